@@ -0,0 +1,119 @@
+//
+//  TUICommitSchedulerSpec.m
+//  TwUITests
+//
+
+#import <TwUI/TUIKit.h>
+
+@interface TUICommitSchedulerSpecView : TUIView
+@property (nonatomic, copy) void (^didLayout)(TUICommitSchedulerSpecView *view);
+@end
+
+@implementation TUICommitSchedulerSpecView
+
+- (void)layoutSubviews
+{
+	[super layoutSubviews];
+	if(self.didLayout)
+		self.didLayout(self);
+}
+
+@end
+
+SpecBegin(TUICommitScheduler)
+
+describe(@"commits", ^{
+	__block TUICommitScheduler *scheduler;
+	__block NSWindow *window;
+	__block TUICommitSchedulerSpecView *superview;
+	__block TUICommitSchedulerSpecView *subview;
+	__block NSMutableArray *laidOut;
+
+	beforeEach(^{
+		[NSApplication sharedApplication];
+		scheduler = [TUICommitScheduler sharedScheduler];
+
+		superview = [[TUICommitSchedulerSpecView alloc] initWithFrame:CGRectMake(0, 0, 100, 100)];
+		subview = [[TUICommitSchedulerSpecView alloc] initWithFrame:CGRectMake(10, 10, 50, 50)];
+		[superview addSubview:subview];
+
+		// views are only laid out by the scheduler once they're in a window
+		window = [[NSWindow alloc] initWithContentRect:NSMakeRect(0, 0, 100, 100) styleMask:NSBorderlessWindowMask backing:NSBackingStoreBuffered defer:NO];
+		[window setReleasedWhenClosed:NO];
+		TUINSView *nsView = [[TUINSView alloc] initWithFrame:NSMakeRect(0, 0, 100, 100)];
+		[window setContentView:nsView];
+		nsView.rootView = superview;
+
+		// settled, so the commits below only have what each example asks for
+		[superview layoutIfNeeded];
+		[subview layoutIfNeeded];
+		[scheduler commit];
+
+		laidOut = [NSMutableArray array];
+		void (^didLayout)(TUICommitSchedulerSpecView *) = ^(TUICommitSchedulerSpecView *view) {
+			[laidOut addObject:view];
+		};
+		superview.didLayout = didLayout;
+		subview.didLayout = didLayout;
+	});
+
+	afterEach(^{
+		superview.didLayout = nil;
+		subview.didLayout = nil;
+		[window close];
+		window = nil;
+	});
+
+	it(@"should lay out a view which asked several times once", ^{
+		[subview setNeedsLayout];
+		[subview setNeedsLayout];
+		[subview setNeedsLayout];
+		[scheduler commit];
+
+		expect(laidOut).to.equal(@[subview]);
+		expect(scheduler.layoutRequestCount).to.equal(3);
+		expect(scheduler.layoutPassCount).to.equal(1);
+		expect(scheduler.savedLayoutPassCount).to.equal(2);
+	});
+
+	it(@"should lay out superviews before their subviews", ^{
+		[subview setNeedsLayout];
+		[superview setNeedsLayout];
+		[scheduler commit];
+
+		expect(laidOut).to.equal(@[superview, subview]);
+	});
+
+	it(@"should not need a commit for passes made without it", ^{
+		[subview.layer setNeedsLayout];
+		[subview layoutIfNeeded];
+
+		expect(laidOut).to.equal(@[subview]);
+		expect([[scheduler valueForKey:@"_needsCommit"] boolValue]).to.beFalsy();
+	});
+
+	it(@"should leave views which keep asking for the next commit", ^{
+		NSUInteger truncatedCommitCount = scheduler.truncatedCommitCount;
+
+		// asks again from each pass, 20 times over
+		__block NSUInteger remaining = 20;
+		__block void (^askAgain)(void) = ^{
+			if(remaining > 0) {
+				remaining--;
+				[scheduler performBeforeCommit:askAgain];
+			}
+		};
+		[scheduler performBeforeCommit:askAgain];
+		[scheduler commit];
+
+		expect(scheduler.truncatedCommitCount).to.equal(truncatedCommitCount + 1);
+		expect(remaining).to.beGreaterThan(0);
+
+		while(remaining > 0)
+			[scheduler commit];
+		[scheduler commit];
+		askAgain = nil;
+	});
+});
+
+SpecEnd
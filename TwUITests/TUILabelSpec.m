@@ -0,0 +1,69 @@
+//
+//  TUILabelSpec.m
+//  TwUITests
+//
+
+#import <TwUI/TUIKit.h>
+
+SpecBegin(TUILabel)
+
+describe(@"one line labels", ^{
+	// draws the label, which draws one line text itself, next to a renderer
+	// set up as the label's would be, which always lays out a frame
+	BOOL (^drawsLikeRenderer)(NSFont *, CGFloat, TUITextVerticalAlignment) = ^(NSFont *font, CGFloat height, TUITextVerticalAlignment verticalAlignment) {
+		CGRect bounds = CGRectMake(0, 0, 200, height);
+		TUILabel *label = [[TUILabel alloc] initWithFrame:bounds];
+		label.backgroundColor = [NSColor whiteColor];
+		label.textColor = [NSColor blackColor];
+		label.font = font;
+		label.text = @"Something to read, gjpqy";
+		label.renderer.verticalAlignment = verticalAlignment;
+
+		NSImage *labelImage = TUIGraphicsDrawAsImage(bounds.size, ^{
+			[label drawRect:bounds];
+		});
+
+		TUITextRenderer *renderer = [[TUITextRenderer alloc] init];
+		renderer.verticalAlignment = verticalAlignment;
+		renderer.attributedString = label.attributedString;
+		renderer.frame = bounds;
+		NSImage *rendererImage = TUIGraphicsDrawAsImage(bounds.size, ^{
+			[[NSColor whiteColor] set];
+			CGContextFillRect(TUIGraphicsGetCurrentContext(), bounds);
+			[renderer draw];
+		});
+
+		return [[labelImage TIFFRepresentation] isEqualToData:[rendererImage TIFFRepresentation]];
+	};
+
+	it(@"should put the baseline where the renderer would when aligned to the middle", ^{
+		NSArray *fonts = @[[NSFont fontWithName:@"Lucida Grande" size:13.0], [NSFont systemFontOfSize:12.0], [NSFont boldSystemFontOfSize:11.0]];
+		for(NSFont *font in fonts) {
+			// text and labels of odd and even heights round differently
+			for(CGFloat height = 17.0; height <= 22.0; height++)
+				expect(drawsLikeRenderer(font, height, TUITextVerticalAlignmentMiddle)).to.beTruthy();
+		}
+	});
+
+	it(@"should put the baseline where the renderer would when aligned to the top", ^{
+		expect(drawsLikeRenderer([NSFont fontWithName:@"Lucida Grande" size:13.0], 20.0, TUITextVerticalAlignmentTop)).to.beTruthy();
+	});
+});
+
+describe(@"setters", ^{
+	it(@"should take the old string off the renderer", ^{
+		TUILabel *label = [[TUILabel alloc] initWithFrame:CGRectMake(0, 0, 200, 20)];
+		label.text = @"Before";
+		expect([label.attributedString string]).to.equal(@"Before");
+
+		label.font = [NSFont systemFontOfSize:20.0];
+		expect(label.renderer.attributedString).to.beNil();
+
+		label.text = @"After";
+		expect(label.renderer.attributedString).to.beNil();
+		expect([label.attributedString string]).to.equal(@"After");
+		expect(label.renderer.attributedString).to.equal(label.attributedString);
+	});
+});
+
+SpecEnd
@@ -0,0 +1,107 @@
+//
+//  TUIRenderSchedulerSpec.m
+//  TwUITests
+//
+
+#import <TwUI/TUIKit.h>
+#import <libkern/OSAtomic.h>
+
+// Runs the main run loop, which finished renders are handed back on, until
+// @p condition holds or a few seconds have gone by.
+static BOOL TUIRenderSchedulerSpecRunUntil(BOOL (^condition)(void))
+{
+	NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:5.0];
+	while(!condition() && [timeout timeIntervalSinceNow] > 0)
+		[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+	return condition();
+}
+
+SpecBegin(TUIRenderScheduler)
+
+describe(@"rendering", ^{
+	__block TUIRenderScheduler *scheduler;
+	__block NSUInteger maximumConcurrentRenders;
+	__block TUIView *first;
+	__block TUIView *second;
+	__block dispatch_semaphore_t firstMayFinish;
+
+	beforeEach(^{
+		scheduler = [TUIRenderScheduler sharedScheduler];
+		maximumConcurrentRenders = scheduler.maximumConcurrentRenders;
+		first = [[TUIView alloc] initWithFrame:CGRectMake(0, 0, 10, 10)];
+		second = [[TUIView alloc] initWithFrame:CGRectMake(0, 0, 10, 10)];
+		firstMayFinish = dispatch_semaphore_create(0);
+	});
+
+	afterEach(^{
+		scheduler.maximumConcurrentRenders = maximumConcurrentRenders;
+	});
+
+	it(@"should coalesce renders scheduled before the view's render starts", ^{
+		scheduler.maximumConcurrentRenders = 1;
+
+		// holds up the only worker, so the second view's renders have to wait
+		[scheduler scheduleRenderForView:first priority:TUIRenderPriorityHigh queue:nil usingBlock:^id{
+			dispatch_semaphore_wait(firstMayFinish, DISPATCH_TIME_FOREVER);
+			return @"first";
+		}];
+
+		__block int32_t renderCount = 0;
+		for(NSUInteger i = 0; i < 3; i++) {
+			NSString *contents = [NSString stringWithFormat:@"second %lu", (unsigned long)i];
+			[scheduler scheduleRenderForView:second priority:TUIRenderPriorityHigh queue:nil usingBlock:^id{
+				OSAtomicIncrement32(&renderCount);
+				return contents;
+			}];
+		}
+
+		dispatch_semaphore_signal(firstMayFinish);
+		expect(TUIRenderSchedulerSpecRunUntil(^{ return (BOOL)(second.layer.contents != nil); })).to.beTruthy();
+		expect(renderCount).to.equal(1);
+		expect(second.layer.contents).to.equal(@"second 2");
+	});
+
+	it(@"should throw away a running render when the view asks again", ^{
+		[scheduler scheduleRenderForView:first priority:TUIRenderPriorityHigh queue:nil usingBlock:^id{
+			dispatch_semaphore_wait(firstMayFinish, DISPATCH_TIME_FOREVER);
+			return @"out of date";
+		}];
+		[scheduler scheduleRenderForView:first priority:TUIRenderPriorityHigh queue:nil usingBlock:^id{
+			return @"up to date";
+		}];
+
+		dispatch_semaphore_signal(firstMayFinish);
+		expect(TUIRenderSchedulerSpecRunUntil(^{ return (BOOL)(first.layer.contents != nil); })).to.beTruthy();
+		expect(first.layer.contents).to.equal(@"up to date");
+
+		// nothing else is on its way to replace it
+		[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+		expect(first.layer.contents).to.equal(@"up to date");
+	});
+
+	it(@"should commit renders in the order they were scheduled", ^{
+		scheduler.maximumConcurrentRenders = 2;
+
+		__block int32_t secondFinished = 0;
+		[scheduler scheduleRenderForView:first priority:TUIRenderPriorityHigh queue:nil usingBlock:^id{
+			dispatch_semaphore_wait(firstMayFinish, DISPATCH_TIME_FOREVER);
+			return @"first";
+		}];
+		[scheduler scheduleRenderForView:second priority:TUIRenderPriorityHigh queue:nil usingBlock:^id{
+			OSAtomicIncrement32Barrier(&secondFinished);
+			return @"second";
+		}];
+
+		// the second render is done, but waits for the first to land
+		TUIRenderSchedulerSpecRunUntil(^{ return (BOOL)(secondFinished > 0); });
+		[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+		expect(second.layer.contents).to.beNil();
+
+		dispatch_semaphore_signal(firstMayFinish);
+		expect(TUIRenderSchedulerSpecRunUntil(^{ return (BOOL)(second.layer.contents != nil); })).to.beTruthy();
+		expect(first.layer.contents).to.equal(@"first");
+		expect(second.layer.contents).to.equal(@"second");
+	});
+});
+
+SpecEnd
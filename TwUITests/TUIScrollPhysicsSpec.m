@@ -0,0 +1,113 @@
+//
+//  TUIScrollPhysicsSpec.m
+//  TwUITests
+//
+
+#import <TwUI/TUIKit.h>
+
+// The frame rates stepped at, and how many frames each has between samples,
+// so the samples all fall at the same timestamps: every 30th of a second.
+static const NSUInteger TUIScrollPhysicsSpecRates[] = {30, 60, 120};
+static const NSUInteger TUIScrollPhysicsSpecRateCount = 3;
+static const NSUInteger TUIScrollPhysicsSpecSampleCount = 30;
+
+static const CGFloat TUIScrollPhysicsSpecTolerance = 0.0001;
+
+typedef TUIScrollPhysicsState (^TUIScrollPhysicsSpecStep)(TUIScrollPhysicsState state, CFTimeInterval dt);
+
+// Steps at a frame rate for a second, writing out where it is every 30th of a second.
+static void TUIScrollPhysicsSpecSample(TUIScrollPhysicsState state, NSUInteger rate, TUIScrollPhysicsSpecStep step, TUIScrollPhysicsState *samples)
+{
+	NSUInteger framesPerSample = rate / 30;
+	for(NSUInteger i = 0; i < TUIScrollPhysicsSpecSampleCount; i++) {
+		for(NSUInteger j = 0; j < framesPerSample; j++)
+			state = step(state, 1.0 / rate);
+		samples[i] = state;
+	}
+}
+
+// How far the furthest sample at any frame rate is from one step straight
+// to the same time, in position or velocity.
+static CGFloat TUIScrollPhysicsSpecPathError(TUIScrollPhysicsState start, TUIScrollPhysicsSpecStep step)
+{
+	CGFloat error = 0.0;
+	for(NSUInteger r = 0; r < TUIScrollPhysicsSpecRateCount; r++) {
+		TUIScrollPhysicsState samples[TUIScrollPhysicsSpecSampleCount];
+		TUIScrollPhysicsSpecSample(start, TUIScrollPhysicsSpecRates[r], step, samples);
+
+		for(NSUInteger i = 0; i < TUIScrollPhysicsSpecSampleCount; i++) {
+			TUIScrollPhysicsState expected = step(start, (i + 1) / 30.0);
+			error = MAX(error, fabs(samples[i].position - expected.position));
+			error = MAX(error, fabs(samples[i].velocity - expected.velocity));
+		}
+	}
+	return error;
+}
+
+SpecBegin(TUIScrollPhysics)
+
+describe(@"decay", ^{
+	CGFloat decayRate = TUIScrollPhysicsDecayRateForDecelerationRate(0.95);
+	TUIScrollPhysicsSpecStep step = ^(TUIScrollPhysicsState state, CFTimeInterval dt) {
+		return TUIScrollPhysicsDecay(state, decayRate, dt);
+	};
+
+	it(@"should follow the same path at any frame rate", ^{
+		expect(TUIScrollPhysicsSpecPathError(TUIScrollPhysicsStateMake(0.0, 3000.0), step)).to.beLessThan(TUIScrollPhysicsSpecTolerance);
+	});
+
+	it(@"should come to rest at the decay distance", ^{
+		TUIScrollPhysicsState state = step(TUIScrollPhysicsStateMake(0.0, 3000.0), 10.0);
+		expect(state.position).to.beCloseToWithin(TUIScrollPhysicsDecayDistance(3000.0, decayRate), 0.01);
+	});
+});
+
+describe(@"spring", ^{
+	CGFloat frequency = 20.0;
+	TUIScrollPhysicsSpecStep step = ^(TUIScrollPhysicsState state, CFTimeInterval dt) {
+		return TUIScrollPhysicsSpring(state, frequency, dt);
+	};
+
+	it(@"should follow the same path at any frame rate", ^{
+		expect(TUIScrollPhysicsSpecPathError(TUIScrollPhysicsStateMake(100.0, -500.0), step)).to.beLessThan(TUIScrollPhysicsSpecTolerance);
+	});
+
+	it(@"should settle without overshooting", ^{
+		// pulled back from rest, and from being thrown further out
+		TUIScrollPhysicsState starts[] = {TUIScrollPhysicsStateMake(100.0, 0.0), TUIScrollPhysicsStateMake(0.0, 500.0)};
+		for(NSUInteger s = 0; s < 2; s++) {
+			for(NSUInteger r = 0; r < TUIScrollPhysicsSpecRateCount; r++) {
+				TUIScrollPhysicsState samples[TUIScrollPhysicsSpecSampleCount];
+				TUIScrollPhysicsSpecSample(starts[s], TUIScrollPhysicsSpecRates[r], step, samples);
+
+				for(NSUInteger i = 0; i < TUIScrollPhysicsSpecSampleCount; i++)
+					expect(samples[i].position).to.beGreaterThanOrEqualTo(0.0);
+				expect(samples[TUIScrollPhysicsSpecSampleCount - 1].position).to.beCloseToWithin(0.0, 0.01);
+			}
+		}
+	});
+});
+
+describe(@"approach", ^{
+	CGFloat decayRate = TUIScrollPhysicsDecayRateForDecelerationRate(0.8);
+	TUIScrollPhysicsSpecStep step = ^(TUIScrollPhysicsState state, CFTimeInterval dt) {
+		return TUIScrollPhysicsStateMake(TUIScrollPhysicsApproach(state.position, 100.0, decayRate, dt), 0.0);
+	};
+
+	it(@"should follow the same path at any frame rate", ^{
+		expect(TUIScrollPhysicsSpecPathError(TUIScrollPhysicsStateMake(0.0, 0.0), step)).to.beLessThan(TUIScrollPhysicsSpecTolerance);
+	});
+
+	it(@"should not pass its destination", ^{
+		for(NSUInteger r = 0; r < TUIScrollPhysicsSpecRateCount; r++) {
+			TUIScrollPhysicsState samples[TUIScrollPhysicsSpecSampleCount];
+			TUIScrollPhysicsSpecSample(TUIScrollPhysicsStateMake(0.0, 0.0), TUIScrollPhysicsSpecRates[r], step, samples);
+
+			for(NSUInteger i = 0; i < TUIScrollPhysicsSpecSampleCount; i++)
+				expect(samples[i].position).to.beLessThanOrEqualTo(100.0);
+			expect(samples[TUIScrollPhysicsSpecSampleCount - 1].position).to.beCloseToWithin(100.0, 0.01);
+		}
+	});
+});
+
+SpecEnd
@@ -0,0 +1,57 @@
+//
+//  TUIScrollViewSpec.m
+//  TwUITests
+//
+
+#import <TwUI/TUIKit.h>
+
+// A continuous (trackpad) scroll of @p delta points down.
+static NSEvent *TUIScrollViewSpecScrollEvent(int32_t delta)
+{
+	CGEventRef cgEvent = CGEventCreateScrollWheelEvent(NULL, kCGScrollEventUnitPixel, 1, -delta);
+	CGEventSetIntegerValueField(cgEvent, kCGScrollWheelEventIsContinuous, 1);
+	CGEventSetIntegerValueField(cgEvent, kCGScrollWheelEventPointDeltaAxis1, -delta);
+	NSEvent *event = [NSEvent eventWithCGEvent:cgEvent];
+	CFRelease(cgEvent);
+	return event;
+}
+
+SpecBegin(TUIScrollView)
+
+describe(@"coalesced scroll events", ^{
+	__block TUIScrollView *scrollView;
+
+	beforeEach(^{
+		scrollView = [[TUIScrollView alloc] initWithFrame:CGRectMake(0, 0, 100, 100)];
+		scrollView.contentSize = CGSizeMake(100, 1000);
+		scrollView.contentOffset = CGPointMake(0, -450);
+	});
+
+	it(@"should wait for the next frame to move the content", ^{
+		[scrollView scrollWheel:TUIScrollViewSpecScrollEvent(10)];
+		expect(scrollView.contentOffset.y).to.equal(-450);
+
+		// which turning coalescing off stands in for
+		scrollView.coalescesScrollEvents = NO;
+		expect(scrollView.contentOffset.y).notTo.equal(-450);
+	});
+
+	it(@"should carry on from an offset set before the next frame", ^{
+		[scrollView scrollWheel:TUIScrollViewSpecScrollEvent(10)];
+		scrollView.coalescesScrollEvents = NO;
+		CGFloat scrolled = scrollView.contentOffset.y - -450;
+
+		scrollView.coalescesScrollEvents = YES;
+		scrollView.contentOffset = CGPointMake(0, -450);
+		[scrollView scrollWheel:TUIScrollViewSpecScrollEvent(10)];
+
+		// as a table view keeping a row in place does
+		scrollView.contentOffset = CGPointMake(0, -300);
+		expect(scrollView.contentOffset.y).to.equal(-300);
+
+		scrollView.coalescesScrollEvents = NO;
+		expect(scrollView.contentOffset.y).to.equal(-300 + scrolled);
+	});
+});
+
+SpecEnd
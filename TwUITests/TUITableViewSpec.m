@@ -0,0 +1,191 @@
+//
+//  TUITableViewSpec.m
+//  TwUITests
+//
+
+#import <TwUI/TUIKit.h>
+#import <pthread.h>
+
+@interface TUITableViewSpecDataSource : NSObject <TUITableViewDataSource, TUITableViewDelegate>
+@property (nonatomic, assign) NSInteger numberOfSections;
+@property (nonatomic, assign) NSInteger numberOfRowsPerSection;
+@end
+
+@implementation TUITableViewSpecDataSource
+
+- (id)init
+{
+	if((self = [super init])) {
+		_numberOfSections = 1;
+		_numberOfRowsPerSection = 10000;
+	}
+	return self;
+}
+
+- (NSInteger)numberOfSectionsInTableView:(TUITableView *)tableView
+{
+	return _numberOfSections;
+}
+
+- (NSInteger)tableView:(TUITableView *)table numberOfRowsInSection:(NSInteger)section
+{
+	return _numberOfRowsPerSection;
+}
+
+- (CGFloat)tableView:(TUITableView *)tableView heightForRowAtIndexPath:(NSIndexPath *)indexPath
+{
+	return 44.0;
+}
+
+- (TUITableViewCell *)tableView:(TUITableView *)tableView cellForRowAtIndexPath:(NSIndexPath *)indexPath
+{
+	TUITableViewCell *cell = [tableView dequeueReusableCellWithIdentifier:@"cell"];
+	if(cell == nil)
+		cell = [[TUITableViewCell alloc] initWithStyle:TUITableViewCellStyleDefault reuseIdentifier:@"cell"];
+	return cell;
+}
+
+@end
+
+// malloc calls this after every allocation and free when it's set
+typedef void (TUITableViewSpecMallocLogger)(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t numberOfFramesToSkip);
+extern TUITableViewSpecMallocLogger *malloc_logger;
+
+// the allocate bit in the logger's type, set for mallocs and reallocs
+static const uint32_t TUITableViewSpecMallocLogTypeAllocate = 2;
+
+static pthread_t TUITableViewSpecCountingThread;
+static volatile NSUInteger TUITableViewSpecAllocationCount;
+
+// Counts allocations made on the thread being measured, so other threads
+// allocating at the same time don't make a difference, and allocations
+// freed again straight away still count.
+static void TUITableViewSpecCountAllocation(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3, uintptr_t result, uint32_t numberOfFramesToSkip)
+{
+	if((type & TUITableViewSpecMallocLogTypeAllocate) && pthread_equal(pthread_self(), TUITableViewSpecCountingThread))
+		TUITableViewSpecAllocationCount++;
+}
+
+// Scrolls down a step at a time. After each step the table is laid out
+// through its layer, which scrolling marks, then the scheduler commits what
+// that asked for, as at the end of a run loop turn. Returns how many
+// allocations scrolling and laying the table out made. The commit is left
+// out: it draws the cells which came into view, and each drawing makes an
+// image for its layer.
+static NSUInteger TUITableViewSpecScroll(TUITableView *tableView, NSUInteger steps, CGFloat step)
+{
+	NSUInteger allocationCount = 0;
+	for(NSUInteger i = 0; i < steps; i++) {
+		@autoreleasepool {
+			TUITableViewSpecCountingThread = pthread_self();
+			TUITableViewSpecAllocationCount = 0;
+			malloc_logger = TUITableViewSpecCountAllocation;
+			
+			CGPoint offset = tableView.contentOffset;
+			offset.y += step;
+			tableView.contentOffset = offset;
+			[tableView layoutIfNeeded];
+			
+			malloc_logger = NULL;
+			allocationCount += TUITableViewSpecAllocationCount;
+			
+			[[TUICommitScheduler sharedScheduler] commit];
+			[CATransaction flush];
+		}
+	}
+	return allocationCount;
+}
+
+SpecBegin(TUITableView)
+
+describe(@"row lookup", ^{
+	// Looks up the row at evenly spaced offsets down a table of rowCount rows,
+	// checking each against its row rect. Returns the seconds taken per lookup.
+	NSTimeInterval (^lookUpRows)(NSInteger) = ^(NSInteger rowCount) {
+		TUITableViewSpecDataSource *dataSource = [[TUITableViewSpecDataSource alloc] init];
+		dataSource.numberOfSections = 4;
+		dataSource.numberOfRowsPerSection = rowCount / 4;
+		TUITableView *tableView = [[TUITableView alloc] initWithFrame:CGRectMake(0, 0, 320, 480) style:TUITableViewStylePlain];
+		tableView.dataSource = dataSource;
+		tableView.delegate = dataSource;
+		[tableView reloadData];
+		
+		const NSUInteger lookups = 2000;
+		CGFloat contentHeight = tableView.contentSize.height;
+		NSUInteger misses = 0;
+		CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+		for(NSUInteger i = 0; i < lookups; i++) {
+			CGFloat offset = floor(contentHeight * (i + 0.5) / lookups);
+			NSIndexPath *indexPath = [tableView indexPathForRowAtVerticalOffset:offset];
+			CGRect rect = (indexPath != nil) ? [tableView rectForRowAtIndexPath:indexPath] : CGRectNull;
+			if(offset < CGRectGetMinY(rect) || offset > CGRectGetMaxY(rect))
+				misses++;
+		}
+		NSTimeInterval elapsed = (CFAbsoluteTimeGetCurrent() - start) / lookups;
+		
+		expect(misses).to.equal(0);
+		
+		CGRect visibleRect = CGRectMake(0, floor(contentHeight / 3), 320, 480);
+		for(NSIndexPath *indexPath in [tableView indexPathsForRowsInRect:visibleRect])
+			expect(CGRectIntersectsRect([tableView rectForRowAtIndexPath:indexPath], visibleRect)).to.beTruthy();
+		expect([[tableView indexPathsForRowsInRect:visibleRect] count]).to.beGreaterThanOrEqualTo(480 / 44);
+		
+		NSLog(@"%ld rows: %.2f us per row lookup", (long)rowCount, elapsed * 1e6);
+		return elapsed;
+	};
+	
+	it(@"should take about as long however many rows there are", ^{
+		NSTimeInterval small = lookUpRows(10000);
+		lookUpRows(100000);
+		NSTimeInterval large = lookUpRows(1000000);
+		
+		// a walk through every row would be a hundred times slower
+		expect(large).to.beLessThan(small * 10);
+	});
+});
+
+describe(@"scrolling", ^{
+	__block TUITableViewSpecDataSource *dataSource;
+	__block TUITableView *tableView;
+	__block NSWindow *window;
+
+	beforeEach(^{
+		[NSApplication sharedApplication];
+		
+		dataSource = [[TUITableViewSpecDataSource alloc] init];
+		tableView = [[TUITableView alloc] initWithFrame:CGRectMake(0, 0, 320, 480) style:TUITableViewStylePlain];
+		tableView.dataSource = dataSource;
+		tableView.delegate = dataSource;
+		
+		// in a window, so it's laid out and drawn the way it is on screen
+		window = [[NSWindow alloc] initWithContentRect:NSMakeRect(0, 0, 320, 480) styleMask:NSBorderlessWindowMask backing:NSBackingStoreBuffered defer:NO];
+		[window setReleasedWhenClosed:NO];
+		TUINSView *nsView = [[TUINSView alloc] initWithFrame:NSMakeRect(0, 0, 320, 480)];
+		[window setContentView:nsView];
+		nsView.rootView = tableView;
+		
+		[tableView reloadData];
+		[tableView scrollToTopAnimated:NO];
+		TUITableViewSpecScroll(tableView, 1, 0.0);
+	});
+	
+	afterEach(^{
+		[window close];
+		window = nil;
+	});
+
+	it(@"should not allocate once the reuse pool is warm", ^{
+		// steps which aren't a whole number of rows, so rows enter and leave at different points in each step
+		const NSUInteger steps = 200;
+		const CGFloat step = 7.0;
+
+		// a first pass over the same distance fills the reuse pool and whatever else grows to a steady size
+		TUITableViewSpecScroll(tableView, steps, step);
+		[tableView scrollToTopAnimated:NO];
+		TUITableViewSpecScroll(tableView, 1, 0.0);
+
+		expect(TUITableViewSpecScroll(tableView, steps, step)).to.equal(0);
+	});
+});
+
+SpecEnd
@@ -0,0 +1,103 @@
+//
+//  TUITextEditorSpec.m
+//  TwUITests
+//
+
+#import <TwUI/TUIKit.h>
+
+// @p count paragraphs of about @p length characters each.
+static NSString *TUITextEditorSpecText(NSUInteger count, NSUInteger length)
+{
+	NSMutableString *text = [NSMutableString string];
+	for(NSUInteger i = 0; i < count; i++) {
+		NSUInteger start = [text length];
+		[text appendFormat:@"Paragraph %lu.", (unsigned long)i];
+		while([text length] - start < length)
+			[text appendString:@" Lorem ipsum dolor sit amet."];
+		[text appendString:@"\n"];
+	}
+	return text;
+}
+
+static TUITextEditor *TUITextEditorSpecEditor(NSString *text)
+{
+	TUITextEditor *editor = [[TUITextEditor alloc] init];
+	editor.defaultAttributes = @{NSFontAttributeName: [NSFont systemFontOfSize:13.0]};
+	editor.frame = CGRectMake(0, 0, 300, 10000);
+	editor.editable = YES;
+	editor.text = text;
+	return editor;
+}
+
+SpecBegin(TUITextEditor)
+
+describe(@"paragraph layout", ^{
+	it(@"should only lay out again the paragraphs an edit touches", ^{
+		NSString *text = TUITextEditorSpecText(200, 300);
+		TUITextEditor *editor = TUITextEditorSpecEditor(text);
+		[editor size];
+		NSArray *before = [[editor valueForKey:@"_paragraphs"] copy];
+
+		NSRange edited = [text paragraphRangeForRange:[text rangeOfString:@"Paragraph 100."]];
+		[editor insertText:@"typed" replacementRange:NSMakeRange(edited.location + 20, 0)];
+		CGSize size = [editor size];
+		NSArray *after = [editor valueForKey:@"_paragraphs"];
+
+		expect([after count]).to.equal([before count]);
+		for(NSUInteger i = 0; i < [after count]; i++) {
+			if(i == 100) {
+				expect([after objectAtIndex:i]).notTo.beIdenticalTo([before objectAtIndex:i]);
+			} else {
+				expect([after objectAtIndex:i]).to.beIdenticalTo([before objectAtIndex:i]);
+			}
+		}
+
+		// and ends up laid out the same as the edited text from scratch
+		CGSize expected = [TUITextEditorSpecEditor(editor.text) size];
+		expect(size.width).to.equal(expected.width);
+		expect(size.height).to.equal(expected.height);
+	});
+
+	it(@"should lay out paragraphs split and joined by an edit", ^{
+		NSString *text = TUITextEditorSpecText(20, 300);
+		TUITextEditor *editor = TUITextEditorSpecEditor(text);
+		[editor size];
+		NSUInteger count = [[editor valueForKey:@"_paragraphs"] count];
+
+		NSRange edited = [text paragraphRangeForRange:[text rangeOfString:@"Paragraph 10."]];
+		[editor insertText:@"\n" replacementRange:NSMakeRange(edited.location + 20, 0)];
+		expect([[editor valueForKey:@"_paragraphs"] count]).to.equal(count + 1);
+		expect([editor size].height).to.equal([TUITextEditorSpecEditor(editor.text) size].height);
+
+		[editor deleteCharactersInRange:NSMakeRange(edited.location + 20, 1)];
+		expect([[editor valueForKey:@"_paragraphs"] count]).to.equal(count);
+		expect([editor size].height).to.equal([TUITextEditorSpecEditor(editor.text) size].height);
+	});
+
+	it(@"should take about as long to type into however many paragraphs there are", ^{
+		// seconds per keystroke, each laid out before the next
+		NSTimeInterval (^type)(NSUInteger) = ^(NSUInteger paragraphCount) {
+			TUITextEditor *editor = TUITextEditorSpecEditor(TUITextEditorSpecText(paragraphCount, 300));
+			[editor size];
+
+			const NSUInteger keystrokes = 50;
+			NSUInteger location = [editor.text length] / 2;
+			CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+			for(NSUInteger i = 0; i < keystrokes; i++) {
+				[editor insertText:@"a" replacementRange:NSMakeRange(location + i, 0)];
+				[editor size];
+			}
+			NSTimeInterval elapsed = (CFAbsoluteTimeGetCurrent() - start) / keystrokes;
+			NSLog(@"%lu paragraphs: %.2f ms per keystroke", (unsigned long)paragraphCount, elapsed * 1e3);
+			return elapsed;
+		};
+
+		NSTimeInterval small = type(10);
+		NSTimeInterval large = type(1000);
+
+		// laying out the whole text again would be a hundred times slower
+		expect(large).to.beLessThan(small * 10);
+	});
+});
+
+SpecEnd
@@ -0,0 +1,100 @@
+//
+//  TUITextRendererSpec.m
+//  TwUITests
+//
+
+#import <TwUI/TUIKit.h>
+#import <TwUI/ABActiveRange.h>
+
+@interface TUITextRendererSpecDelegate : NSObject <TUITextRendererDelegate>
+@property (nonatomic, copy) NSArray *activeRanges;
+@property (nonatomic, assign) NSUInteger askedCount;
+@end
+
+@implementation TUITextRendererSpecDelegate
+
+- (NSArray *)activeRangesForTextRenderer:(TUITextRenderer *)t
+{
+	self.askedCount++;
+	return self.activeRanges;
+}
+
+@end
+
+static ABFlavoredRange *TUITextRendererSpecRange(NSUInteger location, NSUInteger length)
+{
+	ABFlavoredRange *range = [[ABFlavoredRange alloc] init];
+	range.rangeValue = NSMakeRange(location, length);
+	return range;
+}
+
+SpecBegin(TUITextRenderer)
+
+describe(@"active ranges", ^{
+	__block TUITextRenderer *renderer;
+	__block TUITextRendererSpecDelegate *delegate;
+
+	beforeEach(^{
+		renderer = [[TUITextRenderer alloc] init];
+		renderer.attributedString = [TUIAttributedString stringWithString:@"Hello world, this is a link."];
+		renderer.frame = CGRectMake(0, 0, 1000, 20);
+		delegate = [[TUITextRendererSpecDelegate alloc] init];
+		renderer.delegate = delegate;
+	});
+
+	afterEach(^{
+		renderer.delegate = nil;
+	});
+
+	it(@"should find the range at an index", ^{
+		NSMutableArray *ranges = [NSMutableArray array];
+		for(NSUInteger i = 0; i < 1000; i++)
+			[ranges addObject:TUITextRendererSpecRange(i * 10, 3)];
+		delegate.activeRanges = ranges;
+
+		for(NSUInteger i = 0; i < 1000; i++) {
+			expect([renderer activeRangeForStringIndex:i * 10 + 1]).to.beIdenticalTo([ranges objectAtIndex:i]);
+			expect([renderer activeRangeForStringIndex:i * 10 + 5]).to.beNil();
+		}
+	});
+
+	it(@"should prefer the range earlier in the delegate's array where they overlap", ^{
+		ABFlavoredRange *outer = TUITextRendererSpecRange(0, 20);
+		ABFlavoredRange *inner = TUITextRendererSpecRange(5, 3);
+		ABFlavoredRange *later = TUITextRendererSpecRange(18, 10);
+		delegate.activeRanges = @[later, outer, inner];
+
+		expect([renderer activeRangeForStringIndex:6]).to.beIdenticalTo(outer);
+		expect([renderer activeRangeForStringIndex:19]).to.beIdenticalTo(later);
+		expect([renderer activeRangeForStringIndex:25]).to.beIdenticalTo(later);
+		expect([renderer activeRangeForStringIndex:28]).to.beNil();
+	});
+
+	it(@"should only ask the delegate again once invalidated", ^{
+		delegate.activeRanges = @[TUITextRendererSpecRange(13, 4)];
+		[renderer activeRangeForStringIndex:14];
+		[renderer activeRangeForStringIndex:15];
+		expect(delegate.askedCount).to.equal(1);
+
+		[renderer invalidateActiveRanges];
+		[renderer activeRangeForStringIndex:14];
+		expect(delegate.askedCount).to.equal(2);
+	});
+
+	it(@"should ask the delegate again on mouse down", ^{
+		ABFlavoredRange *original = TUITextRendererSpecRange(13, 4);
+		delegate.activeRanges = @[original];
+		expect([renderer activeRangeForStringIndex:14]).to.beIdenticalTo(original);
+
+		// changed without telling the renderer
+		ABFlavoredRange *changed = TUITextRendererSpecRange(13, 4);
+		delegate.activeRanges = @[changed];
+
+		// well away from either range, so it doesn't wait for a drag
+		NSEvent *event = [NSEvent mouseEventWithType:NSLeftMouseDown location:NSZeroPoint modifierFlags:0 timestamp:0 windowNumber:0 context:nil eventNumber:0 clickCount:1 pressure:1.0];
+		[renderer mouseDown:event];
+		expect([renderer activeRangeForStringIndex:14]).to.beIdenticalTo(changed);
+	});
+});
+
+SpecEnd
@@ -0,0 +1,57 @@
+//
+//  TUITextViewSpec.m
+//  TwUITests
+//
+
+#import <TwUI/TUIKit.h>
+
+SpecBegin(TUITextView)
+
+describe(@"spell checking", ^{
+	__block TUITextView *textView;
+
+	beforeEach(^{
+		textView = [[TUITextView alloc] initWithFrame:CGRectMake(0, 0, 300, 100)];
+		textView.text = @"Thiss sentense has mispeled words in it.\nSo does thiss one.\n";
+		textView.selectedRange = NSMakeRange(0, 0);
+	});
+
+	it(@"should not keep track of edits while it's off", ^{
+		expect([textView valueForKey:@"_uncheckedIndexes"]).to.beNil();
+	});
+
+	it(@"should check text set before it was turned on", ^{
+		textView.spellCheckingEnabled = YES;
+
+		NSIndexSet *uncheckedIndexes = [textView valueForKey:@"_uncheckedIndexes"];
+		expect([uncheckedIndexes containsIndexesInRange:NSMakeRange(0, [textView.text length])]).to.beTruthy();
+
+		// the checker answers asynchronously, on the main queue
+		NSAttributedString *backingStore = [[textView valueForKey:@"renderer"] backingStore];
+		BOOL (^underlined)(void) = ^{
+			__block BOOL found = NO;
+			[backingStore enumerateAttribute:(NSString *)kCTUnderlineStyleAttributeName inRange:NSMakeRange(0, [backingStore length]) options:0 usingBlock:^(id value, NSRange range, BOOL *stop) {
+				if(value != nil) *stop = found = YES;
+			}];
+			return found;
+		};
+		NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:5.0];
+		while(!underlined() && [timeout timeIntervalSinceNow] > 0)
+			[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+		expect(underlined()).to.beTruthy();
+	});
+
+	it(@"should only check what's been edited since", ^{
+		textView.spellCheckingEnabled = YES;
+		[textView performSelector:@selector(_checkSpelling)];
+
+		NSRange secondParagraph = [textView.text paragraphRangeForRange:[textView.text rangeOfString:@"So does"]];
+		[[textView valueForKey:@"renderer"] insertText:@"not " replacementRange:NSMakeRange(secondParagraph.location + 3, 0)];
+
+		NSIndexSet *uncheckedIndexes = [textView valueForKey:@"_uncheckedIndexes"];
+		expect([uncheckedIndexes count]).to.beGreaterThan(0);
+		expect([uncheckedIndexes firstIndex]).to.beGreaterThanOrEqualTo(secondParagraph.location);
+	});
+});
+
+SpecEnd
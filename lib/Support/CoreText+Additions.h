@@ -21,6 +21,41 @@ typedef enum AB_CTLineRectAggregationType : NSUInteger {
 	AB_CTLineRectAggregationTypeBlock,
 } AB_CTLineRectAggregationType;
 
+// What hit testing and range lookups need to know about a frame's lines,
+// gathered once so they don't go back to Core Text (or the heap) per query.
+// Lines are top to bottom, as in CTFrameGetLines().
+typedef struct AB_CTLineMetrics {
+	CTLineRef line; // not retained, owned by the frame
+	CGPoint origin;
+	CGFloat ascent;
+	CGFloat descent;
+	CGFloat leading;
+	CFRange stringRange; // in the whole string
+	CFIndex stringOffset; // where the string the line was typeset from starts in the whole string
+} AB_CTLineMetrics;
+
+typedef struct AB_CTFrameMetrics {
+	CGRect bounds;
+	CFRange stringRange; // of the text which fit in the frame
+	CFIndex lineCount;
+	AB_CTLineMetrics lines[];
+} AB_CTFrameMetrics;
+
+// The metrics are only valid for as long as the frame is.
+extern AB_CTFrameMetrics *AB_CTFrameMetricsCreate(CTFrameRef frame);
+extern void AB_CTFrameMetricsRelease(AB_CTFrameMetrics *metrics);
+
+// Metrics for several frames stacked into one, such as one frame per paragraph.
+// The lines of frames[i] are offset by offsets[i], and their string indexes by stringOffsets[i].
+extern AB_CTFrameMetrics *AB_CTFrameMetricsCreateWithFrames(CTFrameRef frames[], CGPoint offsets[], CFIndex stringOffsets[], CFIndex frameCount, CGRect bounds, CFRange stringRange);
+
+// Binary searches for the line containing the string index, or the first line after it.
+extern CFIndex AB_CTFrameMetricsGetLineIndexForStringIndex(const AB_CTFrameMetrics *metrics, CFIndex index);
+extern CFIndex AB_CTFrameMetricsGetStringIndexForPosition(const AB_CTFrameMetrics *metrics, CGPoint p);
+extern void AB_CTFrameMetricsGetRectsForRangeWithAggregationType(const AB_CTFrameMetrics *metrics, CFRange range, AB_CTLineRectAggregationType aggregationType, CGRect rects[], CFIndex *rectCount);
+extern void AB_CTFrameMetricsGetLinePositionOfIndex(const AB_CTFrameMetrics *metrics, CFIndex index, CFIndex *lineIndex, float *xPosition);
+extern CFIndex AB_CTFrameMetricsGetIndexForPositionInLine(const AB_CTFrameMetrics *metrics, CFIndex lineIndex, float xPosition);
+
 extern CGSize AB_CTLineGetSize(CTLineRef line);
 extern CGSize AB_CTFrameGetSize(CTFrameRef frame);
 extern CGFloat AB_CTFrameGetHeight(CTFrameRef frame);
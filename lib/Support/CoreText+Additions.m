@@ -86,51 +86,159 @@ CGFloat AB_CTFrameGetHeight(CTFrameRef f)
 	return 0.0;
 }
 
-CFIndex AB_CTFrameGetStringIndexForPosition(CTFrameRef frame, CGPoint p)
+static AB_CTFrameMetrics *AB_CTFrameMetricsCreateWithLines(CFArrayRef lines, const CGPoint *lineOrigins, CGRect bounds, CFRange stringRange)
 {
-	NSArray *lines = (__bridge NSArray *)CTFrameGetLines(frame);
+	CFIndex linesCount = CFArrayGetCount(lines);
+	AB_CTFrameMetrics *metrics = (AB_CTFrameMetrics *) malloc(sizeof(AB_CTFrameMetrics) + sizeof(AB_CTLineMetrics) * linesCount);
+	metrics->bounds = bounds;
+	metrics->stringRange = stringRange;
+	metrics->lineCount = linesCount;
 	
-	CFIndex linesCount = [lines count];
+	for(CFIndex i = 0; i < linesCount; ++i) {
+		AB_CTLineMetrics *m = &metrics->lines[i];
+		m->line = (CTLineRef)CFArrayGetValueAtIndex(lines, i);
+		m->origin = lineOrigins[i];
+		CTLineGetTypographicBounds(m->line, &m->ascent, &m->descent, &m->leading);
+		m->stringRange = CTLineGetStringRange(m->line);
+		m->stringOffset = 0;
+	}
+	
+	return metrics;
+}
+
+AB_CTFrameMetrics *AB_CTFrameMetricsCreate(CTFrameRef frame)
+{
+	CGRect bounds;
+	CGPathIsRect(CTFrameGetPath(frame), &bounds);
+	
+	CFArrayRef lines = CTFrameGetLines(frame);
+	CFIndex linesCount = CFArrayGetCount(lines);
 	CGPoint *lineOrigins = (CGPoint *) malloc(sizeof(CGPoint) * linesCount);
 	CTFrameGetLineOrigins(frame, CFRangeMake(0, linesCount), lineOrigins);
 	
-	CTLineRef line = NULL;
-	CGPoint lineOrigin = CGPointZero;
+	AB_CTFrameMetrics *metrics = AB_CTFrameMetricsCreateWithLines(lines, lineOrigins, bounds, CTFrameGetStringRange(frame));
+	free(lineOrigins);
+	return metrics;
+}
+
+AB_CTFrameMetrics *AB_CTFrameMetricsCreateWithFrames(CTFrameRef frames[], CGPoint offsets[], CFIndex stringOffsets[], CFIndex frameCount, CGRect bounds, CFRange stringRange)
+{
+	CFIndex linesCount = 0;
+	for(CFIndex i = 0; i < frameCount; ++i) {
+		linesCount += CFArrayGetCount(CTFrameGetLines(frames[i]));
+	}
 	
-	for(CFIndex i = 0; i < linesCount; ++i) {
-		line = (__bridge CTLineRef)[lines objectAtIndex:i];
-		lineOrigin = lineOrigins[i];
-		CGFloat descent, ascent;
-		CTLineGetTypographicBounds(line, &ascent, &descent, NULL);
-		if(p.y > (floor(lineOrigin.y) - floor(descent))) { // above bottom of line
-			if(i == 0 && (p.y > (ceil(lineOrigin.y) + ceil(ascent)))) { // above top of first line
-				free(lineOrigins);
-				return 0;
-			} else {
-				goto found;
-			}
+	AB_CTFrameMetrics *metrics = (AB_CTFrameMetrics *) malloc(sizeof(AB_CTFrameMetrics) + sizeof(AB_CTLineMetrics) * linesCount);
+	metrics->bounds = bounds;
+	metrics->stringRange = stringRange;
+	metrics->lineCount = linesCount;
+	
+	AB_CTLineMetrics *m = metrics->lines;
+	for(CFIndex i = 0; i < frameCount; ++i) {
+		CFArrayRef lines = CTFrameGetLines(frames[i]);
+		CFIndex frameLinesCount = CFArrayGetCount(lines);
+		for(CFIndex j = 0; j < frameLinesCount; ++j, ++m) {
+			m->line = (CTLineRef)CFArrayGetValueAtIndex(lines, j);
+			CTFrameGetLineOrigins(frames[i], CFRangeMake(j, 1), &m->origin);
+			m->origin.x += offsets[i].x;
+			m->origin.y += offsets[i].y;
+			CTLineGetTypographicBounds(m->line, &m->ascent, &m->descent, &m->leading);
+			m->stringRange = CTLineGetStringRange(m->line);
+			m->stringRange.location += stringOffsets[i];
+			m->stringOffset = stringOffsets[i];
 		}
 	}
 	
-	free(lineOrigins);
-	
-	// didn't find a line, must be beneath the last line
-	return CTFrameGetStringRange(frame).length; // last character index
+	return metrics;
+}
 
-found:
+void AB_CTFrameMetricsRelease(AB_CTFrameMetrics *metrics)
+{
+	free(metrics);
+}
 
-	p.x -= lineOrigin.x;
-	p.y -= lineOrigin.y;
+CFIndex AB_CTFrameMetricsGetLineIndexForStringIndex(const AB_CTFrameMetrics *metrics, CFIndex index)
+{
+	// string ranges ascend down the frame
+	CFIndex low = 0;
+	CFIndex high = metrics->lineCount;
+	while(low < high) {
+		CFIndex mid = low + (high - low) / 2;
+		CFRange lineRange = metrics->lines[mid].stringRange;
+		if(lineRange.location + lineRange.length >= index) {
+			high = mid;
+		} else {
+			low = mid + 1;
+		}
+	}
+	return low;
+}
+
+CFIndex AB_CTFrameMetricsGetStringIndexForPosition(const AB_CTFrameMetrics *metrics, CGPoint p)
+{
+	// line bottoms descend down the frame, so find the first one p is above
+	CFIndex low = 0;
+	CFIndex high = metrics->lineCount;
+	while(low < high) {
+		CFIndex mid = low + (high - low) / 2;
+		const AB_CTLineMetrics *m = &metrics->lines[mid];
+		if(p.y > (floor(m->origin.y) - floor(m->descent))) { // above bottom of line
+			high = mid;
+		} else {
+			low = mid + 1;
+		}
+	}
 	
-	if(line) {
-		CFIndex i = CTLineGetStringIndexForPosition(line, p);
-		free(lineOrigins);
-		return i;
+	if(low == metrics->lineCount) {
+		// didn't find a line, must be beneath the last line
+		return metrics->stringRange.length; // last character index
 	}
 	
-	free(lineOrigins);
+	const AB_CTLineMetrics *m = &metrics->lines[low];
+	if(low == 0 && (p.y > (ceil(m->origin.y) + ceil(m->ascent)))) { // above top of first line
+		return 0;
+	}
+	
+	p.x -= m->origin.x;
+	p.y -= m->origin.y;
+	CFIndex index = CTLineGetStringIndexForPosition(m->line, p);
+	return (index == kCFNotFound) ? index : index + m->stringOffset;
+}
+
+void AB_CTFrameMetricsGetLinePositionOfIndex(const AB_CTFrameMetrics *metrics, CFIndex index, CFIndex *lineIndex, float *xPosition)
+{
+	if(metrics->lineCount == 0) {
+		*lineIndex = -1;
+		*xPosition = 0;
+		return;
+	}
+	
+	// the line the index is on, or the last line if it's past them all
+	CFIndex i = AB_CTFrameMetricsGetLineIndexForStringIndex(metrics, index + 1);
+	if(i >= metrics->lineCount)
+		i = metrics->lineCount - 1;
+	
+	const AB_CTLineMetrics *m = &metrics->lines[i];
+	*lineIndex = i;
+	*xPosition = CTLineGetOffsetForStringIndex(m->line, index - m->stringOffset, NULL);
+}
+
+CFIndex AB_CTFrameMetricsGetIndexForPositionInLine(const AB_CTFrameMetrics *metrics, CFIndex lineIndex, float xPosition)
+{
+	if(lineIndex < 0 || lineIndex >= metrics->lineCount)
+		return 0;
 	
-	return 0;
+	const AB_CTLineMetrics *m = &metrics->lines[lineIndex];
+	CFIndex index = CTLineGetStringIndexForPosition(m->line, CGPointMake(xPosition, 0));
+	return (index == kCFNotFound) ? index : index + m->stringOffset;
+}
+
+CFIndex AB_CTFrameGetStringIndexForPosition(CTFrameRef frame, CGPoint p)
+{
+	AB_CTFrameMetrics *metrics = AB_CTFrameMetricsCreate(frame);
+	CFIndex index = AB_CTFrameMetricsGetStringIndexForPosition(metrics, p);
+	AB_CTFrameMetricsRelease(metrics);
+	return index;
 }
 
 static inline BOOL RangeContainsIndex(CFRange range, CFIndex index)
@@ -185,19 +293,35 @@ void AB_CTFrameGetRectsForRange(CTFrameRef frame, CFRange range, CGRect rects[],
 
 void AB_CTFrameGetRectsForRangeWithAggregationType(CTFrameRef frame, CFRange range, AB_CTLineRectAggregationType aggregationType, CGRect rects[], CFIndex *rectCount)
 {
-	CGRect bounds;
-	CGPathIsRect(CTFrameGetPath(frame), &bounds);
+	AB_CTFrameMetrics *metrics = AB_CTFrameMetricsCreate(frame);
+	AB_CTFrameMetricsGetRectsForRangeWithAggregationType(metrics, range, aggregationType, rects, rectCount);
+	AB_CTFrameMetricsRelease(metrics);
+}
+
+void AB_CTLinesGetRectsForRangeWithAggregationType(NSArray *lines, CGPoint *lineOrigins, CGRect bounds, CFRange range, AB_CTLineRectAggregationType aggregationType, CGRect rects[], CFIndex *rectCount)
+{
+	AB_CTFrameMetrics *metrics = AB_CTFrameMetricsCreateWithLines((__bridge CFArrayRef)lines, lineOrigins, bounds, CFRangeMake(0, 0));
+	AB_CTFrameMetricsGetRectsForRangeWithAggregationType(metrics, range, aggregationType, rects, rectCount);
+	AB_CTFrameMetricsRelease(metrics);
+}
+
+// The rect a line's selection or highlight spans vertically, starting at the line's origin.
+static CGRect AB_CTFrameMetricsGetLineRect(const AB_CTFrameMetrics *metrics, CFIndex i)
+{
+	const AB_CTLineMetrics *m = &metrics->lines[i];
+	CFIndex linesCount = metrics->lineCount;
+	CGRect bounds = metrics->bounds;
 	
-	NSArray *lines = (__bridge NSArray *)CTFrameGetLines(frame);
-	CFIndex linesCount = [lines count];
-	CGPoint *lineOrigins = (CGPoint *) malloc(sizeof(CGPoint) * linesCount);
-	CTFrameGetLineOrigins(frame, CFRangeMake(0, linesCount), lineOrigins);
+	// If we have more than 1 line, we want to find the real height of the line by measuring the distance between the current line and previous line. If it's only 1 line, then we'll guess the line's height.
+	BOOL useRealHeight = i < linesCount - 1;
+	CGFloat neighborLineY = i > 0 ? metrics->lines[i - 1].origin.y : (linesCount - 1 > i ? metrics->lines[i + 1].origin.y : 0.0f);
+	CGFloat lineHeight = ceil(useRealHeight ? floor(fabs(neighborLineY - m->origin.y)) : m->ascent + m->descent + m->leading);
+	CGFloat line_y = round(useRealHeight ? m->origin.y + bounds.origin.y - lineHeight/2 + m->descent : m->origin.y - m->descent + bounds.origin.y);
 	
-	AB_CTLinesGetRectsForRangeWithAggregationType(lines, lineOrigins, bounds, range, aggregationType, rects, rectCount);
-	free(lineOrigins);
+	return CGRectMake(bounds.origin.x + m->origin.x, line_y, 0.0f, lineHeight);
 }
 
-void AB_CTLinesGetRectsForRangeWithAggregationType(NSArray *lines, CGPoint *lineOrigins, CGRect bounds, CFRange range, AB_CTLineRectAggregationType aggregationType, CGRect rects[], CFIndex *rectCount)
+void AB_CTFrameMetricsGetRectsForRangeWithAggregationType(const AB_CTFrameMetrics *metrics, CFRange range, AB_CTLineRectAggregationType aggregationType, CGRect rects[], CFIndex *rectCount)
 {
 	CFIndex maxRects = *rectCount;
 	CFIndex rectIndex = 0;
@@ -205,72 +329,47 @@ void AB_CTLinesGetRectsForRangeWithAggregationType(NSArray *lines, CGPoint *line
 	CFIndex startIndex = range.location;
 	CFIndex endIndex = startIndex + range.length;
 	
-	CFIndex linesCount = [lines count];
+	CGRect bounds = metrics->bounds;
 	
-	for(CFIndex i = 0; i < linesCount; ++i) {
-		CTLineRef line = (__bridge CTLineRef)[lines objectAtIndex:i];
+	// lines ending before the range can't contribute, and neither can lines starting after it
+	for(CFIndex i = AB_CTFrameMetricsGetLineIndexForStringIndex(metrics, startIndex); i < metrics->lineCount; ++i) {
+		const AB_CTLineMetrics *m = &metrics->lines[i];
 		
-		CFRange lineRange = CTLineGetStringRange(line);
-		CFIndex lineStartIndex = lineRange.location;
-		CFIndex lineEndIndex = lineStartIndex + lineRange.length;
+		CFRange lineRange = m->stringRange;
+		if(lineRange.location > endIndex)
+			break;
+		
+		CFIndex lineEndIndex = lineRange.location + lineRange.length;
 		BOOL containsStartIndex = RangeContainsIndex(lineRange, startIndex);
 		BOOL containsEndIndex = RangeContainsIndex(lineRange, endIndex);
 		
 		if(containsStartIndex && containsEndIndex) {
-			CGPoint lineOrigin = lineOrigins[i];
-			CGFloat ascent, descent, leading;
-			CGFloat lineWidth = CTLineGetTypographicBounds(line, &ascent, &descent, &leading);
-			lineWidth = lineWidth;
-			
-			// If we have more than 1 line, we want to find the real height of the line by measuring the distance between the current line and previous line. If it's only 1 line, then we'll guess the line's height.
-			BOOL useRealHeight = i < linesCount - 1;
-			CGFloat neighborLineY = i > 0 ? lineOrigins[i - 1].y : (linesCount - 1 > i ? lineOrigins[i + 1].y : 0.0f);
-			CGFloat lineHeight = ceil(useRealHeight ? abs(neighborLineY - lineOrigin.y) : ascent + descent + leading);
-			CGFloat line_y = round(useRealHeight ? lineOrigin.y + bounds.origin.y - lineHeight/2 + descent : lineOrigin.y - descent + bounds.origin.y);
-			
-			CGFloat startOffset = CTLineGetOffsetForStringIndex(line, startIndex, NULL);
-			CGFloat endOffset = CTLineGetOffsetForStringIndex(line, endIndex, NULL);
-			CGRect r = CGRectMake(bounds.origin.x + lineOrigin.x + startOffset, line_y, endOffset - startOffset, lineHeight);
+			CGFloat startOffset = CTLineGetOffsetForStringIndex(m->line, startIndex - m->stringOffset, NULL);
+			CGFloat endOffset = CTLineGetOffsetForStringIndex(m->line, endIndex - m->stringOffset, NULL);
+			CGRect r = AB_CTFrameMetricsGetLineRect(metrics, i);
+			r.origin.x += startOffset;
+			r.size.width = endOffset - startOffset;
 			if(aggregationType == AB_CTLineRectAggregationTypeBlock) {
 				r.size.width = bounds.size.width - startOffset;
 			}
 			
 			if(rectIndex < maxRects)
 				rects[rectIndex++] = r;
-			goto end;
+			break;
 		} else if(containsStartIndex) {
 			if(startIndex == lineEndIndex)
 				continue;
 			
-			CGPoint lineOrigin = lineOrigins[i];
-			CGFloat ascent, descent, leading;
-			CGFloat lineWidth = CTLineGetTypographicBounds(line, &ascent, &descent, &leading);
-			lineWidth = lineWidth;
-			
-			// If we have more than 1 line, we want to find the real height of the line by measuring the distance between the current line and previous line. If it's only 1 line, then we'll guess the line's height.
-			BOOL useRealHeight = i < linesCount - 1;
-			CGFloat neighborLineY = i > 0 ? lineOrigins[i - 1].y : (linesCount > i ? lineOrigins[i + 1].y : 0.0f);
-			CGFloat lineHeight = ceil(useRealHeight ? abs(neighborLineY - lineOrigin.y) : ascent + descent + leading);
-			CGFloat line_y = round(useRealHeight ? lineOrigin.y + bounds.origin.y - lineHeight/2 + descent : lineOrigin.y - descent + bounds.origin.y);
-			
-			CGFloat startOffset = CTLineGetOffsetForStringIndex(line, startIndex, NULL);
-			CGRect r = CGRectMake(bounds.origin.x + lineOrigin.x + startOffset, line_y, bounds.size.width - startOffset, lineHeight);
+			CGFloat startOffset = CTLineGetOffsetForStringIndex(m->line, startIndex - m->stringOffset, NULL);
+			CGRect r = AB_CTFrameMetricsGetLineRect(metrics, i);
+			r.origin.x += startOffset;
+			r.size.width = bounds.size.width - startOffset;
 			if(rectIndex < maxRects)
 				rects[rectIndex++] = r;
 		} else if(containsEndIndex) {
-			CGPoint lineOrigin = lineOrigins[i];
-			CGFloat ascent, descent, leading;
-			CGFloat lineWidth = CTLineGetTypographicBounds(line, &ascent, &descent, &leading);
-			lineWidth = lineWidth;
-			
-			// If we have more than 1 line, we want to find the real height of the line by measuring the distance between the current line and previous line. If it's only 1 line, then we'll guess the line's height.
-			BOOL useRealHeight = i < linesCount - 1;
-			CGFloat neighborLineY = i > 0 ? lineOrigins[i - 1].y : (linesCount > i ? lineOrigins[i + 1].y : 0.0f);
-			CGFloat lineHeight = ceil(useRealHeight ? abs(neighborLineY - lineOrigin.y) : ascent + descent + leading);
-			CGFloat line_y = round(useRealHeight ? lineOrigin.y + bounds.origin.y - lineHeight/2 + descent : lineOrigin.y - descent + bounds.origin.y);
-			
-			CGFloat endOffset = CTLineGetOffsetForStringIndex(line, endIndex, NULL);
-			CGRect r = CGRectMake(bounds.origin.x + lineOrigin.x, line_y, endOffset, lineHeight);
+			CGFloat endOffset = CTLineGetOffsetForStringIndex(m->line, endIndex - m->stringOffset, NULL);
+			CGRect r = AB_CTFrameMetricsGetLineRect(metrics, i);
+			r.size.width = endOffset;
 			if(aggregationType == AB_CTLineRectAggregationTypeBlock) {
 				r.size.width = bounds.size.width;
 			}
@@ -278,23 +377,12 @@ void AB_CTLinesGetRectsForRangeWithAggregationType(NSArray *lines, CGPoint *line
 			if(rectIndex < maxRects)
 				rects[rectIndex++] = r;
 		} else if(RangeContainsIndex(range, lineRange.location)) {
-			CGPoint lineOrigin = lineOrigins[i];
-			CGFloat ascent, descent, leading;
-			CGFloat lineWidth = CTLineGetTypographicBounds(line, &ascent, &descent, &leading);
-			lineWidth = lineWidth;
-			
-			// If we have more than 1 line, we want to find the real height of the line by measuring the distance between the current line and previous line. If it's only 1 line, then we'll guess the line's height.
-			BOOL useRealHeight = i < linesCount - 1;
-			CGFloat neighborLineY = i > 0 ? lineOrigins[i - 1].y : (linesCount > i ? lineOrigins[i + 1].y : 0.0f);
-			CGFloat lineHeight = ceil(useRealHeight ? abs(neighborLineY - lineOrigin.y) : ascent + descent + leading);
-			CGFloat line_y = round(useRealHeight ? lineOrigin.y + bounds.origin.y - lineHeight/2 + descent : lineOrigin.y - descent + bounds.origin.y);
-			
-			CGRect r = CGRectMake(bounds.origin.x + lineOrigin.x, line_y, bounds.size.width, lineHeight);
+			CGRect r = AB_CTFrameMetricsGetLineRect(metrics, i);
+			r.size.width = bounds.size.width;
 			if(rectIndex < maxRects)
 				rects[rectIndex++] = r;
 		}
 	}
 	
-end:
 	*rectCount = rectIndex;
 }
@@ -12,7 +12,8 @@
 @interface NSFont (TUIExtensions)
 
 // Creates and returns a new font with the given size and fallback font names.
-// The fallback fonts all use the font size passed in.
+// The fallback fonts all use the font size passed in. Asking again with the
+// same name, size and fallback names returns the same font.
 + (NSFont *)tui_fontWithName:(NSString *)fontName size:(CGFloat)fontSize fallbackNames:(NSArray *)fallbackNames;
 
 @end
@@ -12,12 +12,26 @@
 @implementation NSFont (TUIExtensions)
 
 + (NSFont *)tui_fontWithName:(NSString *)fontName size:(CGFloat)fontSize fallbackNames:(NSArray *)fallbackNames {
+	// Fonts are immutable, so the same font and cascade list can be handed
+	// out to everyone who asks, instead of matching descriptors every time.
+	static NSCache *fonts = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		fonts = [[NSCache alloc] init];
+	});
+	
+	NSString *key = [NSString stringWithFormat:@"%@\t%f\t%@", fontName, fontSize, [fallbackNames componentsJoinedByString:@"\t"]];
+	NSFont *font = [fonts objectForKey:key];
+	if(font != nil) return font;
+	
 	NSMutableArray *fallbackDescriptors = [NSMutableArray arrayWithCapacity:fallbackNames.count];
 	for(NSString *fallbackName in fallbackNames) {
 		[fallbackDescriptors addObject:[NSFontDescriptor fontDescriptorWithName:fallbackName size:fontSize]];
 	}
 	
-	return [NSFont fontWithDescriptor:[NSFontDescriptor fontDescriptorWithFontAttributes:@{ NSFontNameAttribute: fontName, NSFontCascadeListAttribute: fallbackDescriptors }] size:fontSize];
+	font = [NSFont fontWithDescriptor:[NSFontDescriptor fontDescriptorWithFontAttributes:@{ NSFontNameAttribute: fontName, NSFontCascadeListAttribute: fallbackDescriptors }] size:fontSize];
+	if(font != nil) [fonts setObject:font forKey:key];
+	return font;
 }
 
 @end
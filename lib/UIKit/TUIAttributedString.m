@@ -111,90 +111,124 @@ NSString * const TUIAttributedStringPreDrawBlockName = @"TUIAttributedStringPreD
 	[self setLineHeight:f inRange:[self _stringRange]];
 }
 
-- (void)setLineHeight:(CGFloat)f inRange:(NSRange)range
+/*
+ Paragraph styles are immutable, so strings with the same settings share
+ one, rather than each making its own. It saves allocating them, and lets
+ Core Text match them up quickly while laying out. The style is returned
+ as an object the caller holds, since the cache may evict it at any time.
+ */
+static id TUIParagraphStyleWithLineHeight(CGFloat lineHeight)
 {
-	CTParagraphStyleSetting settings[] = {
-        { kCTParagraphStyleSpecifierMinimumLineHeight, sizeof(f), &f },
-        { kCTParagraphStyleSpecifierMaximumLineHeight, sizeof(f), &f },
-    };
+	static NSCache *paragraphStyles = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		paragraphStyles = [[NSCache alloc] init];
+	});
 	
-	CTParagraphStyleRef paragraphStyle = CTParagraphStyleCreate(settings, sizeof(settings) / sizeof(settings[0]));
-	[self addAttributes:[NSDictionary dictionaryWithObjectsAndKeys:(__bridge id)paragraphStyle, kCTParagraphStyleAttributeName, nil] range:range];
-	CFRelease(paragraphStyle);
+	NSNumber *key = [NSNumber numberWithDouble:lineHeight];
+	id paragraphStyle = [paragraphStyles objectForKey:key];
+	if(paragraphStyle == nil) {
+		CTParagraphStyleSetting settings[] = {
+			{ kCTParagraphStyleSpecifierMinimumLineHeight, sizeof(lineHeight), &lineHeight },
+			{ kCTParagraphStyleSpecifierMaximumLineHeight, sizeof(lineHeight), &lineHeight },
+		};
+		paragraphStyle = CFBridgingRelease(CTParagraphStyleCreate(settings, sizeof(settings) / sizeof(settings[0])));
+		[paragraphStyles setObject:paragraphStyle forKey:key];
+	}
+	return paragraphStyle;
 }
 
-NSParagraphStyle *ABNSParagraphStyleForTextAlignment(TUITextAlignment alignment)
+static CTTextAlignment TUICTTextAlignment(TUITextAlignment alignment)
 {
-	NSTextAlignment a = NSLeftTextAlignment;
 	switch(alignment) {
 		case TUITextAlignmentRight:
-			a = NSRightTextAlignment;
-			break;
+			return kCTRightTextAlignment;
 		case TUITextAlignmentCenter:
-			a = NSCenterTextAlignment;
-			break;
+			return kCTCenterTextAlignment;
 		case TUITextAlignmentJustified:
-			a = NSJustifiedTextAlignment;
-			break;
+			return kCTJustifiedTextAlignment;
 		case TUITextAlignmentLeft:
 		default:
-			a = NSLeftTextAlignment;
-			break;
+			return kCTLeftTextAlignment;
 	}
-	
-	NSMutableParagraphStyle *p = [[NSParagraphStyle defaultParagraphStyle] mutableCopy];
-	[p setAlignment:a];
-	return p;
 }
 
-- (void)setAlignment:(TUITextAlignment)alignment lineBreakMode:(TUILineBreakMode)lineBreakMode
+static CTLineBreakMode TUICTLineBreakMode(TUILineBreakMode lineBreakMode)
 {
-	CTLineBreakMode nativeLineBreakMode = kCTLineBreakByTruncatingTail;
 	switch(lineBreakMode) {
 		case TUILineBreakModeWordWrap:
-			nativeLineBreakMode = kCTLineBreakByWordWrapping;
-			break;
+			return kCTLineBreakByWordWrapping;
 		case TUILineBreakModeCharacterWrap:
-			nativeLineBreakMode = kCTLineBreakByCharWrapping;
-			break;
+			return kCTLineBreakByCharWrapping;
 		case TUILineBreakModeClip:
-			nativeLineBreakMode = kCTLineBreakByClipping;
-			break;
+			return kCTLineBreakByClipping;
 		case TUILineBreakModeHeadTruncation:
-			nativeLineBreakMode = kCTLineBreakByTruncatingHead;
-			break;
-		case TUILineBreakModeTailTruncation:
-			nativeLineBreakMode = kCTLineBreakByTruncatingTail;
-			break;
+			return kCTLineBreakByTruncatingHead;
 		case TUILineBreakModeMiddleTruncation:
-			nativeLineBreakMode = kCTLineBreakByTruncatingMiddle;
-			break;
-	}
-	
-	CTTextAlignment nativeTextAlignment;
-	switch(alignment) {
-		case TUITextAlignmentRight:
-			nativeTextAlignment = kCTRightTextAlignment;
-			break;
-		case TUITextAlignmentCenter:
-			nativeTextAlignment = kCTCenterTextAlignment;
-			break;
-		case TUITextAlignmentJustified:
-			nativeTextAlignment = kCTJustifiedTextAlignment;
-			break;
-		case TUITextAlignmentLeft:
+			return kCTLineBreakByTruncatingMiddle;
+		case TUILineBreakModeTailTruncation:
 		default:
-			nativeTextAlignment = kCTLeftTextAlignment;
-			break;
+			return kCTLineBreakByTruncatingTail;
 	}
+}
+
+#define TUITextAlignmentCount (TUITextAlignmentJustified + 1)
+#define TUILineBreakModeCount (TUILineBreakModeMiddleTruncation + 1)
+
+static CTParagraphStyleRef TUIParagraphStyleWithAlignment(TUITextAlignment alignment, TUILineBreakMode lineBreakMode)
+{
+	// there are few enough of these to make them all up front
+	static CTParagraphStyleRef paragraphStyles[TUITextAlignmentCount][TUILineBreakModeCount];
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		for(NSUInteger a = 0; a < TUITextAlignmentCount; a++) {
+			for(NSUInteger l = 0; l < TUILineBreakModeCount; l++) {
+				CTTextAlignment nativeTextAlignment = TUICTTextAlignment((TUITextAlignment)a);
+				CTLineBreakMode nativeLineBreakMode = TUICTLineBreakMode((TUILineBreakMode)l);
+				CTParagraphStyleSetting settings[] = {
+					kCTParagraphStyleSpecifierLineBreakMode, sizeof(CTLineBreakMode), &nativeLineBreakMode,
+					kCTParagraphStyleSpecifierAlignment, sizeof(CTTextAlignment), &nativeTextAlignment,
+				};
+				paragraphStyles[a][l] = CTParagraphStyleCreate(settings, 2);
+			}
+		}
+	});
+	
+	if((NSUInteger)alignment >= TUITextAlignmentCount) alignment = TUITextAlignmentLeft;
+	if((NSUInteger)lineBreakMode >= TUILineBreakModeCount) lineBreakMode = TUILineBreakModeTailTruncation;
+	return paragraphStyles[alignment][lineBreakMode];
+}
+
+- (void)setLineHeight:(CGFloat)f inRange:(NSRange)range
+{
+	[self addAttribute:(NSString *)kCTParagraphStyleAttributeName value:TUIParagraphStyleWithLineHeight(f) range:range];
+}
+
+NSParagraphStyle *ABNSParagraphStyleForTextAlignment(TUITextAlignment alignment)
+{
+	static NSParagraphStyle *paragraphStyles[TUITextAlignmentCount];
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		NSTextAlignment nativeAlignments[TUITextAlignmentCount] = {
+			[TUITextAlignmentLeft] = NSLeftTextAlignment,
+			[TUITextAlignmentCenter] = NSCenterTextAlignment,
+			[TUITextAlignmentRight] = NSRightTextAlignment,
+			[TUITextAlignmentJustified] = NSJustifiedTextAlignment,
+		};
+		for(NSUInteger a = 0; a < TUITextAlignmentCount; a++) {
+			NSMutableParagraphStyle *p = [[NSParagraphStyle defaultParagraphStyle] mutableCopy];
+			[p setAlignment:nativeAlignments[a]];
+			paragraphStyles[a] = [p copy];
+		}
+	});
 	
-//	TUIAttributedString *s = [TUIAttributedString stringWithString:self];
-	CTParagraphStyleSetting settings[] = {
-		kCTParagraphStyleSpecifierLineBreakMode, sizeof(CTLineBreakMode), &nativeLineBreakMode,
-		kCTParagraphStyleSpecifierAlignment, sizeof(CTTextAlignment), &nativeTextAlignment,
-	};
-	CTParagraphStyleRef p = CTParagraphStyleCreate(settings, 2);
-	[self addAttribute:(NSString *)kCTParagraphStyleAttributeName value:(__bridge_transfer id)p range:[self _stringRange]];
+	if((NSUInteger)alignment >= TUITextAlignmentCount) alignment = TUITextAlignmentLeft;
+	return paragraphStyles[alignment];
+}
+
+- (void)setAlignment:(TUITextAlignment)alignment lineBreakMode:(TUILineBreakMode)lineBreakMode
+{
+	[self addAttribute:(NSString *)kCTParagraphStyleAttributeName value:(__bridge id)TUIParagraphStyleWithAlignment(alignment, lineBreakMode) range:[self _stringRange]];
 }
 
 - (void)setAlignment:(TUITextAlignment)alignment
@@ -0,0 +1,93 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/*
+
+ A pool of bitmap contexts which TUIViews draw into. Instead of each view
+ keeping a bitmap of its own for as long as it lives, a view checks a
+ context out of the pool for the duration of -displayLayer: and checks it
+ back in afterwards, so drawn views only pin the contents of their layers.
+
+ Contexts are bucketed by pixel size, rounded up, so views of similar size
+ share contexts, and by opacity. A context may therefore be larger than
+ requested; drawing happens in its bottom left corner, as usual for a
+ context whose origin is at the bottom left.
+
+ A context is only checked back in once nothing else uses its pixels: no
+ image made with CGBitmapContextCreateImage() or over its data may still be
+ alive, or the next user would either pay for a copy of the whole bitmap
+ or draw into pixels which are on screen. Idle contexts are therefore
+ memory which nothing else holds on to.
+
+ The pool is safe to use from any thread.
+
+ */
+
+@interface TUIBackingStorePool : NSObject
+
++ (instancetype)sharedPool;
+
+/*
+
+ Returns a cleared bitmap context at least @p pixelSize in size, which
+ the caller owns and must hand back with -checkInContext:. Graphics state
+ changes should be balanced before checking the context back in.
+
+ */
+- (CGContextRef)checkOutContextWithPixelSize:(CGSize)pixelSize opaque:(BOOL)opaque CF_RETURNS_RETAINED;
+
+/*
+
+ Hands a context from -checkOutContextWithPixelSize:opaque: back to the
+ pool and releases the caller's reference to it. If keeping the context
+ would take the pool over its high-water mark it is released instead.
+
+ */
+- (void)checkInContext:(CGContextRef)context;
+
+/*
+ Releases every idle context.
+ */
+- (void)removeAllContexts;
+
+/*
+ The most memory, in bytes, which idle contexts may take up. Defaults to
+ 16MB. Lowering it releases idle contexts until the pool fits.
+ */
+@property (nonatomic, assign) NSUInteger maximumIdleBytes;
+
+/*
+ Memory, in bytes, taken up by idle contexts. Contexts checked out, or
+ kept by views for redrawing in part, aren't counted.
+ */
+@property (nonatomic, assign, readonly) NSUInteger idleBytes;
+
+/*
+ The most memory idle contexts have taken up since the statistics were last reset.
+ */
+@property (nonatomic, assign, readonly) NSUInteger peakIdleBytes;
+
+/*
+ Number of check outs served by an idle context, and number which had to create one.
+ */
+@property (nonatomic, assign, readonly) NSUInteger hits;
+@property (nonatomic, assign, readonly) NSUInteger misses;
+
+- (void)resetStatistics;
+
+@end
@@ -0,0 +1,207 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <pthread.h>
+#import "TUIBackingStorePool.h"
+#import "TUICGAdditions.h"
+
+// pixel sizes are rounded up to a multiple of this, so views of similar size share contexts
+#define TUIBackingStoreBucketGranularity 32
+
+#define TUIBackingStoreDefaultMaximumIdleBytes (16 * 1024 * 1024)
+
+static inline size_t TUIBackingStoreBucketDimension(CGFloat pixels)
+{
+	size_t dimension = MAX(1, (size_t)ceil(pixels));
+	return ((dimension + TUIBackingStoreBucketGranularity - 1) / TUIBackingStoreBucketGranularity) * TUIBackingStoreBucketGranularity;
+}
+
+static inline NSUInteger TUIBackingStoreContextBytes(CGContextRef context)
+{
+	return CGBitmapContextGetBytesPerRow(context) * CGBitmapContextGetHeight(context);
+}
+
+static inline BOOL TUIBackingStoreContextIsOpaque(CGContextRef context)
+{
+	CGImageAlphaInfo alphaInfo = CGBitmapContextGetAlphaInfo(context);
+	return (alphaInfo == kCGImageAlphaNoneSkipFirst || alphaInfo == kCGImageAlphaNoneSkipLast || alphaInfo == kCGImageAlphaNone);
+}
+
+static inline NSNumber *TUIBackingStoreBucketKey(size_t width, size_t height, BOOL opaque)
+{
+	return @(((unsigned long long)width << 32) | ((unsigned long long)height << 1) | (opaque ? 1 : 0));
+}
+
+@implementation TUIBackingStorePool {
+	pthread_mutex_t _lock;
+	NSMutableDictionary *_idleContexts; // bucket key -> array of contexts
+	NSUInteger _maximumIdleBytes;
+	NSUInteger _idleBytes;
+	NSUInteger _peakIdleBytes;
+	NSUInteger _hits;
+	NSUInteger _misses;
+}
+
++ (instancetype)sharedPool
+{
+	static TUIBackingStorePool *sharedPool = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		sharedPool = [[self alloc] init];
+	});
+	return sharedPool;
+}
+
+- (id)init
+{
+	if((self = [super init])) {
+		pthread_mutex_init(&_lock, NULL);
+		_idleContexts = [[NSMutableDictionary alloc] init];
+		_maximumIdleBytes = TUIBackingStoreDefaultMaximumIdleBytes;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	pthread_mutex_destroy(&_lock);
+}
+
+- (CGContextRef)checkOutContextWithPixelSize:(CGSize)pixelSize opaque:(BOOL)opaque
+{
+	size_t width = TUIBackingStoreBucketDimension(pixelSize.width);
+	size_t height = TUIBackingStoreBucketDimension(pixelSize.height);
+	NSNumber *key = TUIBackingStoreBucketKey(width, height, opaque);
+
+	CGContextRef context = NULL;
+	pthread_mutex_lock(&_lock);
+	NSMutableArray *contexts = [_idleContexts objectForKey:key];
+	if([contexts count] > 0) {
+		context = (CGContextRef)CFBridgingRetain([contexts lastObject]);
+		[contexts removeLastObject];
+		_idleBytes -= TUIBackingStoreContextBytes(context);
+		_hits++;
+	} else {
+		_misses++;
+	}
+	pthread_mutex_unlock(&_lock);
+
+	if(context != NULL) {
+		// a fresh context is zeroed, so make sure a reused one doesn't leak what was last drawn in it
+		CGContextClearRect(context, CGRectMake(0, 0, width, height));
+	} else {
+		context = TUICreateGraphicsContextWithOptions(CGSizeMake(width, height), opaque);
+	}
+
+	return context;
+}
+
+- (void)checkInContext:(CGContextRef)context
+{
+	if(context == NULL)
+		return;
+
+	NSUInteger bytes = TUIBackingStoreContextBytes(context);
+	NSNumber *key = TUIBackingStoreBucketKey(CGBitmapContextGetWidth(context), CGBitmapContextGetHeight(context), TUIBackingStoreContextIsOpaque(context));
+
+	pthread_mutex_lock(&_lock);
+	if(_idleBytes + bytes <= _maximumIdleBytes) {
+		NSMutableArray *contexts = [_idleContexts objectForKey:key];
+		if(contexts == nil) {
+			contexts = [[NSMutableArray alloc] init];
+			[_idleContexts setObject:contexts forKey:key];
+		}
+		[contexts addObject:(__bridge id)context];
+		_idleBytes += bytes;
+		_peakIdleBytes = MAX(_peakIdleBytes, _idleBytes);
+	}
+	pthread_mutex_unlock(&_lock);
+
+	CGContextRelease(context);
+}
+
+- (void)removeAllContexts
+{
+	pthread_mutex_lock(&_lock);
+	[_idleContexts removeAllObjects];
+	_idleBytes = 0;
+	pthread_mutex_unlock(&_lock);
+}
+
+- (NSUInteger)maximumIdleBytes
+{
+	pthread_mutex_lock(&_lock);
+	NSUInteger maximumIdleBytes = _maximumIdleBytes;
+	pthread_mutex_unlock(&_lock);
+	return maximumIdleBytes;
+}
+
+- (void)setMaximumIdleBytes:(NSUInteger)maximumIdleBytes
+{
+	pthread_mutex_lock(&_lock);
+	_maximumIdleBytes = maximumIdleBytes;
+	for(NSNumber *key in [_idleContexts allKeys]) {
+		NSMutableArray *contexts = [_idleContexts objectForKey:key];
+		while(_idleBytes > _maximumIdleBytes && [contexts count] > 0) {
+			_idleBytes -= TUIBackingStoreContextBytes((__bridge CGContextRef)[contexts lastObject]);
+			[contexts removeLastObject];
+		}
+	}
+	pthread_mutex_unlock(&_lock);
+}
+
+- (NSUInteger)idleBytes
+{
+	pthread_mutex_lock(&_lock);
+	NSUInteger idleBytes = _idleBytes;
+	pthread_mutex_unlock(&_lock);
+	return idleBytes;
+}
+
+- (NSUInteger)peakIdleBytes
+{
+	pthread_mutex_lock(&_lock);
+	NSUInteger peakIdleBytes = _peakIdleBytes;
+	pthread_mutex_unlock(&_lock);
+	return peakIdleBytes;
+}
+
+- (NSUInteger)hits
+{
+	pthread_mutex_lock(&_lock);
+	NSUInteger hits = _hits;
+	pthread_mutex_unlock(&_lock);
+	return hits;
+}
+
+- (NSUInteger)misses
+{
+	pthread_mutex_lock(&_lock);
+	NSUInteger misses = _misses;
+	pthread_mutex_unlock(&_lock);
+	return misses;
+}
+
+- (void)resetStatistics
+{
+	pthread_mutex_lock(&_lock);
+	_hits = 0;
+	_misses = 0;
+	_peakIdleBytes = _idleBytes;
+	pthread_mutex_unlock(&_lock);
+}
+
+@end
@@ -0,0 +1,112 @@
+/*
+ Copyright 2011 Twitter, Inc.
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class TUIView;
+
+/*
+ Posted on the main thread after each commit which had something to do.
+ */
+extern NSString *const TUICommitSchedulerDidCommitNotification;
+
+/*
+
+ Lays out and displays the views which asked for it once per turn of the
+ main run loop, just before Core Animation commits.
+
+ -[TUIView setNeedsLayout] and -[TUIView setNeedsDisplay] mark their
+ layers as usual, and also tell the scheduler. Views asking several times
+ are only kept once, and at the end of the run loop turn the scheduler:
+
+ 1. runs the blocks given to -performBeforeCommit:, which may move views
+    around and ask for more layout,
+ 2. lays out the views which asked for it, superviews before their
+    subviews, so a subview whose superview's layout moves it again is
+    still only laid out once,
+ 3. displays the views which asked for it,
+
+ all in one CATransaction, going around again if any of those steps asked
+ for more, up to a limit.
+
+ Views which aren't in a window are left marked, and laid out or displayed
+ when they are.
+
+ All methods must be called on the main thread.
+
+ */
+
+@interface TUICommitScheduler : NSObject
+
++ (instancetype)sharedScheduler;
+
+/*
+ Whether the scheduler lays out and displays views itself. When NO, Core
+ Animation does it as it did before, which the counts below can be
+ compared against. Blocks given to -performBeforeCommit: run either way.
+ Defaults to YES.
+ */
+@property (nonatomic, assign, getter=isEnabled) BOOL enabled;
+
+- (void)setNeedsLayoutForView:(TUIView *)view;
+- (void)setNeedsDisplayForView:(TUIView *)view;
+
+/*
+ Runs @p block in the next commit, before views are laid out.
+ */
+- (void)performBeforeCommit:(void (^)(void))block;
+
+/*
+ Commits now rather than at the end of the run loop turn.
+ */
+- (void)commit;
+
+/*
+ Called by TUIView each time a view is laid out or displayed, however it
+ came to be, to count the passes made.
+ */
+- (void)viewDidLayout:(TUIView *)view;
+- (void)viewDidDisplay:(TUIView *)view;
+
+/*
+ Counts for the last commit: how many times views asked to be laid out or
+ displayed since the commit before, and how many times they actually were.
+ */
+@property (nonatomic, readonly) NSUInteger layoutRequestCount;
+@property (nonatomic, readonly) NSUInteger layoutPassCount;
+@property (nonatomic, readonly) NSUInteger displayRequestCount;
+@property (nonatomic, readonly) NSUInteger displayPassCount;
+
+/*
+ The requests in the last commit which didn't need a pass of their own.
+ */
+@property (nonatomic, readonly) NSUInteger savedLayoutPassCount;
+@property (nonatomic, readonly) NSUInteger savedDisplayPassCount;
+
+/*
+ The same, added up over every commit.
+ */
+@property (nonatomic, readonly) NSUInteger totalSavedLayoutPassCount;
+@property (nonatomic, readonly) NSUInteger totalSavedDisplayPassCount;
+
+/*
+ How many commits stopped going around with views still asking for more,
+ and left them for the next commit. Views which keep asking for layout
+ from their own layout or display are what makes this go up.
+ */
+@property (nonatomic, readonly) NSUInteger truncatedCommitCount;
+
+@end
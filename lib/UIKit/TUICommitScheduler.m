@@ -0,0 +1,245 @@
+/*
+ Copyright 2011 Twitter, Inc.
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "TUICommitScheduler.h"
+#import "TUIView.h"
+
+NSString *const TUICommitSchedulerDidCommitNotification = @"TUICommitSchedulerDidCommitNotification";
+
+// Core Animation commits the run loop's implicit transaction at 2000000
+static const CFIndex TUICommitSchedulerRunLoopObserverOrder = 1999000;
+
+// how many times a commit goes around before leaving views which keep asking for the next one
+static const NSUInteger TUICommitSchedulerMaximumIterations = 8;
+
+typedef struct TUICommitSchedulerEntry {
+	__unsafe_unretained TUIView *view; // kept alive by the set it came from
+	NSUInteger depth;
+	NSUInteger order;
+} TUICommitSchedulerEntry;
+
+static int TUICommitSchedulerCompareEntries(const void *a, const void *b)
+{
+	const TUICommitSchedulerEntry *x = a;
+	const TUICommitSchedulerEntry *y = b;
+	if(x->depth != y->depth)
+		return (x->depth < y->depth) ? -1 : 1;
+	return (x->order < y->order) ? -1 : (x->order > y->order) ? 1 : 0;
+}
+
+@interface TUICommitScheduler ()
+- (void)_commitIfNeeded;
+@end
+
+static void TUICommitSchedulerRunLoopObserverCallback(CFRunLoopObserverRef observer, CFRunLoopActivity activity, void *info)
+{
+	[(__bridge TUICommitScheduler *)info _commitIfNeeded];
+}
+
+@implementation TUICommitScheduler {
+	CFRunLoopObserverRef _runLoopObserver;
+	NSMutableArray *_blocks;
+	NSMutableOrderedSet *_viewsNeedingLayout; // in the order they asked
+	NSMutableOrderedSet *_viewsNeedingDisplay;
+	BOOL _needsCommit;
+	BOOL _committing;
+	
+	// since the last commit
+	NSUInteger _pendingLayoutRequestCount;
+	NSUInteger _pendingLayoutPassCount;
+	NSUInteger _pendingDisplayRequestCount;
+	NSUInteger _pendingDisplayPassCount;
+}
+
++ (instancetype)sharedScheduler
+{
+	static TUICommitScheduler *sharedScheduler = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		sharedScheduler = [[self alloc] init];
+	});
+	return sharedScheduler;
+}
+
+- (id)init
+{
+	if((self = [super init])) {
+		_enabled = YES;
+		_blocks = [[NSMutableArray alloc] init];
+		_viewsNeedingLayout = [[NSMutableOrderedSet alloc] init];
+		_viewsNeedingDisplay = [[NSMutableOrderedSet alloc] init];
+		
+		// the scheduler lives as long as the observer, so it doesn't need retaining
+		CFRunLoopObserverContext context = {0, (__bridge void *)self, NULL, NULL, NULL};
+		_runLoopObserver = CFRunLoopObserverCreate(NULL, kCFRunLoopBeforeWaiting | kCFRunLoopExit, true, TUICommitSchedulerRunLoopObserverOrder, TUICommitSchedulerRunLoopObserverCallback, &context);
+		CFRunLoopAddObserver(CFRunLoopGetMain(), _runLoopObserver, kCFRunLoopCommonModes);
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	CFRunLoopObserverInvalidate(_runLoopObserver);
+	CFRelease(_runLoopObserver);
+}
+
+- (void)setNeedsLayoutForView:(TUIView *)view
+{
+	NSAssert([NSThread isMainThread], @"%s must be called on the main thread", __func__);
+	_pendingLayoutRequestCount++;
+	[_viewsNeedingLayout addObject:view];
+	_needsCommit = YES;
+}
+
+- (void)setNeedsDisplayForView:(TUIView *)view
+{
+	NSAssert([NSThread isMainThread], @"%s must be called on the main thread", __func__);
+	_pendingDisplayRequestCount++;
+	[_viewsNeedingDisplay addObject:view];
+	_needsCommit = YES;
+}
+
+- (void)performBeforeCommit:(void (^)(void))block
+{
+	NSParameterAssert(block != nil);
+	NSAssert([NSThread isMainThread], @"%s must be called on the main thread", __func__);
+	[_blocks addObject:[block copy]];
+	_needsCommit = YES;
+}
+
+- (void)viewDidLayout:(TUIView *)view
+{
+	// only counted: a pass made elsewhere doesn't need a commit of its own
+	_pendingLayoutPassCount++;
+}
+
+- (void)viewDidDisplay:(TUIView *)view
+{
+	_pendingDisplayPassCount++;
+}
+
+- (void)_commitIfNeeded
+{
+	if(_needsCommit)
+		[self commit];
+}
+
+- (void)_performBlocks
+{
+	NSArray *blocks = _blocks;
+	_blocks = [[NSMutableArray alloc] init];
+	for(void (^block)(void) in blocks)
+		block();
+}
+
+/*
+ Superviews go first, so their layout gets to move their subviews before
+ the subviews lay themselves out. A subview whose superview's layout
+ already took care of it is no longer marked on its layer, and -layoutIfNeeded
+ leaves it alone.
+ */
+- (void)_layoutViews
+{
+	NSOrderedSet *views = _viewsNeedingLayout;
+	_viewsNeedingLayout = [[NSMutableOrderedSet alloc] init];
+	
+	NSUInteger count = 0;
+	TUICommitSchedulerEntry *entries = malloc([views count] * sizeof(TUICommitSchedulerEntry));
+	for(TUIView *view in views) {
+		// left marked on its layer until it's in a window
+		if(view.nsView == nil)
+			continue;
+		NSUInteger depth = 0;
+		for(TUIView *v = view.superview; v != nil; v = v.superview)
+			depth++;
+		entries[count] = (TUICommitSchedulerEntry){view, depth, count};
+		count++;
+	}
+	qsort(entries, count, sizeof(TUICommitSchedulerEntry), TUICommitSchedulerCompareEntries);
+	
+	for(NSUInteger i = 0; i < count; i++)
+		[entries[i].view layoutIfNeeded];
+	free(entries);
+}
+
+- (void)_displayViews
+{
+	NSOrderedSet *views = _viewsNeedingDisplay;
+	_viewsNeedingDisplay = [[NSMutableOrderedSet alloc] init];
+	
+	for(TUIView *view in views) {
+		if(view.nsView != nil)
+			[view.layer displayIfNeeded];
+	}
+}
+
+- (void)commit
+{
+	NSAssert([NSThread isMainThread], @"%s must be called on the main thread", __func__);
+	
+	// a view asking for layout from its own layout is picked up by the commit already running
+	if(_committing)
+		return;
+	_committing = YES;
+	
+	[CATransaction begin];
+	NSUInteger iterations = 0;
+	while([_blocks count] > 0 || [_viewsNeedingLayout count] > 0 || [_viewsNeedingDisplay count] > 0) {
+		if(iterations++ == TUICommitSchedulerMaximumIterations) {
+			// left for the next commit
+			_truncatedCommitCount++;
+			break;
+		}
+		@autoreleasepool {
+			[self _performBlocks];
+			if(_enabled) {
+				[self _layoutViews];
+				if([_blocks count] > 0 || [_viewsNeedingLayout count] > 0)
+					continue; // everything moves into place before anything draws
+				[self _displayViews];
+			} else {
+				// left for Core Animation
+				[_viewsNeedingLayout removeAllObjects];
+				[_viewsNeedingDisplay removeAllObjects];
+			}
+		}
+	}
+	[CATransaction commit];
+	
+	_layoutRequestCount = _pendingLayoutRequestCount;
+	_layoutPassCount = _pendingLayoutPassCount;
+	_displayRequestCount = _pendingDisplayRequestCount;
+	_displayPassCount = _pendingDisplayPassCount;
+	_pendingLayoutRequestCount = _pendingLayoutPassCount = _pendingDisplayRequestCount = _pendingDisplayPassCount = 0;
+	
+	_savedLayoutPassCount = (_layoutRequestCount > _layoutPassCount) ? _layoutRequestCount - _layoutPassCount : 0;
+	_savedDisplayPassCount = (_displayRequestCount > _displayPassCount) ? _displayRequestCount - _displayPassCount : 0;
+	_totalSavedLayoutPassCount += _savedLayoutPassCount;
+	_totalSavedDisplayPassCount += _savedDisplayPassCount;
+	
+	_needsCommit = ([_blocks count] > 0 || [_viewsNeedingLayout count] > 0 || [_viewsNeedingDisplay count] > 0);
+	_committing = NO;
+	
+	if(_layoutRequestCount > 0 || _layoutPassCount > 0 || _displayRequestCount > 0 || _displayPassCount > 0)
+		[[NSNotificationCenter defaultCenter] postNotificationName:TUICommitSchedulerDidCommitNotification object:self];
+}
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"<%@: %p layout %lu/%lu (%lu saved), display %lu/%lu (%lu saved)>", [self class], self, (unsigned long)_layoutPassCount, (unsigned long)_layoutRequestCount, (unsigned long)_savedLayoutPassCount, (unsigned long)_displayPassCount, (unsigned long)_displayRequestCount, (unsigned long)_savedDisplayPassCount];
+}
+
+@end
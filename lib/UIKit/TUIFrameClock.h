@@ -0,0 +1,74 @@
+/*
+ Copyright 2011 Twitter, Inc.
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class TUIFrameClock;
+
+@protocol TUIFrameClockObserver <NSObject>
+
+- (void)frameClockDidTick:(TUIFrameClock *)clock;
+
+@end
+
+/*
+
+ One display link for everything animating in the process.
+
+ Observers are told about each frame on the main thread. If the main thread
+ falls behind, the frames it missed are folded into the next tick rather
+ than queued up, so a busy main thread never gets a burst of stale ticks:
+ it gets one, with the timestamp of the latest frame and how many frames
+ went by since the last tick.
+
+ The display link only runs while there are observers. Observers aren't
+ retained, so remove them before they go away.
+
+ All methods must be called on the main thread.
+
+ */
+
+@interface TUIFrameClock : NSObject
+
++ (instancetype)sharedFrameClock;
+
+- (void)addObserver:(id<TUIFrameClockObserver>)observer;
+- (void)removeObserver:(id<TUIFrameClockObserver>)observer;
+
+/*
+ When the frame being ticked for will be shown, in the same time base as
+ CFAbsoluteTimeGetCurrent(). Zero before the first tick.
+ */
+@property (nonatomic, readonly) CFAbsoluteTime timestamp;
+
+/*
+ How many display frames the current tick stands for: 1 unless the main
+ thread missed some.
+ */
+@property (nonatomic, readonly) NSUInteger frameCount;
+
+/*
+ How long the main thread took to get to this tick after the display link
+ fired for the first of its frames.
+ */
+@property (nonatomic, readonly) CFTimeInterval latency;
+
+/*
+ The display's refresh period, in seconds.
+ */
+@property (nonatomic, readonly) CFTimeInterval refreshPeriod;
+
+@end
@@ -0,0 +1,138 @@
+/*
+ Copyright 2011 Twitter, Inc.
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "TUIFrameClock.h"
+#import <CoreVideo/CoreVideo.h>
+#import <pthread.h>
+
+@interface TUIFrameClock ()
+- (void)_tick;
+@end
+
+@implementation TUIFrameClock {
+	CVDisplayLinkRef _displayLink;
+	NSHashTable *_observers;
+	
+	// shared with the display link thread
+	pthread_mutex_t _lock;
+	CFAbsoluteTime _pendingTimestamp;
+	CFAbsoluteTime _scheduledTime; // when the waiting tick was scheduled
+	NSUInteger _pendingFrameCount;
+	BOOL _tickScheduled;
+}
+
+static CVReturn TUIFrameClockCallback(CVDisplayLinkRef displayLink, const CVTimeStamp *now, const CVTimeStamp *outputTime, CVOptionFlags flagsIn, CVOptionFlags *flagsOut, void *displayLinkContext)
+{
+	TUIFrameClock *clock = (__bridge TUIFrameClock *)displayLinkContext;
+	
+	// when the frame will be shown, relative to now
+	CFAbsoluteTime currentTime = CFAbsoluteTimeGetCurrent();
+	CFAbsoluteTime timestamp = currentTime + (CFTimeInterval)((int64_t)outputTime->hostTime - (int64_t)now->hostTime) / CVGetHostClockFrequency();
+	
+	pthread_mutex_lock(&clock->_lock);
+	clock->_pendingTimestamp = timestamp;
+	clock->_pendingFrameCount++;
+	BOOL scheduleTick = !clock->_tickScheduled;
+	if(scheduleTick)
+		clock->_scheduledTime = currentTime;
+	clock->_tickScheduled = YES;
+	pthread_mutex_unlock(&clock->_lock);
+	
+	// one tick waiting on the main thread at a time, which picks up every frame until it runs
+	if(scheduleTick) {
+		dispatch_async(dispatch_get_main_queue(), ^{
+			[clock _tick];
+		});
+	}
+	return kCVReturnSuccess;
+}
+
++ (instancetype)sharedFrameClock
+{
+	static TUIFrameClock *sharedFrameClock = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		sharedFrameClock = [[self alloc] init];
+	});
+	return sharedFrameClock;
+}
+
+- (id)init
+{
+	if((self = [super init])) {
+		_observers = [[NSHashTable alloc] initWithOptions:NSPointerFunctionsOpaqueMemory | NSPointerFunctionsObjectPointerPersonality capacity:0];
+		pthread_mutex_init(&_lock, NULL);
+		
+		CVDisplayLinkCreateWithActiveCGDisplays(&_displayLink);
+		CVDisplayLinkSetOutputCallback(_displayLink, &TUIFrameClockCallback, (__bridge void *)self);
+		CVDisplayLinkSetCurrentCGDisplay(_displayLink, kCGDirectMainDisplay);
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	CVDisplayLinkStop(_displayLink);
+	CVDisplayLinkRelease(_displayLink);
+	pthread_mutex_destroy(&_lock);
+}
+
+- (CFTimeInterval)refreshPeriod
+{
+	CFTimeInterval period = CVDisplayLinkGetActualOutputVideoRefreshPeriod(_displayLink);
+	return period > 0.0 ? period : 1.0 / 60.0;
+}
+
+- (void)addObserver:(id<TUIFrameClockObserver>)observer
+{
+	NSAssert([NSThread isMainThread], @"%s must be called on the main thread", __func__);
+	
+	[_observers addObject:observer];
+	if(!CVDisplayLinkIsRunning(_displayLink))
+		CVDisplayLinkStart(_displayLink);
+}
+
+- (void)removeObserver:(id<TUIFrameClockObserver>)observer
+{
+	NSAssert([NSThread isMainThread], @"%s must be called on the main thread", __func__);
+	
+	[_observers removeObject:observer];
+	if([_observers count] == 0 && CVDisplayLinkIsRunning(_displayLink))
+		CVDisplayLinkStop(_displayLink);
+}
+
+- (void)_tick
+{
+	pthread_mutex_lock(&_lock);
+	CFAbsoluteTime timestamp = _pendingTimestamp;
+	NSUInteger frameCount = _pendingFrameCount;
+	CFAbsoluteTime scheduledTime = _scheduledTime;
+	_pendingFrameCount = 0;
+	_tickScheduled = NO;
+	pthread_mutex_unlock(&_lock);
+	
+	_timestamp = timestamp;
+	_frameCount = frameCount;
+	_latency = CFAbsoluteTimeGetCurrent() - scheduledTime;
+	
+	// observers tend to remove themselves when they're done
+	for(id<TUIFrameClockObserver> observer in [_observers allObjects]) {
+		if([_observers containsObject:observer])
+			[observer frameClockDidTick:self];
+	}
+}
+
+@end
@@ -0,0 +1,68 @@
+/*
+ Copyright 2011 Twitter, Inc.
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+typedef enum TUIFrameStatisticsMetric : NSUInteger {
+	// How long the main thread took to get to a frame after the display link fired.
+	TUIFrameStatisticsMetricTickLatency,
+	// Between one frame and the next.
+	TUIFrameStatisticsMetricFrameInterval,
+	// Spent moving the content, in -setContentOffset: and whatever it calls.
+	TUIFrameStatisticsMetricContentOffsetTime,
+	// Spent laying out the scroll view and its subclass.
+	TUIFrameStatisticsMetricLayoutTime,
+	// From a scroll wheel event until the content was moved for it.
+	TUIFrameStatisticsMetricScrollEventLatency,
+	
+	TUIFrameStatisticsMetricCount,
+} TUIFrameStatisticsMetric;
+
+/*
+
+ Frame timings for one stretch of scrolling, from when a scroll view starts
+ ticking to when it stops.
+
+ Each metric goes into a histogram of fixed buckets, from under a
+ millisecond to over 200. Recording only increments counters atomically,
+ so it's cheap enough to leave on. Statistics can be read from any thread
+ while they're being recorded, though a read may then miss the latest
+ frame.
+
+ */
+
+@interface TUIFrameStatistics : NSObject
+
+- (id)initWithRefreshPeriod:(CFTimeInterval)refreshPeriod;
+
+// The display's refresh period when the animation started. Dropped frames are counted against it.
+@property (nonatomic, readonly) CFTimeInterval refreshPeriod;
+
+@property (nonatomic, readonly) NSUInteger frameCount; // ticked
+@property (nonatomic, readonly) NSUInteger droppedFrameCount; // went by without a tick
+
+- (NSUInteger)sampleCountForMetric:(TUIFrameStatisticsMetric)metric;
+
+// An upper bound for the value of a metric at a percentile from 0 to 100,
+// as precise as the histogram's buckets. Zero without any samples.
+- (CFTimeInterval)percentile:(double)percentile forMetric:(TUIFrameStatisticsMetric)metric;
+
+// What a frame with a tick latency and interval since the last frame looks
+// like. The interval is 0 for the first frame.
+- (void)recordFrameWithLatency:(CFTimeInterval)latency interval:(CFTimeInterval)interval;
+- (void)recordValue:(CFTimeInterval)value forMetric:(TUIFrameStatisticsMetric)metric;
+
+@end
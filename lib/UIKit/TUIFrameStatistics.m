@@ -0,0 +1,118 @@
+/*
+ Copyright 2011 Twitter, Inc.
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "TUIFrameStatistics.h"
+#import <libkern/OSAtomic.h>
+
+// upper bounds of the histogram's buckets, in milliseconds
+static const double TUIFrameStatisticsBucketBounds[] = {1, 2, 3, 4, 6, 8, 10, 12, 14, 16, 18, 20, 25, 33, 50, 66, 100, 200, INFINITY};
+#define TUIFrameStatisticsBucketCount (sizeof(TUIFrameStatisticsBucketBounds) / sizeof(TUIFrameStatisticsBucketBounds[0]))
+
+@implementation TUIFrameStatistics {
+	volatile int32_t _frameCount;
+	volatile int32_t _droppedFrameCount;
+	volatile int32_t _counts[TUIFrameStatisticsMetricCount][TUIFrameStatisticsBucketCount];
+}
+
+- (id)initWithRefreshPeriod:(CFTimeInterval)refreshPeriod
+{
+	if((self = [super init])) {
+		_refreshPeriod = refreshPeriod;
+	}
+	return self;
+}
+
+- (NSUInteger)frameCount
+{
+	return OSAtomicAdd32Barrier(0, &_frameCount);
+}
+
+- (NSUInteger)droppedFrameCount
+{
+	return OSAtomicAdd32Barrier(0, &_droppedFrameCount);
+}
+
+- (void)recordFrameWithLatency:(CFTimeInterval)latency interval:(CFTimeInterval)interval
+{
+	OSAtomicIncrement32Barrier(&_frameCount);
+	[self recordValue:latency forMetric:TUIFrameStatisticsMetricTickLatency];
+	
+	if(interval > 0.0) {
+		[self recordValue:interval forMetric:TUIFrameStatisticsMetricFrameInterval];
+		
+		// a frame which took as long as two display frames dropped one
+		int32_t dropped = (int32_t) round(interval / _refreshPeriod) - 1;
+		if(dropped > 0)
+			OSAtomicAdd32Barrier(dropped, &_droppedFrameCount);
+	}
+}
+
+- (void)recordValue:(CFTimeInterval)value forMetric:(TUIFrameStatisticsMetric)metric
+{
+	double milliseconds = value * 1000.0;
+	NSUInteger bucket = 0;
+	while(milliseconds > TUIFrameStatisticsBucketBounds[bucket])
+		bucket++;
+	OSAtomicIncrement32Barrier(&_counts[metric][bucket]);
+}
+
+- (NSUInteger)sampleCountForMetric:(TUIFrameStatisticsMetric)metric
+{
+	NSUInteger count = 0;
+	for(NSUInteger i = 0; i < TUIFrameStatisticsBucketCount; i++)
+		count += OSAtomicAdd32Barrier(0, &_counts[metric][i]);
+	return count;
+}
+
+- (CFTimeInterval)percentile:(double)percentile forMetric:(TUIFrameStatisticsMetric)metric
+{
+	int32_t counts[TUIFrameStatisticsBucketCount];
+	NSUInteger total = 0;
+	for(NSUInteger i = 0; i < TUIFrameStatisticsBucketCount; i++) {
+		counts[i] = OSAtomicAdd32Barrier(0, &_counts[metric][i]);
+		total += counts[i];
+	}
+	if(total == 0)
+		return 0.0;
+	
+	double rank = MAX(1.0, ceil(total * MIN(percentile, 100.0) / 100.0));
+	NSUInteger seen = 0;
+	for(NSUInteger i = 0; i < TUIFrameStatisticsBucketCount; i++) {
+		seen += counts[i];
+		if(seen >= rank) {
+			// the last bucket has no upper bound, so say where it starts
+			double bound = isinf(TUIFrameStatisticsBucketBounds[i]) ? TUIFrameStatisticsBucketBounds[i - 1] : TUIFrameStatisticsBucketBounds[i];
+			return bound / 1000.0;
+		}
+	}
+	return 0.0;
+}
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"%lu frames, %lu dropped\nlatency p50 %.0fms p95 %.0fms\ninterval p50 %.0fms p95 %.0fms\noffset p95 %.0fms, layout p95 %.0fms\nscroll event p50 %.0fms p95 %.0fms",
+			(unsigned long)self.frameCount, (unsigned long)self.droppedFrameCount,
+			[self percentile:50 forMetric:TUIFrameStatisticsMetricTickLatency] * 1000.0,
+			[self percentile:95 forMetric:TUIFrameStatisticsMetricTickLatency] * 1000.0,
+			[self percentile:50 forMetric:TUIFrameStatisticsMetricFrameInterval] * 1000.0,
+			[self percentile:95 forMetric:TUIFrameStatisticsMetricFrameInterval] * 1000.0,
+			[self percentile:95 forMetric:TUIFrameStatisticsMetricContentOffsetTime] * 1000.0,
+			[self percentile:95 forMetric:TUIFrameStatisticsMetricLayoutTime] * 1000.0,
+			[self percentile:50 forMetric:TUIFrameStatisticsMetricScrollEventLatency] * 1000.0,
+			[self percentile:95 forMetric:TUIFrameStatisticsMetricScrollEventLatency] * 1000.0];
+}
+
+@end
@@ -28,10 +28,14 @@
 #import "NSView+TUIExtensions.h"
 #import "TUIActivityIndicatorView.h"
 #import "TUIAttributedString.h"
+#import "TUIBackingStorePool.h"
 #import "TUIBridgedScrollView.h"
 #import "TUIBridgedView.h"
 #import "TUIButton.h"
 #import "TUICGAdditions.h"
+#import "TUICommitScheduler.h"
+#import "TUIFrameClock.h"
+#import "TUIFrameStatistics.h"
 #import "TUIHostView.h"
 #import "TUIImageView.h"
 #import "TUILabel.h"
@@ -46,6 +50,8 @@
 #import "TUIProgressBar.h"
 #import "TUIResponder.h"
 #import "TUIRefreshControl.h"
+#import "TUIRenderScheduler.h"
+#import "TUIScrollPhysics.h"
 #import "TUIScrollView.h"
 #import "TUIScrollView+TUIBridgedScrollView.h"
 #import "TUISlider.h"
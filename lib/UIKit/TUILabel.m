@@ -15,12 +15,103 @@
  */
 
 #import "TUILabel.h"
+#import "TUICGAdditions.h"
 #import "TUINSView.h"
-#import "TUITextRenderer.h"
+#import "TUITextRenderer+Private.h"
+
+/*
+ Most labels are one line, often truncated, which doesn't need a framesetter
+ and a CTFrame: one CTLine, truncated by Core Text, draws the same thing.
+ Lines are shared between labels showing the same string at the same width,
+ as cells being reused tend to.
+ */
+@interface TUILabelLineKey : NSObject {
+@public
+	NSAttributedString *_attributedString;
+	CGFloat _width;
+	TUILineBreakMode _lineBreakMode;
+}
+@end
+
+@implementation TUILabelLineKey
+
+- (NSUInteger)hash
+{
+	return [[_attributedString string] hash] ^ (NSUInteger) _width ^ _lineBreakMode;
+}
+
+- (BOOL)isEqual:(id)object
+{
+	if(![object isKindOfClass:[TUILabelLineKey class]]) return NO;
+	TUILabelLineKey *key = object;
+	return key->_width == _width && key->_lineBreakMode == _lineBreakMode && [key->_attributedString isEqualToAttributedString:_attributedString];
+}
+
+@end
+
+static CTLineRef TUILabelCreateLine(NSAttributedString *attributedString, CGFloat width, TUILineBreakMode lineBreakMode)
+{
+	CTLineRef line = CTLineCreateWithAttributedString((__bridge CFAttributedStringRef) attributedString);
+	if(lineBreakMode == TUILineBreakModeClip || CTLineGetTypographicBounds(line, NULL, NULL, NULL) <= width)
+		return line;
+	
+	CTLineTruncationType truncationType = kCTLineTruncationEnd;
+	NSUInteger tokenIndex = [attributedString length] - 1;
+	if(lineBreakMode == TUILineBreakModeHeadTruncation) {
+		truncationType = kCTLineTruncationStart;
+		tokenIndex = 0;
+	} else if(lineBreakMode == TUILineBreakModeMiddleTruncation) {
+		truncationType = kCTLineTruncationMiddle;
+		tokenIndex = [attributedString length] / 2;
+	}
+	
+	// the ellipsis looks like the text it stands in for
+	NSDictionary *tokenAttributes = [attributedString attributesAtIndex:tokenIndex effectiveRange:NULL];
+	NSAttributedString *tokenString = [[NSAttributedString alloc] initWithString:@"\u2026" attributes:tokenAttributes];
+	CTLineRef token = CTLineCreateWithAttributedString((__bridge CFAttributedStringRef) tokenString);
+	CTLineRef truncatedLine = CTLineCreateTruncatedLine(line, width, truncationType, token);
+	CFRelease(token);
+	
+	// Core Text gives up when even the ellipsis doesn't fit, so just clip
+	if(truncatedLine == NULL)
+		return line;
+	CFRelease(line);
+	return truncatedLine;
+}
+
+static CTLineRef TUILabelCopyCachedLine(NSAttributedString *attributedString, CGFloat width, TUILineBreakMode lineBreakMode)
+{
+	static NSCache *cache = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		cache = [[NSCache alloc] init];
+		[cache setCountLimit:512];
+	});
+	
+	TUILabelLineKey *key = [[TUILabelLineKey alloc] init];
+	key->_attributedString = attributedString;
+	key->_width = width;
+	key->_lineBreakMode = lineBreakMode;
+	
+	CTLineRef line = (__bridge_retained CTLineRef) [cache objectForKey:key];
+	if(line == NULL) {
+		line = TUILabelCreateLine(attributedString, width, lineBreakMode);
+		// the string could still change under the cache if it's mutable
+		key->_attributedString = [attributedString copy];
+		[cache setObject:(__bridge id) line forKey:key];
+	}
+	return line;
+}
 
 @interface TUILabel () {
+	CTLineRef _line; // for one line labels, drawn without the renderer
+	NSAttributedString *_lineAttributedString;
+	CGFloat _lineWidth;
+	
 	struct {
 		unsigned int selectable:1;
+		unsigned int needsAttributedString:1; // rebuilt from the text on next use
+		unsigned int singleLine:1; // the string was made from text without line breaks, and won't wrap
 	} _textLabelFlags;
 }
 
@@ -49,6 +140,12 @@
 	return self;
 }
 
+- (void)dealloc
+{
+	if(_line)
+		CFRelease(_line);
+}
+
 
 - (NSMenu *)menuForEvent:(NSEvent *)event
 {
@@ -72,14 +169,54 @@
 }
 - (void)drawRect:(CGRect)rect
 {
-	if(renderer.attributedString == nil) {
-		[self _recreateAttributedString];
-	}
+	NSAttributedString *attributedString = self.attributedString;
 	
 	[super drawRect:rect]; // draw background
 	CGRect bounds = self.bounds;
 	renderer.frame = CGRectMake(0, 0, bounds.size.width, bounds.size.height);
-	[renderer draw];	
+	
+	// the renderer still has to draw selections, and text aligned to the bottom
+	TUITextVerticalAlignment verticalAlignment = renderer.verticalAlignment;
+	BOOL drawsLine = (verticalAlignment == TUITextVerticalAlignmentTop || verticalAlignment == TUITextVerticalAlignmentMiddle);
+	if(_textLabelFlags.singleLine && drawsLine && [attributedString length] > 0 && [renderer selectedRange].length == 0 && renderer.hitRange == nil) {
+		[self _drawLineForAttributedString:attributedString inRect:renderer.frame];
+	} else {
+		[renderer draw];
+	}
+}
+
+- (void)_drawLineForAttributedString:(NSAttributedString *)attributedString inRect:(CGRect)lineRect
+{
+	if(_line == NULL || attributedString != _lineAttributedString || lineRect.size.width != _lineWidth) {
+		if(_line)
+			CFRelease(_line);
+		_line = TUILabelCopyCachedLine(attributedString, lineRect.size.width, _lineBreakMode);
+		_lineAttributedString = attributedString;
+		_lineWidth = lineRect.size.width;
+	}
+	
+	CGFloat ascent, descent, leading;
+	CTLineGetTypographicBounds(_line, &ascent, &descent, &leading);
+	
+	CGFloat flush = 0.0f;
+	if(_alignment == TUITextAlignmentCenter) flush = 0.5f;
+	else if(_alignment == TUITextAlignmentRight) flush = 1.0f;
+	
+	// where the renderer would put the baseline: Core Text sets the line at
+	// the top of the frame, which the renderer moves to align the text
+	CGRect textRect = TUITextRendererAlignedFrame(lineRect, ceil(ascent + descent), renderer.verticalAlignment);
+	CGPoint position;
+	position.x = lineRect.origin.x + CTLineGetPenOffsetForFlush(_line, flush, lineRect.size.width);
+	position.y = CGRectGetMaxY(textRect) - ascent;
+	
+	CGContextRef context = TUIGraphicsGetCurrentContext();
+	CGContextSaveGState(context);
+	if(renderer.shadowColor)
+		CGContextSetShadowWithColor(context, renderer.shadowOffset, renderer.shadowBlur, renderer.shadowColor.CGColor);
+	CGContextSetTextMatrix(context, CGAffineTransformIdentity);
+	CGContextSetTextPosition(context, position.x, position.y);
+	CTLineDraw(_line, context);
+	CGContextRestoreGState(context);
 }
 
 - (void)_update
@@ -89,7 +226,7 @@
 
 - (NSAttributedString *)attributedString
 {
-	if(renderer.attributedString == nil) {
+	if(_textLabelFlags.needsAttributedString) {
 		[self _recreateAttributedString];
 	}
 	
@@ -99,18 +236,43 @@
 - (void)setAttributedString:(NSAttributedString *)a
 {
 	renderer.attributedString = a;
+	// with no string of its own, the label goes back to showing its text
+	_textLabelFlags.needsAttributedString = (a == nil);
+	_textLabelFlags.singleLine = 0;
+	[self _update];
+}
+
+// Setters only mark the string as out of date, so changing several
+// properties at once builds it just once, when it's next needed. The
+// renderer drops the old string straight away, as it always has.
+- (void)_setNeedsAttributedString
+{
+	if(renderer.attributedString != nil)
+		renderer.attributedString = nil;
+	if(_textLabelFlags.needsAttributedString) return;
+	
+	_textLabelFlags.needsAttributedString = 1;
 	[self _update];
 }
 
 - (void)_recreateAttributedString
 {
-	if(_text == nil) return;
+	_textLabelFlags.needsAttributedString = 0;
+	_textLabelFlags.singleLine = 0;
+	
+	if(_text == nil) {
+		renderer.attributedString = nil;
+		return;
+	}
 	
 	TUIAttributedString *newAttributedString = [TUIAttributedString stringWithString:_text];
 	if(_font != nil) newAttributedString.font = _font;
 	if(_textColor != nil) newAttributedString.color = _textColor;
 	[newAttributedString setAlignment:self.alignment lineBreakMode:self.lineBreakMode];
-	self.attributedString = newAttributedString;
+	renderer.attributedString = newAttributedString;
+	
+	BOOL wraps = (_lineBreakMode == TUILineBreakModeWordWrap || _lineBreakMode == TUILineBreakModeCharacterWrap);
+	_textLabelFlags.singleLine = !wraps && [_text rangeOfCharacterFromSet:[NSCharacterSet newlineCharacterSet]].location == NSNotFound;
 }
 
 - (BOOL)isSelectable
@@ -129,7 +291,7 @@
 	
 	_text = [text copy];
 	
-	self.attributedString = nil;
+	[self _setNeedsAttributedString];
 }
 
 - (void)setFont:(NSFont *)font
@@ -138,7 +300,7 @@
 	
 	_font = font;
 	
-	self.attributedString = nil;
+	[self _setNeedsAttributedString];
 }
 
 - (void)setTextColor:(NSColor *)textColor
@@ -147,7 +309,7 @@
 	
 	_textColor = textColor;
 	
-	self.attributedString = nil;
+	[self _setNeedsAttributedString];
 }
 
 - (void)setAlignment:(TUITextAlignment)alignment
@@ -156,7 +318,7 @@
 	
 	_alignment = alignment;
 	
-	self.attributedString = nil;
+	[self _setNeedsAttributedString];
 }
 
 - (void)setLineBreakMode:(TUILineBreakMode)lineBreakMode
@@ -165,7 +327,7 @@
 	
 	_lineBreakMode = lineBreakMode;
 	
-	self.attributedString = nil;
+	[self _setNeedsAttributedString];
 }
 
 @end
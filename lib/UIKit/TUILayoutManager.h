@@ -63,4 +63,19 @@
  */
 - (void)beginProcessingView:(TUIView *)aView;
 
+/*
+ 
+ Constraints aren't applied as soon as a view's frame changes. Views moved
+ during a run loop turn are collected, and their constraints applied once,
+ just before the views are laid out and the turn's changes are committed
+ (see TUICommitScheduler). Until then, the frames of views constrained to
+ a moved view are out of date.
+ 
+ Applies the constraints of every view moved since they were last applied,
+ for when those frames are needed straight away. -layoutIfNeeded on a TUIView
+ does this for the shared layout manager before laying the view out.
+ 
+ */
+- (void)processChangedViews;
+
 @end
@@ -1,3 +1,4 @@
+#import "TUICommitScheduler.h"
 #import "TUILayoutConstraint.h"
 #import "TUILayoutManager.h"
 #import "TUIView+Layout.h"
@@ -44,6 +45,7 @@
 @property (nonatomic, strong) NSMapTable *constraints;
 @property (nonatomic, strong) NSMutableArray *viewsToProcess;
 @property (nonatomic, strong) NSMutableSet *processedViews;
+@property (nonatomic, strong) NSMutableOrderedSet *changedViews;
 
 @end
 
@@ -53,6 +55,7 @@
 @synthesize constraints = _constraints;
 @synthesize viewsToProcess = _viewsToProcess;
 @synthesize processedViews = _processedViews;
+@synthesize changedViews = _changedViews;
 
 + (id)sharedLayoutManager {
 	static TUILayoutManager *_sharedLayoutManager = nil;
@@ -76,6 +79,7 @@
 		_constraints = [NSMapTable weakToStrongObjectsMapTable];
 		_viewsToProcess = [[NSMutableArray alloc] init];
 		_processedViews = [[NSMutableSet alloc] init];
+		_changedViews = [[NSMutableOrderedSet alloc] init];
 	}
 	return self;
 }
@@ -149,9 +153,25 @@
 	}
 }
 
+- (void)processChangedViews {
+	while([self.changedViews count] > 0) {
+		TUIView *view = [self.changedViews objectAtIndex:0];
+		[self.changedViews removeObjectAtIndex:0];
+		[self beginProcessingView:view];
+	}
+}
+
 - (void)frameChanged:(NSNotification *)notification {
 	TUIView *view = [notification object];
-	[self beginProcessingView:view];
+	
+	// A view moved several times in one run loop turn only has its
+	// constraints applied once, before the views are laid out.
+	if([self.changedViews count] == 0) {
+		[[TUICommitScheduler sharedScheduler] performBeforeCommit:^{
+			[self processChangedViews];
+		}];
+	}
+	[self.changedViews addObject:view];
 }
 
 - (void)addLayoutConstraint:(TUILayoutConstraint *)constraint toView:(TUIView *)view {
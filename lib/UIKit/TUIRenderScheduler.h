@@ -0,0 +1,69 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class TUIView;
+
+typedef enum TUIRenderPriority : NSInteger {
+	// The view is offscreen, and can wait for views which aren't.
+	TUIRenderPriorityLow = 0,
+	// The view is on screen.
+	TUIRenderPriorityHigh = 1,
+} TUIRenderPriority;
+
+/*
+
+ Schedules the drawing of views which draw in the background.
+
+ A view has at most one render waiting and one running at a time. A render
+ scheduled while another is waiting replaces it, and a render scheduled
+ while another is running supersedes it: the running render's result is
+ thrown away, and the new one starts once it's done. Waiting renders start
+ by priority, then in the order they were scheduled, with no more than
+ maximumConcurrentRenders running at once.
+
+ Results are set as their views' layer contents on the main thread, in the
+ order the renders were scheduled, so a render never lands after a later
+ render which finished sooner.
+
+ All methods must be called on the main thread.
+
+ */
+
+@interface TUIRenderScheduler : NSObject
+
++ (instancetype)sharedScheduler;
+
+/*
+ How many renders may run at once. Defaults to the number of active processors.
+ */
+@property (nonatomic, assign) NSUInteger maximumConcurrentRenders;
+
+/*
+
+ Schedules @p block, which returns the new layer contents for @p view, to be
+ run on @p queue, or on a global queue if @p queue is nil.
+
+ */
+- (void)scheduleRenderForView:(TUIView *)view priority:(TUIRenderPriority)priority queue:(NSOperationQueue *)queue usingBlock:(id (^)(void))block;
+
+/*
+ Cancels the waiting render for @p view, and throws away the result of a running one.
+ */
+- (void)cancelRendersForView:(TUIView *)view;
+
+@end
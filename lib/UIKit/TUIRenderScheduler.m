@@ -0,0 +1,195 @@
+/*
+ Copyright 2011 Twitter, Inc.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "TUIRenderScheduler.h"
+#import "TUIView.h"
+
+@interface TUIRenderRequest : NSObject
+@property (nonatomic, strong) TUIView *view;
+@property (nonatomic, copy) id (^block)(void);
+@property (nonatomic, strong) NSOperationQueue *queue;
+@property (nonatomic, assign) TUIRenderPriority priority;
+@property (nonatomic, assign) NSUInteger sequence;
+@property (atomic, assign) BOOL cancelled;
+@property (nonatomic, strong) id contents;
+@end
+
+@implementation TUIRenderRequest
+@end
+
+@implementation TUIRenderScheduler {
+	NSUInteger _nextSequence;
+	NSMutableArray *_waitingRequests; // in the order they were scheduled
+	NSMapTable *_waitingRequestsByView;
+	NSMapTable *_runningRequestsByView;
+	NSMutableArray *_finishedRequests; // waiting for earlier renders before being committed
+}
+
++ (instancetype)sharedScheduler
+{
+	static TUIRenderScheduler *sharedScheduler = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		sharedScheduler = [[self alloc] init];
+	});
+	return sharedScheduler;
+}
+
+- (id)init
+{
+	if((self = [super init])) {
+		_maximumConcurrentRenders = MAX(1, [[NSProcessInfo processInfo] activeProcessorCount]);
+		_waitingRequests = [[NSMutableArray alloc] init];
+		_waitingRequestsByView = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality valueOptions:NSPointerFunctionsStrongMemory];
+		_runningRequestsByView = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality valueOptions:NSPointerFunctionsStrongMemory];
+		_finishedRequests = [[NSMutableArray alloc] init];
+	}
+	return self;
+}
+
+- (void)setMaximumConcurrentRenders:(NSUInteger)maximumConcurrentRenders
+{
+	_maximumConcurrentRenders = MAX(1, maximumConcurrentRenders);
+	[self _startWaitingRequests];
+}
+
+- (void)scheduleRenderForView:(TUIView *)view priority:(TUIRenderPriority)priority queue:(NSOperationQueue *)queue usingBlock:(id (^)(void))block
+{
+	NSParameterAssert(view != nil);
+	NSParameterAssert(block != nil);
+	NSAssert([NSThread isMainThread], @"%s must be called on the main thread", __func__);
+
+	// whatever is running now is out of date
+	[[_runningRequestsByView objectForKey:view] setCancelled:YES];
+
+	TUIRenderRequest *request = [_waitingRequestsByView objectForKey:view];
+	if(request != nil) {
+		// coalesce with the render which hasn't started yet, moving it to the back of the line
+		[_waitingRequests removeObjectIdenticalTo:request];
+	} else {
+		request = [[TUIRenderRequest alloc] init];
+		request.view = view;
+		[_waitingRequestsByView setObject:request forKey:view];
+	}
+	request.block = block;
+	request.queue = queue;
+	request.priority = priority;
+	request.sequence = _nextSequence++;
+	[_waitingRequests addObject:request];
+
+	[self _startWaitingRequests];
+}
+
+- (void)cancelRendersForView:(TUIView *)view
+{
+	TUIRenderRequest *request = [_waitingRequestsByView objectForKey:view];
+	if(request != nil) {
+		[_waitingRequests removeObjectIdenticalTo:request];
+		[_waitingRequestsByView removeObjectForKey:view];
+	}
+	[[_runningRequestsByView objectForKey:view] setCancelled:YES];
+}
+
+- (TUIRenderRequest *)_nextWaitingRequest
+{
+	TUIRenderRequest *next = nil;
+	for(TUIRenderRequest *request in _waitingRequests) {
+		// a view only ever draws on one thread at a time
+		if([_runningRequestsByView objectForKey:request.view] != nil)
+			continue;
+		if(next == nil || request.priority > next.priority)
+			next = request;
+	}
+	return next;
+}
+
+- (void)_startWaitingRequests
+{
+	while([_runningRequestsByView count] < _maximumConcurrentRenders) {
+		TUIRenderRequest *request = [self _nextWaitingRequest];
+		if(request == nil)
+			break;
+
+		[_waitingRequests removeObjectIdenticalTo:request];
+		[_waitingRequestsByView removeObjectForKey:request.view];
+		[_runningRequestsByView setObject:request forKey:request.view];
+
+		void (^render)(void) = ^{
+			if(!request.cancelled) {
+				request.contents = request.block();
+			}
+			dispatch_async(dispatch_get_main_queue(), ^{
+				[self _finishRequest:request];
+			});
+		};
+
+		if(request.queue != nil) {
+			[request.queue addOperationWithBlock:render];
+		} else {
+			dispatch_async(dispatch_get_global_queue(request.priority == TUIRenderPriorityHigh ? DISPATCH_QUEUE_PRIORITY_HIGH : DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), render);
+		}
+	}
+}
+
+- (void)_finishRequest:(TUIRenderRequest *)request
+{
+	[_runningRequestsByView removeObjectForKey:request.view];
+	request.block = nil;
+
+	if(!request.cancelled) {
+		NSUInteger index = [_finishedRequests indexOfObject:request inSortedRange:NSMakeRange(0, [_finishedRequests count]) options:NSBinarySearchingInsertionIndex usingComparator:^NSComparisonResult(TUIRenderRequest *a, TUIRenderRequest *b) {
+			return (a.sequence < b.sequence) ? NSOrderedAscending : (a.sequence > b.sequence) ? NSOrderedDescending : NSOrderedSame;
+		}];
+		[_finishedRequests insertObject:request atIndex:index];
+	}
+
+	[self _commitFinishedRequests];
+	[self _startWaitingRequests];
+}
+
+/*
+ Commit finished renders up to the earliest one still running, so results
+ land in the order they were scheduled.
+ */
+- (void)_commitFinishedRequests
+{
+	NSUInteger earliestRunningSequence = NSUIntegerMax;
+	for(TUIView *view in _runningRequestsByView) {
+		TUIRenderRequest *request = [_runningRequestsByView objectForKey:view];
+		if(!request.cancelled)
+			earliestRunningSequence = MIN(earliestRunningSequence, request.sequence);
+	}
+
+	NSUInteger count = 0;
+	while(count < [_finishedRequests count] && [[_finishedRequests objectAtIndex:count] sequence] < earliestRunningSequence)
+		count++;
+	if(count == 0)
+		return;
+
+	[CATransaction begin];
+	for(NSUInteger i = 0; i < count; i++) {
+		TUIRenderRequest *request = [_finishedRequests objectAtIndex:i];
+		// a render can be cancelled after it finishes, while it waits its turn
+		if(!request.cancelled)
+			request.view.layer.contents = request.contents;
+		request.contents = nil;
+		request.view = nil;
+	}
+	[CATransaction commit];
+	[_finishedRequests removeObjectsInRange:NSMakeRange(0, count)];
+}
+
+@end
@@ -0,0 +1,53 @@
+/*
+ Copyright 2011 Twitter, Inc.
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/*
+ Scroll animation math, as closed-form functions of elapsed time rather
+ than something stepped once per frame. Stepping by dt twice lands in the
+ same place as stepping by 2dt once, so an animation follows the same path
+ whatever the refresh rate, and however late the frames are.
+ */
+
+// Where a scroll view is along one axis and how fast it's going, in points
+// and points per second.
+typedef struct TUIScrollPhysicsState {
+	CGFloat position;
+	CGFloat velocity;
+} TUIScrollPhysicsState;
+
+static inline TUIScrollPhysicsState TUIScrollPhysicsStateMake(CGFloat position, CGFloat velocity) {
+	return (TUIScrollPhysicsState){.position = position, .velocity = velocity};
+}
+
+// The per second rate velocity decays at, for a deceleration rate giving
+// the fraction of velocity kept every 60th of a second.
+extern CGFloat TUIScrollPhysicsDecayRateForDecelerationRate(CGFloat decelerationRate);
+
+// Advances a throw by dt, its velocity decaying exponentially.
+extern TUIScrollPhysicsState TUIScrollPhysicsDecay(TUIScrollPhysicsState state, CGFloat decayRate, CFTimeInterval dt);
+
+// How far a throw goes before it comes to rest.
+extern CGFloat TUIScrollPhysicsDecayDistance(CGFloat velocity, CGFloat decayRate);
+
+// Advances a critically damped spring pulling the position back to 0, with
+// an undamped angular frequency of frequency.
+extern TUIScrollPhysicsState TUIScrollPhysicsSpring(TUIScrollPhysicsState state, CGFloat frequency, CFTimeInterval dt);
+
+// Moves a position towards a destination by dt, covering the same fraction
+// of the distance left in equal times.
+extern CGFloat TUIScrollPhysicsApproach(CGFloat position, CGFloat destination, CGFloat decayRate, CFTimeInterval dt);
@@ -0,0 +1,52 @@
+/*
+ Copyright 2011 Twitter, Inc.
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this work except in compliance with the License.
+ You may obtain a copy of the License in the LICENSE file, or at:
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "TUIScrollPhysics.h"
+
+CGFloat TUIScrollPhysicsDecayRateForDecelerationRate(CGFloat decelerationRate)
+{
+	decelerationRate = MAX(0.001, MIN(decelerationRate, 0.999));
+	return -60.0 * log(decelerationRate);
+}
+
+TUIScrollPhysicsState TUIScrollPhysicsDecay(TUIScrollPhysicsState state, CGFloat decayRate, CFTimeInterval dt)
+{
+	// v(t) = v0 e^(-kt), so x(t) = x0 + v0 (1 - e^(-kt)) / k
+	CGFloat decay = exp(-decayRate * dt);
+	state.position += state.velocity * (1.0 - decay) / decayRate;
+	state.velocity *= decay;
+	return state;
+}
+
+CGFloat TUIScrollPhysicsDecayDistance(CGFloat velocity, CGFloat decayRate)
+{
+	return velocity / decayRate;
+}
+
+TUIScrollPhysicsState TUIScrollPhysicsSpring(TUIScrollPhysicsState state, CGFloat frequency, CFTimeInterval dt)
+{
+	// x(t) = (x0 + (v0 + w x0) t) e^(-wt)
+	CGFloat decay = exp(-frequency * dt);
+	CGFloat b = state.velocity + frequency * state.position;
+	state.velocity = (state.velocity - frequency * b * dt) * decay;
+	state.position = (state.position + b * dt) * decay;
+	return state;
+}
+
+CGFloat TUIScrollPhysicsApproach(CGFloat position, CGFloat destination, CGFloat decayRate, CFTimeInterval dt)
+{
+	return destination + (position - destination) * exp(-decayRate * dt);
+}
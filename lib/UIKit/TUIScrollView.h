@@ -45,8 +45,10 @@ typedef enum TUIScrollViewIndicator : NSUInteger {
 } TUIScrollViewIndicator;
 
 @protocol TUIScrollViewDelegate;
+@protocol TUIScrollViewObserver;
 
 @class TUIScroller;
+@class TUIFrameStatistics;
 
 /**
  
@@ -79,7 +81,6 @@ typedef enum TUIScrollViewIndicator : NSUInteger {
 	
 	__unsafe_unretained id _delegate;
 	
-	CVDisplayLinkRef displayLink;
 	CGPoint destinationOffset;
 	CGPoint unfixedContentOffset;
 	
@@ -116,6 +117,17 @@ typedef enum TUIScrollViewIndicator : NSUInteger {
 	
 	CGPoint  _dragScrollLocation;
 	
+	TUIFrameStatistics *_frameStatistics;
+	TUIView *_frameStatisticsView;
+	CFAbsoluteTime _lastFrameTimestamp;
+	CFAbsoluteTime _frameStatisticsViewUpdateTime;
+	NSUInteger _idleFrameCount;
+	
+	CGPoint _pendingScrollOffset; // where scroll events waiting for the next frame will take the content
+	NSTimeInterval _pendingScrollEventTime; // of the first of them
+	
+	NSHashTable *_scrollObservers;
+	
 	BOOL x;
 	
 	struct {
@@ -145,6 +157,12 @@ typedef enum TUIScrollViewIndicator : NSUInteger {
 		unsigned delegateScrollViewDidShowScrollIndicator:1;
 		unsigned delegateScrollViewWillHideScrollIndicator:1;
 		unsigned delegateScrollViewDidHideScrollIndicator:1;
+		unsigned delegateScrollViewDidEndAnimationWithFrameStatistics:1;
+		unsigned recordsFrameStatistics:1;
+		unsigned recordingFrameStatistics:1;
+		unsigned observingFrameClock:1;
+		unsigned coalescesScrollEvents:1;
+		unsigned scrollPending:1;
 	} _scrollViewFlags;
 }
 
@@ -191,6 +209,35 @@ typedef enum TUIScrollViewIndicator : NSUInteger {
 - (void)flashScrollIndicators;
 - (void)stopThrowing;
 
+// Observers hear about every change of the content offset, like the
+// delegate's -scrollViewDidScroll:, for views inside the scroll view which
+// need to follow it. They aren't retained, so remove them before they go away.
+- (void)addScrollObserver:(id<TUIScrollViewObserver>)observer;
+- (void)removeScrollObserver:(id<TUIScrollViewObserver>)observer;
+
+// Scroll wheel and trackpad events only add up where the content will go,
+// and the content goes there once per display frame, so it's moved (and
+// laid out) at most once a frame however many events come in. Turn this
+// off to move the content for every event.
+@property (nonatomic) BOOL coalescesScrollEvents; // default = YES
+
+// Records how smoothly each stretch of scrolling (scrolling on the
+// trackpad, a throw, a bounce, an animated scroll) runs, into a new
+// TUIFrameStatistics each time. The delegate gets them when it ends, or
+// they can be polled from frameStatistics.
+@property (nonatomic) BOOL recordsFrameStatistics; // default = NO
+@property (nonatomic, strong, readonly) TUIFrameStatistics *frameStatistics; // of the current animation, or the last one
+
+// Draws the frame statistics over the top left of the content, for
+// debugging. Turns on recordsFrameStatistics.
+@property (nonatomic) BOOL showsFrameStatistics; // default = NO
+
+@end
+
+@protocol TUIScrollViewObserver <NSObject>
+
+- (void)scrollViewDidChangeContentOffset:(TUIScrollView *)scrollView;
+
 @end
 
 @protocol TUIScrollViewDelegate <NSObject>
@@ -207,4 +254,7 @@ typedef enum TUIScrollViewIndicator : NSUInteger {
 - (void)scrollView:(TUIScrollView *)scrollView willHideScrollIndicator:(TUIScrollViewIndicator)indicator;
 - (void)scrollView:(TUIScrollView *)scrollView didHideScrollIndicator:(TUIScrollViewIndicator)indicator;
 
+// Sent when a stretch of scrolling ends, if recordsFrameStatistics is on.
+- (void)scrollView:(TUIScrollView *)scrollView didEndAnimationWithFrameStatistics:(TUIFrameStatistics *)statistics;
+
 @end
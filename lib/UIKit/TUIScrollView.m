@@ -16,15 +16,23 @@
 
 #import <CoreServices/CoreServices.h>
 #import "TUIScrollView+Private.h"
+#import "TUIFrameClock.h"
+#import "TUIFrameStatistics.h"
+#import "TUIScrollPhysics.h"
 #import "TUINSView.h"
 #import "TUIScroller.h"
+#import "TUIStringDrawing.h"
 
 #define KNOB_Z_POSITION 6000
 
 #define FORCE_ENABLE_BOUNCE 1
 
 #define TUIScrollViewContinuousScrollDragBoundary 25.0
-#define TUIScrollViewContinuousScrollRate 10.0
+#define TUIScrollViewContinuousScrollRate 600.0 // points per second
+
+#define TUIScrollViewBounceFrequency 12.0 // of the spring pulling content back in bounds
+
+#define TUIScrollViewFrameClockIdleFrames 6 // with nothing to do, before letting the frame clock go
 
 enum {
 	ScrollPhaseNormal = 0,
@@ -40,7 +48,7 @@ enum {
 	AnimationModeScrollContinuous,
 };
 
-@interface TUIScrollView ()
+@interface TUIScrollView () <TUIFrameClockObserver>
 
 @property (nonatomic, strong, readwrite) TUIScroller *verticalScroller;
 @property (nonatomic, strong, readwrite) TUIScroller *horizontalScroller;
@@ -100,6 +108,7 @@ static BOOL isAtleastMountainLion = YES;
 		_layer.masksToBounds = NO; // differs from UIKit
 		[super setAcceptsTouchEvents:YES];
 		decelerationRate = 0.88;
+		_scrollViewFlags.coalescesScrollEvents = 1;
 		
 		_scrollViewFlags.bounceEnabled = [self.class requiresElasticSrolling];
 		_scrollViewFlags.alwaysBounceVertical = NO;
@@ -131,9 +140,20 @@ static BOOL isAtleastMountainLion = YES;
 	self.verticalScroller.scrollView = nil;
 	self.horizontalScroller.scrollView = nil;
 	
-	if (displayLink) {
-		CVDisplayLinkRelease(displayLink);
+	[[TUIFrameClock sharedFrameClock] removeObserver:self];
+}
+
+- (void)addScrollObserver:(id<TUIScrollViewObserver>)observer
+{
+	if (_scrollObservers == nil) {
+		_scrollObservers = [[NSHashTable alloc] initWithOptions:NSPointerFunctionsOpaqueMemory | NSPointerFunctionsObjectPointerPersonality capacity:0];
 	}
+	[_scrollObservers addObject:observer];
+}
+
+- (void)removeScrollObserver:(id<TUIScrollViewObserver>)observer
+{
+	[_scrollObservers removeObject:observer];
 }
 
 - (id<TUIScrollViewDelegate>)delegate
@@ -152,6 +172,7 @@ static BOOL isAtleastMountainLion = YES;
 	_scrollViewFlags.delegateScrollViewDidShowScrollIndicator = [_delegate respondsToSelector:@selector(scrollView:didShowScrollIndicator:)];
 	_scrollViewFlags.delegateScrollViewWillHideScrollIndicator = [_delegate respondsToSelector:@selector(scrollView:willHideScrollIndicator:)];
 	_scrollViewFlags.delegateScrollViewDidHideScrollIndicator = [_delegate respondsToSelector:@selector(scrollView:didHideScrollIndicator:)];
+	_scrollViewFlags.delegateScrollViewDidEndAnimationWithFrameStatistics = [_delegate respondsToSelector:@selector(scrollView:didEndAnimationWithFrameStatistics:)];
 }
 
 - (TUIScrollViewIndicatorStyle)scrollIndicatorStyle
@@ -293,47 +314,190 @@ static BOOL isAtleastMountainLion = YES;
 	return TUIEdgeInsetsMake(0, 0, (_scrollViewFlags.horizontalScrollIndicatorShowing) ? self.horizontalScroller.frame.size.height : 0, (_scrollViewFlags.verticalScrollIndicatorShowing) ? self.verticalScroller.frame.size.width : 0);
 }
 
-static CVReturn scrollCallback(CVDisplayLinkRef displayLink, const CVTimeStamp *now, const CVTimeStamp *outputTime, CVOptionFlags flagsIn, CVOptionFlags *flagsOut, void *displayLinkContext)
-{
-	@autoreleasepool {
-		// perform drawing on the main thread
-		TUIScrollView *scrollView = (__bridge id)displayLinkContext;
-		[scrollView performSelectorOnMainThread:@selector(tick) withObject:nil waitUntilDone:NO];
-	}
-	return kCVReturnSuccess;
-}
-
 - (void)_startDisplayLink:(int)scrollMode
 {
 	_scrollViewFlags.animationMode = scrollMode;
 	_throw.t = CFAbsoluteTimeGetCurrent();
 	_bounce.bouncing = NO;
 	
-	if (!displayLink) {
-		CVDisplayLinkCreateWithActiveCGDisplays(&displayLink);
-		CVDisplayLinkSetOutputCallback(displayLink, &scrollCallback, (__bridge void *)self);
-		CVDisplayLinkSetCurrentCGDisplay(displayLink, kCGDirectMainDisplay);
-	}
-	CVDisplayLinkStart(displayLink);
+	[self _observeFrameClock];
 }
 
 - (void)_stopDisplayLink
 {
-	if (displayLink) {
-		CVDisplayLinkStop(displayLink);
-	}
+	// the frame clock is let go of once a few frames go by with nothing to do
 	_scrollViewFlags.animationMode = AnimationModeNone;
 	_bounce.bouncing = 0;
 	[self _updateBounce];
 	[self _updateScrollersAnimated:NO];
 }
 
+- (void)_observeFrameClock
+{
+	_idleFrameCount = 0;
+	if (_scrollViewFlags.observingFrameClock)
+		return;
+	
+	// every scroll view animates off the same display link
+	_scrollViewFlags.observingFrameClock = 1;
+	[[TUIFrameClock sharedFrameClock] addObserver:self];
+	
+	if (_scrollViewFlags.recordsFrameStatistics) {
+		_scrollViewFlags.recordingFrameStatistics = 1;
+		_frameStatistics = [[TUIFrameStatistics alloc] initWithRefreshPeriod:[TUIFrameClock sharedFrameClock].refreshPeriod];
+		_lastFrameTimestamp = 0.0;
+	}
+}
+
+- (void)_stopObservingFrameClock
+{
+	if (!_scrollViewFlags.observingFrameClock)
+		return;
+	
+	_scrollViewFlags.observingFrameClock = 0;
+	[[TUIFrameClock sharedFrameClock] removeObserver:self];
+	
+	if (_scrollViewFlags.recordingFrameStatistics) {
+		_scrollViewFlags.recordingFrameStatistics = 0;
+		[self _updateFrameStatisticsView];
+		if (_scrollViewFlags.delegateScrollViewDidEndAnimationWithFrameStatistics)
+			[_delegate scrollView:self didEndAnimationWithFrameStatistics:_frameStatistics];
+	}
+}
+
+- (void)frameClockDidTick:(TUIFrameClock *)clock
+{
+	BOOL scrolled = _scrollViewFlags.scrollPending;
+	BOOL animating = (_scrollViewFlags.animationMode != AnimationModeNone);
+	
+	if (!scrolled && !animating) {
+		// a scroll event could be along any moment, so hang on to the clock for a bit
+		_lastFrameTimestamp = clock.timestamp;
+		if (++_idleFrameCount >= TUIScrollViewFrameClockIdleFrames)
+			[self _stopObservingFrameClock];
+		return;
+	}
+	_idleFrameCount = 0;
+	
+	if (_scrollViewFlags.recordingFrameStatistics) {
+		[_frameStatistics recordFrameWithLatency:clock.latency interval:(_lastFrameTimestamp > 0.0 ? clock.timestamp - _lastFrameTimestamp : 0.0)];
+		_lastFrameTimestamp = clock.timestamp;
+	}
+	
+	if (scrolled)
+		[self _applyPendingScroll];
+	if (animating)
+		[self tick];
+	
+	// a few times a second is plenty to read
+	if (_frameStatisticsView && CFAbsoluteTimeGetCurrent() - _frameStatisticsViewUpdateTime > 0.25)
+		[self _updateFrameStatisticsView];
+}
+
+#pragma mark Frame Statistics
+
+- (BOOL)recordsFrameStatistics
+{
+	return _scrollViewFlags.recordsFrameStatistics;
+}
+
+- (void)setRecordsFrameStatistics:(BOOL)records
+{
+	_scrollViewFlags.recordsFrameStatistics = records;
+	if (!records)
+		_scrollViewFlags.recordingFrameStatistics = 0;
+}
+
+- (TUIFrameStatistics *)frameStatistics
+{
+	return _frameStatistics;
+}
+
+- (BOOL)showsFrameStatistics
+{
+	return _frameStatisticsView != nil;
+}
+
+- (void)setShowsFrameStatistics:(BOOL)shows
+{
+	if (shows == self.showsFrameStatistics)
+		return;
+	
+	if (shows) {
+		self.recordsFrameStatistics = YES;
+		
+		_frameStatisticsView = [[TUIView alloc] initWithFrame:CGRectMake(0, 0, 220, 80)];
+		_frameStatisticsView.userInteractionEnabled = NO;
+		_frameStatisticsView.opaque = NO;
+		_frameStatisticsView.backgroundColor = [NSColor colorWithCalibratedWhite:0.0 alpha:0.6];
+		_frameStatisticsView.layer.zPosition = KNOB_Z_POSITION;
+		
+		__weak TUIScrollView *weakSelf = self;
+		_frameStatisticsView.drawRect = ^(TUIView *view, CGRect rect) {
+			CGRect bounds = CGRectInset(view.bounds, 6, 4);
+			NSString *description = weakSelf.frameStatistics ? [weakSelf.frameStatistics description] : @"No animations yet";
+			[description ab_drawInRect:bounds color:[NSColor whiteColor] font:[NSFont userFixedPitchFontOfSize:10]];
+		};
+		[self addSubview:_frameStatisticsView];
+		[self _updateScrollers];
+	} else {
+		[_frameStatisticsView removeFromSuperview];
+		_frameStatisticsView = nil;
+	}
+}
+
+// Scroll events can come several times a frame, and moving the content
+// can mean laying out a whole table, so they only add up where the content
+// will go, and it goes there once the next frame comes.
+- (void)_applyPendingScroll
+{
+	if (!_scrollViewFlags.scrollPending)
+		return;
+	
+	_scrollViewFlags.scrollPending = 0;
+	if (_scrollViewFlags.recordingFrameStatistics)
+		[_frameStatistics recordValue:[[NSProcessInfo processInfo] systemUptime] - _pendingScrollEventTime forMetric:TUIFrameStatisticsMetricScrollEventLatency];
+	[self setContentOffset:_pendingScrollOffset];
+}
+
+- (BOOL)coalescesScrollEvents
+{
+	return _scrollViewFlags.coalescesScrollEvents;
+}
+
+- (void)setCoalescesScrollEvents:(BOOL)coalesces
+{
+	_scrollViewFlags.coalescesScrollEvents = coalesces;
+	if (!coalesces)
+		[self _applyPendingScroll];
+}
+
+- (void)_updateFrameStatisticsView
+{
+	_frameStatisticsViewUpdateTime = CFAbsoluteTimeGetCurrent();
+	[_frameStatisticsView setNeedsDisplay];
+}
+
+- (void)layoutSublayersOfLayer:(CALayer *)layer
+{
+	if (!_scrollViewFlags.recordingFrameStatistics) {
+		[super layoutSublayersOfLayer:layer];
+		return;
+	}
+	
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+	[super layoutSublayersOfLayer:layer];
+	[_frameStatistics recordValue:CFAbsoluteTimeGetCurrent() - start forMetric:TUIFrameStatisticsMetricLayoutTime];
+}
+
 - (void)willMoveToWindow:(TUINSWindow *)newWindow
 {
 	[super willMoveToWindow:newWindow];
 	if (!newWindow) {
 		x = YES;
+		[self _applyPendingScroll];
 		[self _stopDisplayLink];
+		[self _stopObservingFrameClock];
 	}
 }
 
@@ -508,6 +672,13 @@ static CVReturn scrollCallback(CVDisplayLinkRef displayLink, const CVTimeStamp *
 		self.verticalScroller.frame = newVScrollerRect;
 		self.horizontalScroller.frame = newHScrollerRect;
 	};
+	
+	// the statistics stay in the top left corner
+	if (_frameStatisticsView) {
+		CGRect statisticsRect = _frameStatisticsView.frame;
+		statisticsRect.origin = CGPointMake(roundf(-offset.x - pullX + 8), roundf(-offset.y + pullY + bounds.size.height - statisticsRect.size.height - 8));
+		_frameStatisticsView.frame = statisticsRect;
+	}
 	if (!animated)
 		updateBlock();
 	
@@ -641,6 +812,15 @@ __unused static CGPoint PointLerp(CGPoint a, CGPoint b, CGFloat t)
 
 - (void)_setContentOffset:(CGPoint)p
 {
+	CFAbsoluteTime start = _scrollViewFlags.recordingFrameStatistics ? CFAbsoluteTimeGetCurrent() : 0.0;
+	
+	// scroll events waiting for a frame carry on from wherever the content is
+	// moved in the meantime, rather than taking it back to where it was
+	if (_scrollViewFlags.scrollPending) {
+		_pendingScrollOffset.x += p.x - _unroundedContentOffset.x;
+		_pendingScrollOffset.y += p.y - _unroundedContentOffset.y;
+	}
+	
 	_unroundedContentOffset = p;
 	p.x = round(-p.x - self.bounceOffset.x - self.pullOffset.x);
 	p.y = round(-p.y - self.bounceOffset.y - self.pullOffset.y);
@@ -648,6 +828,14 @@ __unused static CGPoint PointLerp(CGPoint a, CGPoint b, CGFloat t)
 	if (_scrollViewFlags.delegateScrollViewDidScroll){
 		[_delegate scrollViewDidScroll:self];
 	}
+	if ([_scrollObservers count] > 0) {
+		for (id<TUIScrollViewObserver> observer in [_scrollObservers allObjects]) {
+			[observer scrollViewDidChangeContentOffset:self];
+		}
+	}
+	
+	if (_scrollViewFlags.recordingFrameStatistics)
+		[_frameStatistics recordValue:CFAbsoluteTimeGetCurrent() - start forMetric:TUIFrameStatisticsMetricContentOffsetTime];
 }
 
 - (void)setContentOffset:(CGPoint)p
@@ -755,17 +943,18 @@ __unused static CGPoint PointLerp(CGPoint a, CGPoint b, CGFloat t)
 
 - (BOOL)isScrollingToTop
 {
-	if (displayLink) {
-		if (_scrollViewFlags.animationMode == AnimationModeScrollTo) {
-			if (roundf(destinationOffset.y) == roundf([self topDestinationOffset]))
-				return YES;
-		}
+	if (_scrollViewFlags.animationMode == AnimationModeScrollTo) {
+		if (roundf(destinationOffset.y) == roundf([self topDestinationOffset]))
+			return YES;
 	}
 	return NO;
 }
 
 - (void)setContentOffset:(CGPoint)contentOffset animated:(BOOL)animated
 {
+	// wherever the scroll events were taking the content, it's going here instead
+	_scrollViewFlags.scrollPending = 0;
+	
 	if (animated) {
 		destinationOffset = contentOffset;
 		[self _startDisplayLink:AnimationModeScrollTo];
@@ -833,29 +1022,16 @@ static float clampBounce(float x) {
 - (void)_updateBounce
 {
 	if (_bounce.bouncing) {
-		CFAbsoluteTime t = CFAbsoluteTimeGetCurrent();
-		double dt = t - _bounce.t;
-		
-		CGPoint F = CGPointZero;
-		
-		float tightness = 2.5f;
-		float dampiness = 0.35f;
+		// the time of the frame being ticked for, never before the last step
+		CFAbsoluteTime t = MAX([TUIFrameClock sharedFrameClock].timestamp, _bounce.t);
+		CFTimeInterval dt = t - _bounce.t;
 		
-		// spring
-		F.x = -_bounce.x * tightness;
-		F.y = -_bounce.y * tightness;
-		
-		// damper
-		if (fabsf(_bounce.x) > 0.0)
-			F.x -= _bounce.vx * dampiness;
-		if (fabsf(_bounce.y) > 0.0)
-			F.y -= _bounce.vy * dampiness;
-		
-		_bounce.vx += F.x; // mass=1
-		_bounce.vy += F.y;
-		
-		_bounce.x += _bounce.vx * dt;
-		_bounce.y += _bounce.vy * dt;
+		TUIScrollPhysicsState horizontal = TUIScrollPhysicsSpring(TUIScrollPhysicsStateMake(_bounce.x, _bounce.vx), TUIScrollViewBounceFrequency, dt);
+		TUIScrollPhysicsState vertical = TUIScrollPhysicsSpring(TUIScrollPhysicsStateMake(_bounce.y, _bounce.vy), TUIScrollViewBounceFrequency, dt);
+		_bounce.x = horizontal.position;
+		_bounce.vx = horizontal.velocity;
+		_bounce.y = vertical.position;
+		_bounce.vy = vertical.velocity;
 		
 		_bounce.t = t;
 		
@@ -880,14 +1056,21 @@ static float clampBounce(float x) {
 		return;
 	}
 	
+	// every mode steps from the last tick to the frame being ticked for
+	CFAbsoluteTime t = MAX([TUIFrameClock sharedFrameClock].timestamp, _throw.t);
+	CFTimeInterval dt = t - _throw.t;
+	_throw.t = t;
+	
+	CGFloat decayRate = TUIScrollPhysicsDecayRateForDecelerationRate(decelerationRate);
+	
 	switch (_scrollViewFlags.animationMode) {
 		case AnimationModeThrow: {
 			
 			CGPoint o = _unroundedContentOffset;
-			CFAbsoluteTime t = CFAbsoluteTimeGetCurrent();
-			double dt = t - _throw.t;
-			o.x = o.x + _throw.vx * dt;
-			o.y = o.y - _throw.vy * dt;
+			TUIScrollPhysicsState horizontal = TUIScrollPhysicsDecay(TUIScrollPhysicsStateMake(o.x, _throw.vx), decayRate, dt);
+			TUIScrollPhysicsState vertical = TUIScrollPhysicsDecay(TUIScrollPhysicsStateMake(o.y, -_throw.vy), decayRate, dt);
+			o.x = horizontal.position;
+			o.y = vertical.position;
 			
 			CGPoint fixedOffset = [self _fixProposedContentOffset:o];
 			if (!CGPointEqualToPoint(fixedOffset, o)) {
@@ -896,9 +1079,8 @@ static float clampBounce(float x) {
 			
 			[self setContentOffset:o];
 			
-			_throw.vx *= decelerationRate;
-			_throw.vy *= decelerationRate;
-			_throw.t = t;
+			_throw.vx = horizontal.velocity;
+			_throw.vy = -vertical.velocity;
 			
 			if (_throw.throwing && !self._pulling && !_bounce.bouncing) {
 				// may happen in the case where our we scrolled, then stopped, then lifted finger (didn't do a system-started throw, but display link started anyway to do something else)
@@ -912,14 +1094,15 @@ static float clampBounce(float x) {
 		}
 		case AnimationModeScrollTo: {
 			
+			// head for where the content can actually get to, or it never arrives
+			CGPoint destination = [self _fixProposedContentOffset:destinationOffset];
 			CGPoint o = _unroundedContentOffset;
-			CGPoint lastOffset = o;
-			o.x = o.x * decelerationRate + destinationOffset.x * (1-decelerationRate);
-			o.y = o.y * decelerationRate + destinationOffset.y * (1-decelerationRate);
+			o.x = TUIScrollPhysicsApproach(o.x, destination.x, decayRate, dt);
+			o.y = TUIScrollPhysicsApproach(o.y, destination.y, decayRate, dt);
 			o = [self _fixProposedContentOffset:o];
 			[self _setContentOffset:o];
 			
-			if ((fabsf(o.x - lastOffset.x) < 0.1) && (fabsf(o.y - lastOffset.y) < 0.1)) {
+			if ((fabs(o.x - destination.x) < 0.5) && (fabs(o.y - destination.y) < 0.5)) {
 				[self _stopDisplayLink];
 				[self setContentOffset:destinationOffset];
 			}
@@ -941,7 +1124,7 @@ static float clampBounce(float x) {
 			}
 			
 			CGPoint offset = _unroundedContentOffset;
-			CGFloat step = (1.0 - (distance / TUIScrollViewContinuousScrollDragBoundary)) * TUIScrollViewContinuousScrollRate;
+			CGFloat step = (1.0 - (distance / TUIScrollViewContinuousScrollDragBoundary)) * TUIScrollViewContinuousScrollRate * dt;
 			CGPoint dest = CGPointMake(offset.x, offset.y + (step * direction));
 			
 			[self setContentOffset:dest];
@@ -1057,6 +1240,8 @@ static float clampBounce(float x) {
 
 - (void)_startThrow
 {
+	// throw from wherever the scroll events left off
+	[self _applyPendingScroll];
 	
 	if (!self._pulling){
 		if (fabsf(_lastScroll.dy) < 2.0 && fabsf(_lastScroll.dx) < 2.0){
@@ -1215,7 +1400,8 @@ static float clampBounce(float x) {
 					_lastScroll.t = CFAbsoluteTimeGetCurrent();
 				}
 				
-				CGPoint o = _unroundedContentOffset;
+				// carry on from any scroll events still waiting for a frame
+				CGPoint o = _scrollViewFlags.scrollPending ? _pendingScrollOffset : _unroundedContentOffset;
 				
 				if (!_pull.xPulling) o.x = o.x + dx;
 				if (!_pull.yPulling) o.y = o.y - dy;
@@ -1264,7 +1450,14 @@ static float clampBounce(float x) {
 					_pull.yPulling = yPulling;
 				}
 				
-				[self setContentOffset:o];
+				if (!_scrollViewFlags.scrollPending)
+					_pendingScrollEventTime = event.timestamp;
+				_pendingScrollOffset = o;
+				_scrollViewFlags.scrollPending = 1;
+				[self _observeFrameClock];
+				
+				if (!_scrollViewFlags.coalescesScrollEvents)
+					[self _applyPendingScroll];
 				break;
 			}
 			case ScrollPhaseThrowingBegan: {
@@ -19,11 +19,22 @@
 
 @class NSFont;
 
+/*
+ Measuring is safe to do from any thread, and from several at once.
+ Drawing is too, as long as each thread draws into its own context.
+ */
 @interface NSAttributedString (TUIStringDrawing)
 
+/*
+ Measures each of @p attributedStrings at @p width, in parallel, returning
+ an array of NSValue-wrapped sizes in the same order.
+ */
++ (NSArray *)ab_sizesOfAttributedStrings:(NSArray *)attributedStrings constrainedToWidth:(CGFloat)width;
+
 - (CGSize)ab_size;
 - (CGSize)ab_sizeConstrainedToSize:(CGSize)size;
 - (CGSize)ab_sizeConstrainedToWidth:(CGFloat)width;
+- (CGSize)ab_sizeConstrainedToWidth:(CGFloat)width numberOfLines:(NSUInteger)numberOfLines; // 0 for no limit
 
 - (CGSize)ab_drawInRect:(CGRect)rect;
 - (CGSize)ab_drawInRect:(CGRect)rect context:(CGContextRef)ctx;
@@ -35,6 +46,8 @@
 - (CGSize)ab_sizeWithFont:(NSFont *)font;
 - (CGSize)ab_sizeWithFont:(NSFont *)font constrainedToSize:(CGSize)size;
 
++ (NSArray *)ab_sizesOfStrings:(NSArray *)strings withFont:(NSFont *)font constrainedToWidth:(CGFloat)width;
+
 #if TARGET_OS_MAC
 // for ABRowView
 //- (CGSize)drawInRect:(CGRect)rect withFont:(NSFont *)font lineBreakMode:(TUILineBreakMode)lineBreakMode alignment:(TUITextAlignment)alignment;
@@ -44,3 +57,48 @@
 - (CGSize)ab_drawInRect:(CGRect)rect withFont:(NSFont *)font lineBreakMode:(TUILineBreakMode)lineBreakMode alignment:(TUITextAlignment)alignment;
 
 @end
+
+/*
+
+ The layouts the methods above measure and draw with. Layouts are keyed by
+ attributed string and width, and only laid out as far down as the height
+ asked for, so a long string measured or drawn in a short rect isn't all
+ typeset. Measuring a string and then drawing it in a rect of the same
+ height, or any rect it fits in, reuses one layout; a taller request for a
+ string which didn't fit replaces it with a taller one. Least recently used
+ layouts are evicted once either limit is hit.
+
+ The cache is safe to use from any thread.
+
+ */
+
+@interface TUITextLayoutCache : NSObject
+
++ (instancetype)sharedCache;
+
+/*
+ The most layouts to keep. Defaults to 256.
+ */
+@property (nonatomic, assign) NSUInteger countLimit;
+
+/*
+ The most memory, in bytes, layouts may take up. Defaults to 4MB.
+ */
+@property (nonatomic, assign) NSUInteger byteLimit;
+
+/*
+ Number of cached layouts, and an estimate of the memory, in bytes, they take up.
+ */
+@property (nonatomic, assign, readonly) NSUInteger count;
+@property (nonatomic, assign, readonly) NSUInteger bytes;
+
+/*
+ Number of lookups served by a cached layout, and number which had to build one.
+ */
+@property (nonatomic, assign, readonly) NSUInteger hits;
+@property (nonatomic, assign, readonly) NSUInteger misses;
+
+- (void)removeAllLayouts;
+- (void)resetStatistics;
+
+@end
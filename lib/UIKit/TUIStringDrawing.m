@@ -14,19 +14,363 @@
  limitations under the License.
  */
 
+#import <pthread.h>
+#import "CoreText+Additions.h"
 #import "TUIAttributedString.h"
 #import "TUICGAdditions.h"
 #import "TUIStringDrawing.h"
-#import "TUITextRenderer.h"
+
+// the height layouts are built to when the caller doesn't limit it
+#define TUITextLayoutMaximumHeight 1000000.0f
+
+#define TUITextLayoutDefaultCountLimit 256
+#define TUITextLayoutDefaultByteLimit (4 * 1024 * 1024)
+
+// rough per line and per glyph overhead of a CTLine, for estimating what a layout costs
+#define TUITextLayoutBytesPerLine 256
+#define TUITextLayoutBytesPerGlyph (sizeof(CGGlyph) + sizeof(CGPoint) + sizeof(CGSize) + sizeof(CFIndex))
+
+static CTFrameRef TUITextLayoutCreateFrame(CTFramesetterRef framesetter, CGRect rect)
+{
+	CGMutablePathRef path = CGPathCreateMutable();
+	CGPathAddRect(path, NULL, rect);
+	CTFrameRef frame = CTFramesetterCreateFrame(framesetter, CFRangeMake(0, 0), path, NULL);
+	CGPathRelease(path);
+	return frame;
+}
+
+@interface TUITextLayoutKey : NSObject <NSCopying>
+@property (nonatomic, strong) NSAttributedString *attributedString;
+@property (nonatomic, assign) CGFloat width;
+@end
+
+@implementation TUITextLayoutKey
+
+- (id)copyWithZone:(NSZone *)zone
+{
+	TUITextLayoutKey *key = [[TUITextLayoutKey alloc] init];
+	// the caller's string may be mutable, so the key the cache keeps gets its own
+	key.attributedString = [self.attributedString copy];
+	key.width = self.width;
+	return key;
+}
+
+- (NSUInteger)hash
+{
+	return [self.attributedString hash] ^ (NSUInteger)(self.width * 31);
+}
+
+- (BOOL)isEqual:(id)object
+{
+	if(![object isKindOfClass:[TUITextLayoutKey class]])
+		return NO;
+
+	TUITextLayoutKey *key = object;
+	return key.width == self.width && (key.attributedString == self.attributedString || [key.attributedString isEqualToAttributedString:self.attributedString]);
+}
+
+@end
+
+/*
+ A string laid out at a width, in a frame _height tall with its origin at
+ zero. Layouts aren't changed once built, since other threads may be using
+ them; a taller one replaces a shorter one in the cache instead. Entries
+ are also the links of the cache's LRU list.
+ */
+@interface TUITextLayout : NSObject {
+@public
+	CTFramesetterRef _framesetter;
+	CTFrameRef _frame;
+	CGFloat _height;
+	BOOL _complete; // the frame holds all of the string
+	CGSize _size;
+	NSUInteger _bytes;
+
+	TUITextLayoutKey *_key;
+	__unsafe_unretained TUITextLayout *_previous; // more recently used
+	__unsafe_unretained TUITextLayout *_next; // less recently used
+}
+@end
+
+@implementation TUITextLayout
+
+- (id)initWithAttributedString:(NSAttributedString *)attributedString framesetter:(CTFramesetterRef)framesetter width:(CGFloat)width height:(CGFloat)height
+{
+	if((self = [super init])) {
+		_framesetter = framesetter ? (CTFramesetterRef)CFRetain(framesetter) : CTFramesetterCreateWithAttributedString((__bridge CFAttributedStringRef)attributedString);
+		_frame = TUITextLayoutCreateFrame(_framesetter, CGRectMake(0, 0, width, height));
+		_height = height;
+		_complete = (CFIndex)[attributedString length] == CTFrameGetVisibleStringRange(_frame).length;
+		_size = AB_CTFrameGetSize(_frame);
+
+		_bytes = [attributedString length] * sizeof(unichar);
+		for(id line in (__bridge NSArray *)CTFrameGetLines(_frame)) {
+			_bytes += TUITextLayoutBytesPerLine + CTLineGetGlyphCount((__bridge CTLineRef)line) * TUITextLayoutBytesPerGlyph;
+		}
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	if(_frame) CFRelease(_frame);
+	if(_framesetter) CFRelease(_framesetter);
+}
+
+/*
+ Whether the layout is the same as one built @p height tall would be.
+ */
+- (BOOL)coversHeight:(CGFloat)height
+{
+	return _height == height || (_complete && _size.height <= height);
+}
+
+/*
+ The size of the first @p numberOfLines lines, or of every line if it's 0.
+ */
+- (CGSize)sizeWithNumberOfLines:(NSUInteger)numberOfLines
+{
+	NSArray *lines = (__bridge NSArray *)CTFrameGetLines(_frame);
+	NSUInteger count = [lines count];
+	if(numberOfLines == 0 || numberOfLines >= count)
+		return _size;
+
+	CGFloat w = 0.0;
+	for(NSUInteger i = 0; i < numberOfLines; i++) {
+		w = MAX(w, AB_CTLineGetSize((__bridge CTLineRef)[lines objectAtIndex:i]).width);
+	}
+
+	CGPoint lastLineOrigin;
+	CTFrameGetLineOrigins(_frame, CFRangeMake(numberOfLines - 1, 1), &lastLineOrigin);
+	CGFloat ascent, descent, leading;
+	CTLineGetTypographicBounds((__bridge CTLineRef)[lines objectAtIndex:numberOfLines - 1], &ascent, &descent, &leading);
+	return CGSizeMake(ceil(w), ceil(_height - lastLineOrigin.y + descent));
+}
+
+@end
+
+@implementation TUITextLayoutCache {
+	pthread_mutex_t _lock;
+	NSMapTable *_layouts; // TUITextLayoutKey -> TUITextLayout, keys kept as given rather than copied again
+	__unsafe_unretained TUITextLayout *_mostRecentlyUsed;
+	__unsafe_unretained TUITextLayout *_leastRecentlyUsed;
+	NSUInteger _countLimit;
+	NSUInteger _byteLimit;
+	NSUInteger _bytes;
+	NSUInteger _hits;
+	NSUInteger _misses;
+}
+
++ (instancetype)sharedCache
+{
+	static TUITextLayoutCache *sharedCache = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		sharedCache = [[self alloc] init];
+	});
+	return sharedCache;
+}
+
+- (id)init
+{
+	if((self = [super init])) {
+		pthread_mutex_init(&_lock, NULL);
+		_layouts = [NSMapTable strongToStrongObjectsMapTable];
+		_countLimit = TUITextLayoutDefaultCountLimit;
+		_byteLimit = TUITextLayoutDefaultByteLimit;
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	pthread_mutex_destroy(&_lock);
+}
+
+// The following must be called with the lock held.
+
+- (void)_unlinkLayout:(TUITextLayout *)layout
+{
+	if(layout->_previous) layout->_previous->_next = layout->_next;
+	else _mostRecentlyUsed = layout->_next;
+	if(layout->_next) layout->_next->_previous = layout->_previous;
+	else _leastRecentlyUsed = layout->_previous;
+	layout->_previous = nil;
+	layout->_next = nil;
+}
+
+- (void)_linkLayoutAsMostRecentlyUsed:(TUITextLayout *)layout
+{
+	layout->_next = _mostRecentlyUsed;
+	if(_mostRecentlyUsed) _mostRecentlyUsed->_previous = layout;
+	_mostRecentlyUsed = layout;
+	if(!_leastRecentlyUsed) _leastRecentlyUsed = layout;
+}
+
+- (void)_evictLayoutsToFitLimits
+{
+	while(_leastRecentlyUsed && ([_layouts count] > _countLimit || _bytes > _byteLimit)) {
+		TUITextLayout *layout = _leastRecentlyUsed;
+		[self _unlinkLayout:layout];
+		_bytes -= layout->_bytes;
+		[_layouts removeObjectForKey:layout->_key];
+	}
+}
+
+/*
+ A layout of @p attributedString at @p width the same as one built @p height
+ tall. A cached layout is used if it covers the height. Otherwise one is
+ built to the height, reusing the cached layout's framesetter, and takes
+ the cached one's place if it holds more of the string.
+ */
+- (TUITextLayout *)layoutForAttributedString:(NSAttributedString *)attributedString width:(CGFloat)width height:(CGFloat)height
+{
+	TUITextLayoutKey *key = [[TUITextLayoutKey alloc] init];
+	key.attributedString = attributedString;
+	key.width = width;
+
+	pthread_mutex_lock(&_lock);
+	TUITextLayout *cached = [_layouts objectForKey:key];
+	if(cached != nil) {
+		[self _unlinkLayout:cached];
+		[self _linkLayoutAsMostRecentlyUsed:cached];
+	}
+	BOOL hit = (cached != nil && [cached coversHeight:height]);
+	if(hit) {
+		_hits++;
+	} else {
+		_misses++;
+	}
+	pthread_mutex_unlock(&_lock);
+
+	if(hit)
+		return cached;
+
+	// build outside the lock; if another thread builds the same layout meanwhile, the one holding more wins
+	TUITextLayout *layout = [[TUITextLayout alloc] initWithAttributedString:attributedString framesetter:(cached ? cached->_framesetter : NULL) width:width height:height];
+
+	pthread_mutex_lock(&_lock);
+	TUITextLayout *existing = [_layouts objectForKey:key];
+	if(existing == nil || (!existing->_complete && layout->_height > existing->_height)) {
+		if(existing != nil) {
+			[self _unlinkLayout:existing];
+			_bytes -= existing->_bytes;
+			[_layouts removeObjectForKey:key];
+		}
+		layout->_key = [key copy];
+		[_layouts setObject:layout forKey:layout->_key];
+		_bytes += layout->_bytes;
+		[self _linkLayoutAsMostRecentlyUsed:layout];
+		[self _evictLayoutsToFitLimits];
+	}
+	pthread_mutex_unlock(&_lock);
+
+	return layout;
+}
+
+- (void)removeAllLayouts
+{
+	pthread_mutex_lock(&_lock);
+	_mostRecentlyUsed = nil;
+	_leastRecentlyUsed = nil;
+	[_layouts removeAllObjects];
+	_bytes = 0;
+	pthread_mutex_unlock(&_lock);
+}
+
+- (NSUInteger)countLimit
+{
+	pthread_mutex_lock(&_lock);
+	NSUInteger countLimit = _countLimit;
+	pthread_mutex_unlock(&_lock);
+	return countLimit;
+}
+
+- (void)setCountLimit:(NSUInteger)countLimit
+{
+	pthread_mutex_lock(&_lock);
+	_countLimit = countLimit;
+	[self _evictLayoutsToFitLimits];
+	pthread_mutex_unlock(&_lock);
+}
+
+- (NSUInteger)byteLimit
+{
+	pthread_mutex_lock(&_lock);
+	NSUInteger byteLimit = _byteLimit;
+	pthread_mutex_unlock(&_lock);
+	return byteLimit;
+}
+
+- (void)setByteLimit:(NSUInteger)byteLimit
+{
+	pthread_mutex_lock(&_lock);
+	_byteLimit = byteLimit;
+	[self _evictLayoutsToFitLimits];
+	pthread_mutex_unlock(&_lock);
+}
+
+- (NSUInteger)count
+{
+	pthread_mutex_lock(&_lock);
+	NSUInteger count = [_layouts count];
+	pthread_mutex_unlock(&_lock);
+	return count;
+}
+
+- (NSUInteger)bytes
+{
+	pthread_mutex_lock(&_lock);
+	NSUInteger bytes = _bytes;
+	pthread_mutex_unlock(&_lock);
+	return bytes;
+}
+
+- (NSUInteger)hits
+{
+	pthread_mutex_lock(&_lock);
+	NSUInteger hits = _hits;
+	pthread_mutex_unlock(&_lock);
+	return hits;
+}
+
+- (NSUInteger)misses
+{
+	pthread_mutex_lock(&_lock);
+	NSUInteger misses = _misses;
+	pthread_mutex_unlock(&_lock);
+	return misses;
+}
+
+- (void)resetStatistics
+{
+	pthread_mutex_lock(&_lock);
+	_hits = 0;
+	_misses = 0;
+	pthread_mutex_unlock(&_lock);
+}
+
+@end
 
 @implementation NSAttributedString (TUIStringDrawing)
 
-- (TUITextRenderer *)ab_sharedTextRenderer
++ (NSArray *)ab_sizesOfAttributedStrings:(NSArray *)attributedStrings constrainedToWidth:(CGFloat)width
 {
-	static TUITextRenderer *t = nil;
-	if(!t)
-		t = [[TUITextRenderer alloc] init];
-	return t;
+	NSUInteger count = [attributedStrings count];
+	if(count == 0)
+		return @[];
+
+	CGSize *sizes = malloc(sizeof(CGSize) * count);
+	dispatch_apply(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+		sizes[i] = [[attributedStrings objectAtIndex:i] ab_sizeConstrainedToWidth:width];
+	});
+
+	NSMutableArray *values = [NSMutableArray arrayWithCapacity:count];
+	for(NSUInteger i = 0; i < count; i++) {
+		[values addObject:[NSValue valueWithSize:sizes[i]]];
+	}
+	free(sizes);
+	return values;
 }
 
 - (CGSize)ab_sizeConstrainedToWidth:(CGFloat)width
@@ -34,12 +378,16 @@
 	return [self ab_sizeConstrainedToSize:CGSizeMake(width, 2000)]; // big enough
 }
 
+- (CGSize)ab_sizeConstrainedToWidth:(CGFloat)width numberOfLines:(NSUInteger)numberOfLines
+{
+	TUITextLayout *layout = [[TUITextLayoutCache sharedCache] layoutForAttributedString:self width:width height:TUITextLayoutMaximumHeight];
+	return [layout sizeWithNumberOfLines:numberOfLines];
+}
+
 - (CGSize)ab_sizeConstrainedToSize:(CGSize)size
 {
-	TUITextRenderer *t = [self ab_sharedTextRenderer];
-	t.attributedString = self;
-	t.frame = CGRectMake(0, 0, size.width, size.height);
-	return [t size];
+	TUITextLayout *layout = [[TUITextLayoutCache sharedCache] layoutForAttributedString:self width:size.width height:size.height];
+	return layout->_size;
 }
 
 - (CGSize)ab_size
@@ -49,11 +397,15 @@
 
 - (CGSize)ab_drawInRect:(CGRect)rect context:(CGContextRef)ctx
 {
-	TUITextRenderer *t = [self ab_sharedTextRenderer];
-	t.attributedString = self;
-	t.frame = rect;
-	[t drawInContext:ctx];
-	return [t size];
+	TUITextLayout *layout = [[TUITextLayoutCache sharedCache] layoutForAttributedString:self width:rect.size.width height:rect.size.height];
+
+	CGContextSaveGState(ctx);
+	CGContextSetTextMatrix(ctx, CGAffineTransformIdentity);
+	// line origins are relative to the top of the layout, so line its top up with the rect's
+	CGContextTranslateCTM(ctx, rect.origin.x, CGRectGetMaxY(rect) - layout->_height);
+	CTFrameDraw(layout->_frame, ctx);
+	CGContextRestoreGState(ctx);
+	return layout->_size;
 }
 
 - (CGSize)ab_drawInRect:(CGRect)rect
@@ -81,6 +433,17 @@
 	return [s ab_sizeConstrainedToSize:size];
 }
 
++ (NSArray *)ab_sizesOfStrings:(NSArray *)strings withFont:(NSFont *)font constrainedToWidth:(CGFloat)width
+{
+	NSMutableArray *attributedStrings = [NSMutableArray arrayWithCapacity:[strings count]];
+	for(NSString *string in strings) {
+		TUIAttributedString *s = [TUIAttributedString stringWithString:string];
+		s.font = font;
+		[attributedStrings addObject:s];
+	}
+	return [NSAttributedString ab_sizesOfAttributedStrings:attributedStrings constrainedToWidth:width];
+}
+
 //- (CGSize)drawInRect:(CGRect)rect withFont:(NSFont *)font lineBreakMode:(TUILineBreakMode)lineBreakMode alignment:(TUITextAlignment)alignment
 //{
 //	return [self ab_drawInRect:rect withFont:font lineBreakMode:lineBreakMode alignment:alignment];
@@ -31,6 +31,7 @@
 - (void)_layoutCells:(BOOL)needLayout;
 - (void)checkEventModifiers:(NSEvent *)event;
 
+- (BOOL)indexPathSelected:(NSIndexPath *)indexPathToCheck;
 - (void)_clearIndexPaths;
 - (void)_addSelectedIndexPath:(NSIndexPath*)indexPathToAdd animated:(BOOL)shouldAnimate;
 
@@ -122,7 +123,7 @@
 - (void)__updateDraggingCells:(TUITableViewCell *)cell offset:(CGPoint)offset location:(CGPoint)location {
     
     NSIndexPath *ip = [self indexPathForRowAtPoint:location];
-    if (![self.indexPathesForSelectedRows containsObject:ip] && ![self __isDraggingCells] && [self eventInside:[NSApp currentEvent]]) {
+    if (![self indexPathSelected:ip] && ![self __isDraggingCells] && [self eventInside:[NSApp currentEvent]]) {
         [self _clearIndexPaths];
         [self selectRowAtIndexPath:cell.indexPath animated:NO scrollPosition:TUITableViewScrollPositionNone];
         [self _generateDraggingViewsFromCell:cell atLocation:location];
@@ -225,7 +226,7 @@
     
     if (_indexPathToInsert &&
         ![_indexPathToInsert isEqual:[cell indexPath]] &&
-        ![self.indexPathesForSelectedRows containsObject:_indexPathToInsert]) {
+        ![self indexPathSelected:_indexPathToInsert]) {
         if(self.dataSource != nil && [self.dataSource respondsToSelector:@selector(tableView:moveRows:toIndexPath:)]){
             [self.dataSource tableView:self moveRows:self.indexPathesForSelectedRows toIndexPath:_indexPathToInsert];
             [self reloadData];
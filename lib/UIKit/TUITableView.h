@@ -56,6 +56,20 @@ typedef NS_ENUM(NSInteger, TUITableViewDropDestination) {
 
 @optional
 
+/**
+ If implemented, the table asks for an estimated height for every row when its section info is rebuilt (on reload and
+ resize), and only asks for the real height from tableView:heightForRowAtIndexPath: once a row comes near the visible
+ rect. The content size and scroll position are corrected as the real heights come in. The estimate should be cheap.
+ */
+- (CGFloat)tableView:(TUITableView *)tableView estimatedHeightForRowAtIndexPath:(NSIndexPath *)indexPath;
+
+/**
+ If implemented, row heights are measured with this method instead of tableView:heightForRowAtIndexPath:, with the rows of each section spread across a concurrent GCD queue. It is called on background threads and must be thread-safe: it must not touch the table, its cells or any other views.
+ 
+ On its own, reloads still wait for every row to be measured, just in parallel. Together with tableView:estimatedHeightForRowAtIndexPath:, reloads return with estimates and each section's real heights are applied on the main thread as soon as the whole section has been measured.
+ */
+- (CGFloat)tableView:(TUITableView *)tableView concurrentHeightForRowAtIndexPath:(NSIndexPath *)indexPath;
+
 - (void)tableView:(TUITableView *)tableView willDisplayCell:(TUITableViewCell *)cell forRowAtIndexPath:(NSIndexPath *)indexPath; // called after the cell's frame has been set but before it's added as a subview
 - (void)tableView:(TUITableView *)tableView didSelectRowAtIndexPath:(NSIndexPath *)indexPath; // happens on left/right mouse down, key up/down
 - (void)tableView:(TUITableView *)tableView didDeselectRowAtIndexPath:(NSIndexPath *)indexPath;
@@ -86,13 +100,14 @@ typedef NS_ENUM(NSInteger, TUITableViewDropDestination) {
 	CGFloat                       _contentHeight;
 	
 	NSMutableIndexSet           * _visibleSectionHeaders;
-	NSMutableDictionary         * _visibleItems;
 	NSMutableDictionary         * _reusableTableCells;
 	TUIView                     * _multiDragableView;
     
     // additions for multipleSelections
     NSIndexPath                 *_indexPathForLastSelectedRow;
-    NSMutableArray              * _arrayOfSelectedIndexes;
+    NSMutableArray              * _selectedRowIndexes; // an NSMutableIndexSet of selected rows per section
+    NSUInteger                    _numberOfSelectedRows;
+    NSArray                     * _indexPathsForSelectedRows; // built on demand, cleared when the selection changes
     BOOL                        _multipleSelectionKeyIsPressed;
     BOOL                        _extendMultipleSelectionKeyIsPressed;
 //    NSUInteger                  _iterationCount;
@@ -103,6 +118,14 @@ typedef NS_ENUM(NSInteger, TUITableViewDropDestination) {
 	NSIndexPath            * _keepVisibleIndexPathForReload;
 	CGFloat                       _relativeOffsetForReload;
 	
+	// row updates between -beginUpdates and -endUpdates
+	NSInteger                     _updateNestingLevel;
+	NSMutableArray              * _deletedIndexPaths;
+	NSMutableArray              * _insertedIndexPaths;
+	NSMutableArray              * _reloadedIndexPaths;
+	
+	NSMutableDictionary         * _rowHeightMeasurements; // running background measurements by section index
+	
     // New drag properties
     NSMutableArray      *_draggedViews;
     TUIView             *_draggingSeparatorView;
@@ -120,6 +143,12 @@ typedef NS_ENUM(NSInteger, TUITableViewDropDestination) {
 		unsigned int dataSourceNumberOfSectionsInTableView:1;
 		unsigned int delegateTableViewWillDisplayCellForRowAtIndexPath:1;
 		unsigned int maintainContentOffsetAfterReload:1;
+		unsigned int delegateTableViewEstimatedHeightForRowAtIndexPath:1;
+		unsigned int delegateTableViewConcurrentHeightForRowAtIndexPath:1;
+		unsigned int visibleCellsNeedRelayout:1;
+		unsigned int indexPathsForRowsInRectOverridden:1;
+		unsigned int prefetchScheduled:1;
+		unsigned int prefetchTowardLaterRows:1;
 	} _tableFlags;
 	
 }
@@ -146,6 +175,18 @@ typedef NS_ENUM(NSInteger, TUITableViewDropDestination) {
 // Forces a re-calculation and re-layout of the table. This is most useful for animating the relayout. It is potentially _more_ expensive than -reloadData since it has to allow for animating.
 - (void)reloadLayout;
 
+/**
+ Row updates patch the heights and offsets of the affected sections in place and only recycle the visible cells of rows which were deleted or reloaded, instead of rebuilding the whole table like -reloadData. The data source must already reflect the change when they're applied.
+ 
+ Updates made between -beginUpdates and -endUpdates are applied together by the outermost -endUpdates. Deleted and reloaded index paths refer to rows before the update, inserted index paths to rows after it. The first visible row is kept in place, and cells for the rows left without one are made when the table is next laid out, at the end of the run loop turn; call -layoutIfNeeded to have them sooner. The number of sections can't change; if the updates don't match the data source, the table falls back to -reloadData.
+ */
+- (void)beginUpdates;
+- (void)endUpdates;
+
+- (void)insertRowsAtIndexPaths:(NSArray *)indexPaths;
+- (void)deleteRowsAtIndexPaths:(NSArray *)indexPaths;
+- (void)reloadRowsAtIndexPaths:(NSArray *)indexPaths;
+
 - (NSInteger)numberOfSections;
 - (NSInteger)numberOfRowsInSection:(NSInteger)section;
 
@@ -176,6 +217,18 @@ typedef NS_ENUM(NSInteger, TUITableViewDropDestination) {
 
 @property (weak, nonatomic, readonly) NSIndexPath *indexPathForSelectedRow;
 @property (strong, nonatomic, readonly) NSArray *indexPathesForSelectedRows;
+@property (nonatomic, readonly) NSUInteger numberOfSelectedRows;
+
+/**
+ * @brief Obtain the selected rows of a section
+ *
+ * Unlike #indexPathesForSelectedRows this doesn't create an index path per
+ * selected row, so it stays cheap for large selections.
+ *
+ * @param section the section
+ * @return indexes of the selected rows in @p section
+ */
+- (NSIndexSet *)indexesOfSelectedRowsInSection:(NSInteger)section;
 
 - (NSIndexPath *)indexPathForFirstRow;
 - (NSIndexPath *)indexPathForLastRow;
@@ -201,6 +254,21 @@ typedef NS_ENUM(NSInteger, TUITableViewDropDestination) {
  */
 - (TUITableViewCell *)dequeueReusableCellWithIdentifier:(NSString *)identifier;
 
+/**
+ Fills the reuse pool for @p identifier up to @p count cells, so the first screenfuls of a table don't have to allocate any. @p block is called for each missing cell and must return a cell with the given reuse identifier.
+ */
+- (void)prepareReusableCellsWithIdentifier:(NSString *)identifier count:(NSUInteger)count usingBlock:(TUITableViewCell *(^)(void))block;
+
+/**
+ Caps how many recycled cells with @p identifier are kept for reuse; cells recycled beyond the cap are released. Pass NSUIntegerMax to remove the cap. Pools are not capped by default.
+ */
+- (void)setMaximumNumberOfReusableCells:(NSUInteger)count withIdentifier:(NSString *)identifier;
+
+/**
+ How far beyond the visible rect, in points, cells are made ahead of time in the direction the table is scrolling. Prefetched cells are requested from the data source, laid out and drawn a few at a time between scroll ticks, so scrolling them into view is cheap. tableView:willDisplayCell:forRowAtIndexPath: is still only called once a cell becomes visible. Defaults to 0, which disables prefetching.
+ */
+@property (nonatomic, assign) CGFloat prefetchDistance;
+
 // Drag proxy
 
 - (NSDragOperation)draggingUpdated:(id <NSDraggingInfo>)sender;
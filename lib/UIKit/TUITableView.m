@@ -27,11 +27,91 @@ NSUInteger const TUIAddSelectionKey = NSCommandKeyMask;
 // header views need to be above the cells at all times
 #define HEADER_Z_POSITION 1000
 
+// how far above and below the visible rect estimated row heights are resolved, in visible rect heights
+#define ESTIMATED_ROW_HEIGHT_RESOLVE_MARGIN 1.0
+
+// number of rows measured per block when row heights are computed concurrently
+#define CONCURRENT_ROW_HEIGHT_CHUNK_SIZE 256
+
+// number of cells prefetched per run loop pass, so prefetching never holds up a scroll tick for long
+#define PREFETCH_CELLS_PER_PASS 1
+
 typedef struct {
 	CGFloat offset; // from beginning of section
 	CGFloat height;
+	BOOL estimated; // height came from tableView:estimatedHeightForRowAtIndexPath:
 } TUITableViewRowInfo;
 
+typedef struct {
+	NSInteger section;
+	NSInteger row;
+} TUITableViewRowPosition;
+
+static inline NSComparisonResult TUITableViewCompareRowPositions(TUITableViewRowPosition a, TUITableViewRowPosition b)
+{
+	if(a.section != b.section)
+		return (a.section < b.section) ? NSOrderedAscending : NSOrderedDescending;
+	if(a.row != b.row)
+		return (a.row < b.row) ? NSOrderedAscending : NSOrderedDescending;
+	return NSOrderedSame;
+}
+
+@interface TUITableView (SectionInfo)
+
+- (BOOL)_usesEstimatedRowHeights;
+- (BOOL)_usesConcurrentRowHeights;
+
+@end
+
+@class TUITableViewSection;
+
+/**
+ * @brief A section being measured in the background
+ *
+ * Kept by the table per section index while the measurement runs.  It is
+ * cancelled when the table's data or width changes, and the measuring loop
+ * checks between rows, so a stale measurement stops early instead of running
+ * to the end.
+ */
+@interface TUITableViewRowHeightMeasurement : NSObject
+@property (nonatomic, assign) NSUInteger numberOfRows;
+@property (nonatomic, assign) CGFloat width;
+@property (nonatomic, strong) TUITableViewSection *section; // where the heights are published, moved along when the section is rebuilt
+@property (nonatomic, assign) NSUInteger mutationCount; // of the section when it was adopted
+@property (atomic, assign) BOOL cancelled;
+@end
+
+@implementation TUITableViewRowHeightMeasurement
+@end
+
+/**
+ * @brief Measure the rows of a section on a concurrent queue
+ *
+ * The rows are split into chunks which are measured in parallel with
+ * tableView:concurrentHeightForRowAtIndexPath:, and this returns once every
+ * row has been measured, or as soon as @p measurement is cancelled.  Safe to
+ * call from any thread.
+ *
+ * @param heights receives the height of each row
+ * @param stride distance in bytes between consecutive heights
+ * @param measurement checked for cancellation between rows, or nil
+ */
+static void TUITableViewComputeRowHeightsConcurrently(TUITableView *tableView, id<TUITableViewDelegate> delegate, NSInteger section, NSUInteger numberOfRows, CGFloat *heights, size_t stride, TUITableViewRowHeightMeasurement *measurement)
+{
+	size_t chunks = (numberOfRows + CONCURRENT_ROW_HEIGHT_CHUNK_SIZE - 1) / CONCURRENT_ROW_HEIGHT_CHUNK_SIZE;
+	dispatch_apply(chunks, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t chunk) {
+		@autoreleasepool {
+			NSUInteger end = MIN((chunk + 1) * CONCURRENT_ROW_HEIGHT_CHUNK_SIZE, numberOfRows);
+			for(NSUInteger row = chunk * CONCURRENT_ROW_HEIGHT_CHUNK_SIZE; row < end; row++) {
+				if(measurement.cancelled)
+					return;
+				CGFloat *height = (CGFloat *)((char *)heights + row * stride);
+				*height = roundf([delegate tableView:tableView concurrentHeightForRowAtIndexPath:[NSIndexPath indexPathForRow:row inSection:section]]);
+			}
+		}
+	});
+}
+
 @interface TUITableViewSection : NSObject
 {
 	__unsafe_unretained TUITableView  *_tableView;   // weak
@@ -41,6 +121,9 @@ typedef struct {
 	CGFloat               sectionHeight;
 	CGFloat               sectionOffset;
 	TUITableViewRowInfo  *rowInfo;
+	NSUInteger            numberOfEstimatedRows;
+	CGFloat               firstRowOffset; // header height
+	NSUInteger            mutationCount; // bumped whenever rows are set up, inserted or deleted
 }
 
 @property (strong, readonly) TUIView           *headerView;
@@ -75,22 +158,214 @@ typedef struct {
 	return numberOfRows;
 }
 
+- (NSUInteger)numberOfEstimatedRows
+{
+	return numberOfEstimatedRows;
+}
+
+- (NSUInteger)mutationCount
+{
+	return mutationCount;
+}
+
+/**
+ * @brief Ask the delegate for the real height of a row
+ *
+ * The concurrent height method is preferred when the delegate implements it,
+ * so rows measured on the main thread agree with rows measured in the background.
+ */
+- (CGFloat)_exactRowHeight:(NSInteger)i
+{
+	NSIndexPath *indexPath = [NSIndexPath indexPathForRow:i inSection:sectionIndex];
+	if([_tableView _usesConcurrentRowHeights])
+		return roundf([_tableView.delegate tableView:_tableView concurrentHeightForRowAtIndexPath:indexPath]);
+	return roundf([_tableView.delegate tableView:_tableView heightForRowAtIndexPath:indexPath]);
+}
+
+/**
+ * @brief Ask the delegate for the height of a row
+ *
+ * Only an estimate is requested if the table uses estimated row heights.  The
+ * row offset is not updated.
+ *
+ * @param i the row
+ */
+- (void)_setupRowHeight:(NSInteger)i
+{
+	NSIndexPath *indexPath = [NSIndexPath indexPathForRow:i inSection:sectionIndex];
+	if([_tableView _usesEstimatedRowHeights]) {
+		rowInfo[i].height = roundf([_tableView.delegate tableView:_tableView estimatedHeightForRowAtIndexPath:indexPath]);
+		if(!rowInfo[i].estimated)
+			++numberOfEstimatedRows;
+		rowInfo[i].estimated = YES;
+	} else {
+		rowInfo[i].height = [self _exactRowHeight:i];
+		if(rowInfo[i].estimated)
+			--numberOfEstimatedRows;
+		rowInfo[i].estimated = NO;
+	}
+}
+
 - (void)_setupRowHeights
 {
-	sectionHeight = 0.0;
+	firstRowOffset = 0.0;
+	numberOfEstimatedRows = 0;
+	++mutationCount;
 	
 	TUIView *header;
 	if((header = self.headerView) != nil) {
-		sectionHeight += roundf(header.frame.size.height);
+		firstRowOffset += roundf(header.frame.size.height);
 	}
-    
-	for(int i = 0; i < numberOfRows; ++i) {
-		CGFloat h = roundf([_tableView.delegate tableView:_tableView heightForRowAtIndexPath:[NSIndexPath indexPathForRow:i inSection:sectionIndex]]);
-		rowInfo[i].offset = sectionHeight;
-		rowInfo[i].height = h;
-		sectionHeight += h;
+	
+	if([_tableView _usesConcurrentRowHeights] && ![_tableView _usesEstimatedRowHeights]) {
+		// each block writes the heights of its own rows, so they can share the row info array
+		TUITableViewComputeRowHeightsConcurrently(_tableView, _tableView.delegate, sectionIndex, numberOfRows, &rowInfo[0].height, sizeof(TUITableViewRowInfo), nil);
+		for(int i = 0; i < numberOfRows; ++i) {
+			rowInfo[i].estimated = NO;
+		}
+	} else {
+		for(int i = 0; i < numberOfRows; ++i) {
+			rowInfo[i].estimated = NO;
+			[self _setupRowHeight:i];
+		}
+	}
+	
+	[self _updateRowOffsetsFromRow:0];
+}
+
+/**
+ * @brief Replace the heights of rows which are still estimated
+ *
+ * Used to publish heights that were computed in the background.  Rows which
+ * were resolved in the meantime keep their height.
+ *
+ * @param heights the real height of every row
+ * @return the change in section height
+ */
+- (CGFloat)_setEstimatedRowHeights:(const CGFloat *)heights
+{
+	CGFloat previousHeight = sectionHeight;
+	for(NSUInteger i = 0; i < numberOfRows; ++i) {
+		if(rowInfo[i].estimated) {
+			rowInfo[i].height = heights[i];
+			rowInfo[i].estimated = NO;
+		}
 	}
+	numberOfEstimatedRows = 0;
+	[self _updateRowOffsetsFromRow:0];
 	
+	return sectionHeight - previousHeight;
+}
+
+/**
+ * @brief Recompute row offsets and the section height starting at a row
+ *
+ * Offsets before @p row are left untouched, so only the tail of the section
+ * which was affected by a change is walked.
+ *
+ * @param row the first row whose offset may have changed
+ */
+- (void)_updateRowOffsetsFromRow:(NSInteger)row
+{
+	row = MIN(MAX(row, 0), (NSInteger)numberOfRows);
+	
+	CGFloat offset = (row > 0) ? rowInfo[row - 1].offset + rowInfo[row - 1].height : firstRowOffset;
+	for(NSInteger i = row; i < numberOfRows; ++i) {
+		rowInfo[i].offset = offset;
+		offset += rowInfo[i].height;
+	}
+	sectionHeight = offset;
+}
+
+/**
+ * @brief Patch the row info for rows which were deleted, inserted or reloaded
+ *
+ * Surviving rows keep their heights; only inserted and reloaded rows are
+ * measured, and offsets are recomputed from the first row that changed.
+ *
+ * @param deleted rows to delete, indexed before the update
+ * @param inserted rows to insert, indexed after the update
+ * @param reloaded rows to measure again, indexed after the update
+ */
+- (void)_deleteRowsAtIndexes:(NSIndexSet *)deleted insertRowsAtIndexes:(NSIndexSet *)inserted reloadRowsAtIndexes:(NSIndexSet *)reloaded
+{
+	NSUInteger count = numberOfRows - [deleted count] + [inserted count];
+	TUITableViewRowInfo *info = calloc(MAX(count, 1), sizeof(TUITableViewRowInfo));
+	++mutationCount;
+	
+	for(NSUInteger i = [deleted firstIndex]; i != NSNotFound; i = [deleted indexGreaterThanIndex:i]) {
+		if(rowInfo[i].estimated)
+			--numberOfEstimatedRows;
+	}
+	
+	// copy the surviving rows across in runs, leaving zeroed gaps for inserted rows
+	NSUInteger i = 0, j = 0;
+	NSUInteger nextDeleted = [deleted firstIndex];
+	NSUInteger nextInserted = [inserted firstIndex];
+	while(j < count) {
+		if(j == nextInserted) {
+			nextInserted = [inserted indexGreaterThanIndex:nextInserted];
+			++j;
+		} else if(i == nextDeleted) {
+			nextDeleted = [deleted indexGreaterThanIndex:nextDeleted];
+			++i;
+		} else {
+			NSUInteger run = MIN(MIN(nextInserted - j, nextDeleted - i), count - j);
+			memcpy(&info[j], &rowInfo[i], run * sizeof(TUITableViewRowInfo));
+			i += run;
+			j += run;
+		}
+	}
+	
+	free(rowInfo);
+	rowInfo = info;
+	numberOfRows = count;
+	
+	for(NSUInteger row = [inserted firstIndex]; row != NSNotFound; row = [inserted indexGreaterThanIndex:row]) {
+		[self _setupRowHeight:row];
+	}
+	for(NSUInteger row = [reloaded firstIndex]; row != NSNotFound; row = [reloaded indexGreaterThanIndex:row]) {
+		if(![inserted containsIndex:row])
+			[self _setupRowHeight:row];
+	}
+	
+	NSUInteger first = MIN(MIN([deleted firstIndex], [inserted firstIndex]), [reloaded firstIndex]);
+	if(first != NSNotFound)
+		[self _updateRowOffsetsFromRow:first];
+}
+
+/**
+ * @brief Ask the delegate for the real height of any estimated rows in a range
+ *
+ * @param range the rows to resolve
+ * @return the change in section height
+ */
+- (CGFloat)_resolveEstimatedRowHeightsInRange:(NSRange)range
+{
+	if(numberOfEstimatedRows == 0)
+		return 0.0;
+	
+	CGFloat previousHeight = sectionHeight;
+	NSInteger firstChangedRow = NSNotFound;
+	NSUInteger end = MIN(NSMaxRange(range), numberOfRows);
+	for(NSUInteger i = range.location; i < end; ++i) {
+		if(!rowInfo[i].estimated)
+			continue;
+		
+		CGFloat h = [self _exactRowHeight:i];
+		rowInfo[i].estimated = NO;
+		--numberOfEstimatedRows;
+		if(h != rowInfo[i].height) {
+			rowInfo[i].height = h;
+			if(firstChangedRow == NSNotFound)
+				firstChangedRow = i;
+		}
+	}
+	
+	if(firstChangedRow != NSNotFound)
+		[self _updateRowOffsetsFromRow:firstChangedRow];
+	
+	return sectionHeight - previousHeight;
 }
 
 - (CGFloat)rowHeight:(NSInteger)i
@@ -114,6 +389,30 @@ typedef struct {
 	return sectionOffset + [self sectionRowOffset:i];
 }
 
+/**
+ * @brief Obtain the first row whose bottom edge is at or past the specified offset.
+ *
+ * Row offsets are running sums of the row heights, so both the top and the
+ * bottom edges of the rows are non-decreasing and can be binary searched.
+ *
+ * @param offset offset from the beginning of the section
+ * @return row index, or the number of rows if every row ends before @p offset
+ */
+- (NSInteger)indexOfFirstRowEndingAtSectionOffset:(CGFloat)offset
+{
+	NSInteger low = 0;
+	NSInteger high = numberOfRows;
+	while(low < high) {
+		NSInteger mid = low + (high - low) / 2;
+		if(rowInfo[mid].offset + rowInfo[mid].height < offset) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
 - (CGFloat)sectionHeight
 {
 	return sectionHeight;
@@ -150,12 +449,31 @@ typedef struct {
 
 - (void)_updateSectionInfo;
 - (void)_updateDerepeaterViews;
+- (void)_updateRowsDeletingIndexPaths:(NSArray *)deleted insertingIndexPaths:(NSArray *)inserted reloadingIndexPaths:(NSArray *)reloaded;
+- (void)_enumerateRowsFromTableOffset:(CGFloat)top toTableOffset:(CGFloat)bottom usingBlock:(void (^)(NSInteger section, NSInteger row, CGRect rowRect, BOOL *stop))block;
+- (void)_offsetSectionsFromIndex:(NSInteger)section by:(CGFloat)delta;
+- (void)_computeEstimatedRowHeightsInBackground;
+- (void)_cancelRowHeightMeasurements;
+- (void)_cancelRowHeightMeasurementForSection:(NSInteger)section;
+- (void)_finishRowHeightMeasurement:(TUITableViewRowHeightMeasurement *)measurement heights:(const CGFloat *)heights;
+- (BOOL)_getFirstVisibleRowSection:(NSInteger *)section row:(NSInteger *)row top:(CGFloat *)top;
+- (void)_scrollRowInSection:(NSInteger)section row:(NSInteger)row toTop:(CGFloat)top;
+- (BOOL)_resolveEstimatedRowHeightsInRect:(CGRect)rect;
+- (BOOL)_resolveEstimatedRowHeightsMaintainingVisibleRowsInRect:(CGRect)rect;
+- (BOOL)_resolveEstimatedRowHeightsNearVisibleRect;
+- (NSUInteger)_indexOfVisibleCellForSection:(NSInteger)section row:(NSInteger)row;
+- (void)_insertVisibleCell:(TUITableViewCell *)cell forSection:(NSInteger)section row:(NSInteger)row atIndex:(NSUInteger)index;
+- (void)_removeVisibleCellAtIndex:(NSUInteger)index;
+- (void)_removeAllVisibleCells;
+- (void)_schedulePrefetchingCells;
+- (void)_prefetchCells;
+- (void)_removeAllPrefetchedCells;
 
 // additions for multiple selection
-- (NSMutableArray *)arrayOfIndexesOfSectionsFromIndex:(NSIndexPath*)startIndex
-                                                   to:(NSIndexPath*)endIndex;
-
 - (BOOL)indexPathSelected:(NSIndexPath*)indexPathToCheck;
+- (BOOL)_isRowSelectedInSection:(NSInteger)section row:(NSInteger)row;
+- (NSMutableIndexSet *)_selectedRowIndexesInSection:(NSInteger)section;
+- (void)_addSelectedRowsFromIndexPath:(NSIndexPath *)fromIndexPath toIndexPath:(NSIndexPath *)toIndexPath;
 - (void)checkEventModifiers:(NSEvent *)event;
 - (NSIndexPath *)topIndexPath;
 - (NSIndexPath *)bottomIndexPath;
@@ -176,6 +494,18 @@ typedef struct {
 @implementation TUITableView {
     TUITableViewDropDestination _dropDestination;
     NSIndexPath *_dropTargetIndexPath;
+	
+	// visible cells in row order, and the row each one is displaying
+	NSMutableArray *_visibleCells;
+	TUITableViewRowPosition *_visibleRows;
+	NSUInteger _visibleRowsCapacity;
+	
+	// hidden cells made ahead of time for rows about to scroll into view, by index path
+	NSMutableDictionary *_prefetchedCells;
+	CGFloat _prefetchDistance;
+	CGFloat _lastVisibleRectOriginY;
+	
+	NSMutableDictionary *_maximumNumberOfReusableCells;
 }
 
 #pragma mark - Pasteboard Dragging Destination
@@ -349,13 +679,20 @@ typedef struct {
 		_style = style;
 		_reusableTableCells = [[NSMutableDictionary alloc] init];
 		_visibleSectionHeaders = [[NSMutableIndexSet alloc] init];
-		_visibleItems = [[NSMutableDictionary alloc] init];
-        _arrayOfSelectedIndexes = [[NSMutableArray alloc] init];
+		_visibleCells = [[NSMutableArray alloc] init];
+        _selectedRowIndexes = [[NSMutableArray alloc] init];
 		_tableFlags.animateSelectionChanges = 1;
+		// subclasses may display rows outside of the visible rect, which takes the slower path through _layoutCells:
+		_tableFlags.indexPathsForRowsInRectOverridden = ([self methodForSelector:@selector(indexPathsForRowsInRect:)] != [TUITableView instanceMethodForSelector:@selector(indexPathsForRowsInRect:)]);
 	}
 	return self;
 }
 
+- (void)dealloc
+{
+	free(_visibleRows);
+}
+
 - (id)initWithFrame:(CGRect)frame
 {
 	return [self initWithFrame:frame style:TUITableViewStylePlain];
@@ -370,6 +707,8 @@ typedef struct {
 - (void)setDelegate:(id<TUITableViewDelegate>)d
 {
 	_tableFlags.delegateTableViewWillDisplayCellForRowAtIndexPath = [d respondsToSelector:@selector(tableView:willDisplayCell:forRowAtIndexPath:)];
+	_tableFlags.delegateTableViewEstimatedHeightForRowAtIndexPath = [d respondsToSelector:@selector(tableView:estimatedHeightForRowAtIndexPath:)];
+	_tableFlags.delegateTableViewConcurrentHeightForRowAtIndexPath = [d respondsToSelector:@selector(tableView:concurrentHeightForRowAtIndexPath:)];
 	[super setDelegate:d]; // must call super
 }
 
@@ -483,6 +822,280 @@ typedef struct {
 	_contentHeight = (offset - self.contentInset.bottom) + self.footerView.bounds.size.height;
 	_sectionInfo = sections;
 	
+	if(_tableFlags.delegateTableViewConcurrentHeightForRowAtIndexPath && _tableFlags.delegateTableViewEstimatedHeightForRowAtIndexPath) {
+		[self _computeEstimatedRowHeightsInBackground];
+	}
+}
+
+- (BOOL)_usesEstimatedRowHeights
+{
+	return _tableFlags.delegateTableViewEstimatedHeightForRowAtIndexPath;
+}
+
+- (BOOL)_usesConcurrentRowHeights
+{
+	return _tableFlags.delegateTableViewConcurrentHeightForRowAtIndexPath;
+}
+
+/**
+ * @brief Compute the real heights of estimated sections in the background
+ *
+ * Each section is measured on a concurrent queue and its heights are published
+ * on the main thread in one step once the whole section is done.  A section
+ * rebuilt with the same number of rows at the same width, as when the table
+ * is only resized vertically, keeps the measurement already running for it.
+ * Any other measurement of the section is cancelled.  Results for sections
+ * which had rows inserted or deleted in the meantime are dropped; those rows
+ * are resolved as they come into view instead.
+ */
+- (void)_computeEstimatedRowHeightsInBackground
+{
+	if(_rowHeightMeasurements == nil)
+		_rowHeightMeasurements = [[NSMutableDictionary alloc] init];
+	
+	// sections which are gone
+	for(NSNumber *key in [_rowHeightMeasurements allKeys]) {
+		if([key integerValue] >= (NSInteger)[_sectionInfo count])
+			[self _cancelRowHeightMeasurementForSection:[key integerValue]];
+	}
+	
+	id<TUITableViewDelegate> delegate = self.delegate;
+	CGFloat width = self.bounds.size.width;
+	for(TUITableViewSection *section in _sectionInfo) {
+		NSUInteger numberOfRows = [section numberOfRows];
+		NSInteger sectionIndex = section.sectionIndex;
+		if([section numberOfEstimatedRows] == 0) {
+			[self _cancelRowHeightMeasurementForSection:sectionIndex];
+			continue;
+		}
+		
+		TUITableViewRowHeightMeasurement *measurement = [_rowHeightMeasurements objectForKey:@(sectionIndex)];
+		if(measurement != nil && measurement.numberOfRows == numberOfRows && measurement.width == width) {
+			measurement.section = section;
+			measurement.mutationCount = [section mutationCount];
+			continue;
+		}
+		[self _cancelRowHeightMeasurementForSection:sectionIndex];
+		
+		measurement = [[TUITableViewRowHeightMeasurement alloc] init];
+		measurement.numberOfRows = numberOfRows;
+		measurement.width = width;
+		measurement.section = section;
+		measurement.mutationCount = [section mutationCount];
+		[_rowHeightMeasurements setObject:measurement forKey:@(sectionIndex)];
+		
+		dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+			CGFloat *heights = NULL;
+			if(!measurement.cancelled) {
+				heights = malloc(numberOfRows * sizeof(CGFloat));
+				TUITableViewComputeRowHeightsConcurrently(self, delegate, sectionIndex, numberOfRows, heights, sizeof(CGFloat), measurement);
+			}
+			dispatch_async(dispatch_get_main_queue(), ^{
+				[self _finishRowHeightMeasurement:measurement heights:heights];
+				free(heights);
+			});
+		});
+	}
+}
+
+- (void)_cancelRowHeightMeasurementForSection:(NSInteger)section
+{
+	TUITableViewRowHeightMeasurement *measurement = [_rowHeightMeasurements objectForKey:@(section)];
+	measurement.cancelled = YES;
+	measurement.section = nil;
+	[_rowHeightMeasurements removeObjectForKey:@(section)];
+}
+
+- (void)_cancelRowHeightMeasurements
+{
+	for(NSNumber *key in [_rowHeightMeasurements allKeys])
+		[self _cancelRowHeightMeasurementForSection:[key integerValue]];
+}
+
+- (void)_finishRowHeightMeasurement:(TUITableViewRowHeightMeasurement *)measurement heights:(const CGFloat *)heights
+{
+	TUITableViewSection *section = measurement.section;
+	NSNumber *key = @(section.sectionIndex);
+	if(section == nil || [_rowHeightMeasurements objectForKey:key] != measurement)
+		return;
+	[_rowHeightMeasurements removeObjectForKey:key];
+	measurement.section = nil;
+	
+	if(!measurement.cancelled && heights != NULL)
+		[self _publishRowHeights:heights forSection:section mutationCount:measurement.mutationCount];
+}
+
+- (void)_publishRowHeights:(const CGFloat *)heights forSection:(TUITableViewSection *)section mutationCount:(NSUInteger)mutationCount
+{
+	NSInteger s = [_sectionInfo indexOfObjectIdenticalTo:section];
+	if(s == NSNotFound || [section mutationCount] != mutationCount || [section numberOfEstimatedRows] == 0)
+		return;
+	
+	NSInteger anchorSection, anchorRow;
+	CGFloat anchorTop;
+	BOOL anchored = [self _getFirstVisibleRowSection:&anchorSection row:&anchorRow top:&anchorTop];
+	
+	[self _offsetSectionsFromIndex:s + 1 by:[section _setEstimatedRowHeights:heights]];
+	self.contentSize = CGSizeMake(self.bounds.size.width, _contentHeight);
+	if(anchored)
+		[self _scrollRowInSection:anchorSection row:anchorRow toTop:anchorTop];
+	
+	// laid out with everything else which changed this run loop turn
+	_tableFlags.visibleCellsNeedRelayout = 1;
+	[self setNeedsLayout];
+}
+
+/**
+ * @brief Move sections and the end of the content by a change in height
+ *
+ * @param section the first section to move
+ * @param delta the change in height of the content before @p section
+ */
+- (void)_offsetSectionsFromIndex:(NSInteger)section by:(CGFloat)delta
+{
+	if(delta == 0.0)
+		return;
+	
+	for(NSInteger i = section; i < [_sectionInfo count]; i++) {
+		TUITableViewSection *s = [_sectionInfo objectAtIndex:i];
+		s.sectionOffset += delta;
+	}
+	_contentHeight += delta;
+}
+
+/**
+ * @brief Find the first row in the visible rect and the position of its top edge
+ *
+ * Used with #_scrollRowInSection:row:toTop: to keep the rows the user is looking
+ * at in place when the heights around them change.
+ *
+ * @return NO if there are no visible rows
+ */
+- (BOOL)_getFirstVisibleRowSection:(NSInteger *)section row:(NSInteger *)row top:(CGFloat *)top
+{
+	CGRect visible = [self visibleRect];
+	__block NSInteger firstSection = -1, firstRow = 0;
+	[self _enumerateRowsFromTableOffset:_contentHeight - CGRectGetMaxY(visible) toTableOffset:_contentHeight - CGRectGetMinY(visible) usingBlock:^(NSInteger s, NSInteger r, CGRect rowRect, BOOL *stop) {
+		if(CGRectIntersectsRect(rowRect, visible)) {
+			firstSection = s;
+			firstRow = r;
+			*stop = YES;
+		}
+	}];
+	
+	if(firstSection < 0)
+		return NO;
+	
+	*section = firstSection;
+	*row = firstRow;
+	*top = _contentHeight - [[_sectionInfo objectAtIndex:firstSection] tableRowOffset:firstRow];
+	return YES;
+}
+
+/**
+ * @brief Scroll so the top edge of a row is at the specified position in the content
+ *
+ * @param section the section of the row
+ * @param row the row
+ * @param top the y-coordinate the top edge of the row had before the content changed
+ */
+- (void)_scrollRowInSection:(NSInteger)section row:(NSInteger)row toTop:(CGFloat)top
+{
+	CGPoint offset = _unroundedContentOffset;
+	offset.y -= (_contentHeight - [[_sectionInfo objectAtIndex:section] tableRowOffset:row]) - top;
+	self.contentOffset = offset;
+}
+
+/**
+ * @brief Replace estimated row heights with real ones for the rows in @p rect
+ *
+ * Section offsets and the content height are corrected for the difference.
+ * The content size and offset are left for the caller to update.
+ *
+ * @param rect the rect, in content coordinates, to resolve
+ * @return YES if any estimated row was resolved
+ */
+- (BOOL)_resolveEstimatedRowHeightsInRect:(CGRect)rect
+{
+	__block NSInteger firstSection = -1, firstRow = 0;
+	__block NSInteger lastSection = -1, lastRow = 0;
+	[self _enumerateRowsFromTableOffset:_contentHeight - CGRectGetMaxY(rect) toTableOffset:_contentHeight - CGRectGetMinY(rect) usingBlock:^(NSInteger section, NSInteger row, CGRect rowRect, BOOL *stop) {
+		if(firstSection < 0) {
+			firstSection = section;
+			firstRow = row;
+		}
+		lastSection = section;
+		lastRow = row;
+	}];
+	
+	if(firstSection < 0)
+		return NO;
+	
+	BOOL resolved = NO;
+	for(NSInteger i = firstSection; i <= lastSection; i++) {
+		TUITableViewSection *section = [_sectionInfo objectAtIndex:i];
+		NSUInteger estimatedRows = [section numberOfEstimatedRows];
+		if(estimatedRows == 0)
+			continue;
+		
+		NSInteger start = (i == firstSection) ? firstRow : 0;
+		NSInteger end = (i == lastSection) ? lastRow + 1 : [section numberOfRows];
+		CGFloat delta = [section _resolveEstimatedRowHeightsInRange:NSMakeRange(start, end - start)];
+		[self _offsetSectionsFromIndex:i + 1 by:delta];
+		resolved = resolved || ([section numberOfEstimatedRows] != estimatedRows);
+	}
+	
+	return resolved;
+}
+
+/**
+ * @brief Resolve estimated row heights in @p rect without moving the visible rows
+ *
+ * The top of the first visible row is kept at the same distance from the top of
+ * the visible rect, so rows which change height above or below it don't shift the
+ * content under the user.  The content size is updated to the corrected height.
+ *
+ * @param rect the rect, in content coordinates, to resolve
+ * @return YES if any estimated row was resolved
+ */
+- (BOOL)_resolveEstimatedRowHeightsMaintainingVisibleRowsInRect:(CGRect)rect
+{
+	if(!_tableFlags.delegateTableViewEstimatedHeightForRowAtIndexPath)
+		return NO;
+	
+	NSInteger anchorSection, anchorRow;
+	CGFloat anchorTop;
+	BOOL anchored = [self _getFirstVisibleRowSection:&anchorSection row:&anchorRow top:&anchorTop];
+	
+	if(![self _resolveEstimatedRowHeightsInRect:rect])
+		return NO;
+	
+	self.contentSize = CGSizeMake(self.bounds.size.width, _contentHeight);
+	if(anchored)
+		[self _scrollRowInSection:anchorSection row:anchorRow toTop:anchorTop];
+	
+	return YES;
+}
+
+/**
+ * @brief Resolve estimated row heights in and around the visible rect
+ *
+ * Resolving can pull rows which were estimated into view, so this repeats until
+ * every row within the margin has its real height.
+ *
+ * @return YES if any estimated row was resolved
+ */
+- (BOOL)_resolveEstimatedRowHeightsNearVisibleRect
+{
+	BOOL resolved = NO;
+	for(;;) {
+		CGRect visible = [self visibleRect];
+		CGFloat margin = roundf(visible.size.height * ESTIMATED_ROW_HEIGHT_RESOLVE_MARGIN);
+		if(![self _resolveEstimatedRowHeightsMaintainingVisibleRowsInRect:CGRectInset(visible, 0, -margin)])
+			break;
+		resolved = YES;
+	}
+	return resolved;
 }
 
 - (void)_enqueueReusableCell:(TUITableViewCell *)cell
@@ -497,9 +1110,48 @@ typedef struct {
 		array = [[NSMutableArray alloc] init];
 		[_reusableTableCells setObject:array forKey:identifier];
 	}
+	
+	NSNumber *maximum = [_maximumNumberOfReusableCells objectForKey:identifier];
+	if(maximum != nil && [array count] >= [maximum unsignedIntegerValue])
+		return; // the pool is full, let the cell go
+	
 	[array addObject:cell];
 }
 
+- (void)setMaximumNumberOfReusableCells:(NSUInteger)count withIdentifier:(NSString *)identifier
+{
+	if(!identifier)
+		return;
+	
+	if(_maximumNumberOfReusableCells == nil)
+		_maximumNumberOfReusableCells = [[NSMutableDictionary alloc] init];
+	
+	if(count == NSUIntegerMax) {
+		[_maximumNumberOfReusableCells removeObjectForKey:identifier];
+	} else {
+		[_maximumNumberOfReusableCells setObject:@(count) forKey:identifier];
+		NSMutableArray *array = [_reusableTableCells objectForKey:identifier];
+		if([array count] > count)
+			[array removeObjectsInRange:NSMakeRange(count, [array count] - count)];
+	}
+}
+
+- (void)prepareReusableCellsWithIdentifier:(NSString *)identifier count:(NSUInteger)count usingBlock:(TUITableViewCell *(^)(void))block
+{
+	NSParameterAssert(block != nil);
+	if(!identifier)
+		return;
+	
+	NSUInteger numberOfCells = [[_reusableTableCells objectForKey:identifier] count];
+	for(; numberOfCells < count; numberOfCells++) {
+		TUITableViewCell *cell = block();
+		NSAssert([cell.reuseIdentifier isEqualToString:identifier], @"Cell %@ doesn't have the reuse identifier %@", cell, identifier);
+		[self _enqueueReusableCell:cell];
+		if([[_reusableTableCells objectForKey:identifier] count] <= numberOfCells)
+			break; // the pool is capped below count
+	}
+}
+
 - (TUITableViewCell *)dequeueReusableCellWithIdentifier:(NSString *)identifier
 {
 	if(!identifier)
@@ -535,12 +1187,13 @@ typedef struct {
 
 - (TUITableViewCell *)cellForRowAtIndexPath:(NSIndexPath *)indexPath // returns nil if cell is not visible or index path is out of range
 {
-	return [_visibleItems objectForKey:indexPath];
+	NSUInteger index = [self _indexOfVisibleCellForSection:indexPath.section row:indexPath.row];
+	return (index != NSNotFound) ? [_visibleCells objectAtIndex:index] : nil;
 }
 
 - (NSArray *)visibleCells
 {
-	return [_visibleItems allValues];
+	return [_visibleCells copy];
 }
 
 __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, void *ctx)
@@ -560,21 +1213,85 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
 	}];
 }
 
-#define INDEX_PATHS_FOR_VISIBLE_ROWS [_visibleItems allKeys]
-
 - (NSArray *)indexPathsForVisibleRows
 {
-	return INDEX_PATHS_FOR_VISIBLE_ROWS;
+	NSUInteger count = [_visibleCells count];
+	NSMutableArray *indexPaths = [NSMutableArray arrayWithCapacity:count];
+	for(NSUInteger i = 0; i < count; i++) {
+		[indexPaths addObject:[NSIndexPath indexPathForRow:_visibleRows[i].row inSection:_visibleRows[i].section]];
+	}
+	return indexPaths;
 }
 
 - (NSIndexPath *)indexPathForCell:(TUITableViewCell *)c
 {
-	for(NSIndexPath *i in _visibleItems) {
-		TUITableViewCell *cell = [_visibleItems objectForKey:i];
-		if(cell == c)
-			return i;
+	NSUInteger index = [_visibleCells indexOfObjectIdenticalTo:c];
+	if(index == NSNotFound)
+		return nil;
+	return [NSIndexPath indexPathForRow:_visibleRows[index].row inSection:_visibleRows[index].section];
+}
+
+/**
+ * @brief Obtain the position of the visible cell for a row
+ *
+ * Visible cells are kept in row order, so this is a binary search.
+ *
+ * @return index of the cell in the visible cells, or NSNotFound if the row has no visible cell
+ */
+- (NSUInteger)_indexOfVisibleCellForSection:(NSInteger)section row:(NSInteger)row
+{
+	TUITableViewRowPosition position = { section, row };
+	NSUInteger low = 0;
+	NSUInteger high = [_visibleCells count];
+	while(low < high) {
+		NSUInteger mid = low + (high - low) / 2;
+		switch(TUITableViewCompareRowPositions(_visibleRows[mid], position)) {
+			case NSOrderedAscending:
+				low = mid + 1;
+				break;
+			case NSOrderedDescending:
+				high = mid;
+				break;
+			case NSOrderedSame:
+				return mid;
+		}
+	}
+	return NSNotFound;
+}
+
+- (void)_insertVisibleCell:(TUITableViewCell *)cell forSection:(NSInteger)section row:(NSInteger)row atIndex:(NSUInteger)index
+{
+	NSUInteger count = [_visibleCells count];
+	if(count == _visibleRowsCapacity) {
+		_visibleRowsCapacity = MAX(32, _visibleRowsCapacity * 2);
+		_visibleRows = realloc(_visibleRows, _visibleRowsCapacity * sizeof(TUITableViewRowPosition));
 	}
-	return nil;
+	memmove(_visibleRows + index + 1, _visibleRows + index, (count - index) * sizeof(TUITableViewRowPosition));
+	_visibleRows[index] = (TUITableViewRowPosition){ section, row };
+	[_visibleCells insertObject:cell atIndex:index];
+}
+
+/**
+ * @brief Recycle a visible cell and remove it from the visible cells
+ */
+- (void)_removeVisibleCellAtIndex:(NSUInteger)index
+{
+	TUITableViewCell *cell = [_visibleCells objectAtIndex:index];
+	[self _enqueueReusableCell:cell];
+	[cell removeFromSuperview];
+	
+	NSUInteger count = [_visibleCells count];
+	memmove(_visibleRows + index, _visibleRows + index + 1, (count - index - 1) * sizeof(TUITableViewRowPosition));
+	[_visibleCells removeObjectAtIndex:index];
+}
+
+- (void)_removeAllVisibleCells
+{
+	for(TUITableViewCell *cell in _visibleCells) {
+		[self _enqueueReusableCell:cell];
+		[cell removeFromSuperview];
+	}
+	[_visibleCells removeAllObjects];
 }
 
 /**
@@ -615,23 +1332,67 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
 	return indexes;
 }
 
+/**
+ * @brief Enumerate the rows which lie between two offsets from the top of the table
+ *
+ * Offsets are measured downward from the top of the content, the same way row and
+ * section offsets are stored.  The first candidate row is found by binary searching
+ * the sections and then the row offsets of the first matching section, after which
+ * rows are walked in order until one begins past @p bottom.  Enumeration is
+ * conservative; the block is expected to test the row rect it is given.
+ *
+ * @param top offset from the top of the table at which to begin enumerating
+ * @param bottom offset from the top of the table at which to stop enumerating
+ * @param block the block to enumerate with
+ */
+- (void)_enumerateRowsFromTableOffset:(CGFloat)top toTableOffset:(CGFloat)bottom usingBlock:(void (^)(NSInteger section, NSInteger row, CGRect rowRect, BOOL *stop))block
+{
+	NSInteger numberOfSections = [_sectionInfo count];
+	NSInteger low = 0;
+	NSInteger high = numberOfSections;
+	while(low < high) {
+		NSInteger mid = low + (high - low) / 2;
+		TUITableViewSection *section = [_sectionInfo objectAtIndex:mid];
+		if(section.sectionOffset + [section sectionHeight] < top) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	
+	CGFloat width = self.bounds.size.width;
+	for(NSInteger s = low; s < numberOfSections; s++) {
+		TUITableViewSection *section = [_sectionInfo objectAtIndex:s];
+		CGFloat sectionOffset = section.sectionOffset;
+		if(sectionOffset > bottom)
+			return;
+		
+		NSInteger numberOfRows = [section numberOfRows];
+		NSInteger row = (s == low) ? [section indexOfFirstRowEndingAtSectionOffset:top - sectionOffset] : 0;
+		for(; row < numberOfRows; row++) {
+			CGFloat offset = sectionOffset + [section sectionRowOffset:row];
+			if(offset > bottom)
+				return;
+			
+			CGFloat height = [section rowHeight:row];
+			BOOL stop = NO;
+			block(s, row, CGRectMake(0, _contentHeight - offset - height, width, height), &stop);
+			if(stop)
+				return;
+		}
+	}
+}
+
 - (NSArray *)indexPathsForRowsInRect:(CGRect)rect
 {
 	NSMutableArray *indexPaths = [NSMutableArray arrayWithCapacity:50];
-	NSInteger sectionIndex = 0;
-	for(TUITableViewSection *section in _sectionInfo) {
-		NSInteger numberOfRows = [section numberOfRows];
-		for(NSInteger row = 0; row < numberOfRows; ++row) {
-			NSIndexPath *indexPath = [NSIndexPath indexPathForRow:row inSection:sectionIndex];
-			CGRect cellRect = [self rectForRowAtIndexPath:indexPath];
-			if(CGRectIntersectsRect(cellRect, rect)) {
-				[indexPaths addObject:indexPath];
-			} else {
-				// not visible
-			}
+	CGFloat top = _contentHeight - CGRectGetMaxY(rect);
+	CGFloat bottom = _contentHeight - CGRectGetMinY(rect);
+	[self _enumerateRowsFromTableOffset:top toTableOffset:bottom usingBlock:^(NSInteger section, NSInteger row, CGRect rowRect, BOOL *stop) {
+		if(CGRectIntersectsRect(rowRect, rect)) {
+			[indexPaths addObject:[NSIndexPath indexPathForRow:row inSection:section]];
 		}
-		++sectionIndex;
-	}
+	}];
 	return indexPaths;
 }
 
@@ -646,21 +1407,19 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
  */
 - (NSIndexPath *)indexPathForRowAtPoint:(CGPoint)point {
     
-	NSInteger sectionIndex = 0;
+	__block NSIndexPath *indexPath = nil;
     
     point.y -= self.contentOffset.y;
-    for(TUITableViewSection *section in _sectionInfo){
-        for(NSInteger row = 0; row < [section numberOfRows]; row++){
-            NSIndexPath *indexPath = [NSIndexPath indexPathForRow:row inSection:sectionIndex];
-            CGRect cellRect = [self rectForRowAtIndexPath:indexPath];
-            if(CGRectContainsPoint(cellRect, point)){
-                return indexPath;
-            }
-        }
-		++sectionIndex;
-    }
+	// search a point either side of the offset so rounding can't skip a row boundary
+	CGFloat offset = _contentHeight - point.y;
+	[self _enumerateRowsFromTableOffset:offset - 1 toTableOffset:offset + 1 usingBlock:^(NSInteger section, NSInteger row, CGRect rowRect, BOOL *stop) {
+		if(CGRectContainsPoint(rowRect, point)) {
+			indexPath = [NSIndexPath indexPathForRow:row inSection:section];
+			*stop = YES;
+		}
+	}];
 	
-	return nil;
+	return indexPath;
 }
 
 /**
@@ -674,19 +1433,17 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
  */
 - (NSIndexPath *)indexPathForRowAtVerticalOffset:(CGFloat)offset {
     
-	NSInteger sectionIndex = 0;
-    for(TUITableViewSection *section in _sectionInfo){
-        for(NSInteger row = 0; row < [section numberOfRows]; row++){
-            NSIndexPath *indexPath = [NSIndexPath indexPathForRow:row inSection:sectionIndex];
-            CGRect cellRect = [self rectForRowAtIndexPath:indexPath];
-            if(offset >= cellRect.origin.y && offset <= (cellRect.origin.y + cellRect.size.height)){
-                return indexPath;
-            }
-        }
-		++sectionIndex;
-    }
+	__block NSIndexPath *indexPath = nil;
 	
-	return nil;
+	CGFloat tableOffset = _contentHeight - offset;
+	[self _enumerateRowsFromTableOffset:tableOffset - 1 toTableOffset:tableOffset + 1 usingBlock:^(NSInteger section, NSInteger row, CGRect rowRect, BOOL *stop) {
+		if(offset >= rowRect.origin.y && offset <= (rowRect.origin.y + rowRect.size.height)) {
+			indexPath = [NSIndexPath indexPathForRow:row inSection:section];
+			*stop = YES;
+		}
+	}];
+	
+	return indexPath;
 }
 
 /**
@@ -796,11 +1553,7 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
 
 - (NSIndexPath *)_topVisibleIndexPath
 {
-	NSIndexPath *topVisibleIndex = nil;
-	NSArray *v = [INDEX_PATHS_FOR_VISIBLE_ROWS sortedArrayUsingSelector:@selector(compare:)];
-	if([v count])
-		topVisibleIndex = [v objectAtIndex:0];
-	return topVisibleIndex;
+	return [self indexPathForFirstVisibleRow];
 }
 
 - (void)setFrame:(CGRect)f
@@ -864,9 +1617,8 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
 		} else {
 			if(_tableFlags.forceSaveScrollPosition || resizingOffset) {
 				_tableFlags.forceSaveScrollPosition = 0;
-				NSArray *a = [INDEX_PATHS_FOR_VISIBLE_ROWS sortedArrayUsingSelector:@selector(compare:)];
-				if([a count]) {
-					savedIndexPath = [a objectAtIndex:0];
+				savedIndexPath = [self indexPathForFirstVisibleRow];
+				if(savedIndexPath) {
 					CGRect v = [self visibleRect];
 					CGRect r = [self rectForRowAtIndexPath:savedIndexPath];
 					relativeOffset = ((v.origin.y + v.size.height) - (r.origin.y + r.size.height));
@@ -985,84 +1737,154 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
 	
 }
 
-- (void)_layoutCells:(BOOL)visibleCellsNeedRelayout
+- (TUITableViewCell *)_displayCellForRowAtIndexPath:(NSIndexPath *)indexPath frame:(CGRect)frame
 {
-    
-	if(visibleCellsNeedRelayout) {
-		// update remaining visible cells if needed
-		for(NSIndexPath *i in _visibleItems) {
-			TUITableViewCell *cell = [_visibleItems objectForKey:i];
-			cell.frame = [self rectForRowAtIndexPath:i];
+	TUITableViewCell *cell = [_prefetchedCells objectForKey:indexPath];
+	if(cell != nil) {
+		// already configured, laid out and drawn, and in place as a hidden subview
+		[_prefetchedCells removeObjectForKey:indexPath];
+		cell.hidden = NO;
+		if(!CGRectEqualToRect(cell.frame, frame)) {
+			cell.frame = frame;
+			[cell setNeedsLayout];
+		}
+	} else {
+		cell = [_dataSource tableView:self cellForRowAtIndexPath:indexPath];
+		cell.frame = frame;
+		[cell setNeedsLayout];
+		[cell prepareForDisplay];
+	}
+	[self.nsView invalidateHoverForView:cell];
+	cell.layer.zPosition = 0;
+	
+	if([self _isRowSelectedInSection:indexPath.section row:indexPath.row]) {
+		[cell setSelected:YES animated:NO];
+	} else {
+		[cell setSelected:NO animated:NO];
+	}
+	
+	if(_tableFlags.delegateTableViewWillDisplayCellForRowAtIndexPath) {
+		[_delegate tableView:self willDisplayCell:cell forRowAtIndexPath:indexPath];
+	}
+	
+	return cell;
+}
+
+/**
+ * @brief Make sure the visible cell at @p index displays a row
+ *
+ * Cells for rows before the given row are recycled, and a cell is added for
+ * the row if it doesn't have one yet.
+ *
+ * @return the index following the cell for the row
+ */
+- (NSUInteger)_layoutCellForSection:(NSInteger)section row:(NSInteger)row frame:(CGRect)frame atIndex:(NSUInteger)index needsRelayout:(BOOL)visibleCellsNeedRelayout
+{
+	TUITableViewRowPosition position = { section, row };
+	while(index < [_visibleCells count] && TUITableViewCompareRowPositions(_visibleRows[index], position) == NSOrderedAscending) {
+		[self _removeVisibleCellAtIndex:index];
+	}
+	
+	if(index < [_visibleCells count] && TUITableViewCompareRowPositions(_visibleRows[index], position) == NSOrderedSame) {
+		if(visibleCellsNeedRelayout) {
+			TUITableViewCell *cell = [_visibleCells objectAtIndex:index];
+			cell.frame = frame;
 			cell.layer.zPosition = 0;
 			[cell setNeedsLayout];
 		}
+		return index + 1;
+	}
+	
+	NSIndexPath *indexPath = [NSIndexPath indexPathForRow:row inSection:section];
+	TUITableViewCell *cell = [self _displayCellForRowAtIndexPath:indexPath frame:frame];
+	[self _insertVisibleCell:cell forSection:section row:row atIndex:index];
+	if(cell.superview != self)
+		[self addSubview:cell];
+	
+	if([_indexPathShouldBeFirstResponder isEqual:indexPath]) {
+		// only make cells first responder if they accept it
+		if([cell acceptsFirstResponder]){
+			[self.nsWindow makeFirstResponderIfNotAlreadyInResponderChain:cell withFutureRequestToken:_futureMakeFirstResponderToken];
+		}
+		_indexPathShouldBeFirstResponder = nil;
 	}
 	
+	return index + 1;
+}
+
+- (void)_layoutCells:(BOOL)visibleCellsNeedRelayout
+{
 	CGRect visible = [self visibleRect];
 	
+	// Visible cells are kept in row order, so they are reconciled with the rows in the
+	// visible rect by walking both in step. While scrolling, cells only leave and enter
+	// at the ends, and nothing but the index paths handed to the data source is allocated.
+	//
 	// Example:
 	// old:            0 1 2 3 4 5 6 7
 	// new:                2 3 4 5 6 7 8 9
 	// to remove:      0 1
 	// to add:                         8 9
 	
-	NSArray *oldVisibleIndexPaths = INDEX_PATHS_FOR_VISIBLE_ROWS;
-	NSArray *newVisibleIndexPaths = [self indexPathsForRowsInRect:visible];
-	
-	NSMutableArray *indexPathsToRemove = [oldVisibleIndexPaths mutableCopy];
-	[indexPathsToRemove removeObjectsInArray:newVisibleIndexPaths];
+	NSArray *indexPaths = nil;
+	__block TUITableViewRowPosition first = { NSIntegerMax, NSIntegerMax };
+	__block TUITableViewRowPosition last = { NSIntegerMin, NSIntegerMin };
+	CGFloat top = _contentHeight - CGRectGetMaxY(visible);
+	CGFloat bottom = _contentHeight - CGRectGetMinY(visible);
 	
-	NSMutableArray *indexPathsToAdd = [newVisibleIndexPaths mutableCopy];
-	[indexPathsToAdd removeObjectsInArray:oldVisibleIndexPaths];
+	if(_tableFlags.indexPathsForRowsInRectOverridden) {
+		indexPaths = [[self indexPathsForRowsInRect:visible] sortedArrayUsingSelector:@selector(compare:)];
+		if([indexPaths count]) {
+			NSIndexPath *firstIndexPath = [indexPaths objectAtIndex:0];
+			NSIndexPath *lastIndexPath = [indexPaths lastObject];
+			first = (TUITableViewRowPosition){ firstIndexPath.section, firstIndexPath.row };
+			last = (TUITableViewRowPosition){ lastIndexPath.section, lastIndexPath.row };
+		}
+	} else {
+		[self _enumerateRowsFromTableOffset:top toTableOffset:bottom usingBlock:^(NSInteger section, NSInteger row, CGRect rowRect, BOOL *stop) {
+			if(CGRectIntersectsRect(rowRect, visible)) {
+				if(first.section == NSIntegerMax)
+					first = (TUITableViewRowPosition){ section, row };
+				last = (TUITableViewRowPosition){ section, row };
+			}
+		}];
+	}
 	
-	// remove offscreen cells
-	for(NSIndexPath *i in indexPathsToRemove) {
-		TUITableViewCell *cell = [self cellForRowAtIndexPath:i];
-		// don't reuse the dragged cell
-        [self _enqueueReusableCell:cell];
-        [cell removeFromSuperview];
-        [_visibleItems removeObjectForKey:i];
+	// recycle cells which went offscreen at either end before any are dequeued for new rows
+	while([_visibleCells count] && TUITableViewCompareRowPositions(_visibleRows[0], first) == NSOrderedAscending) {
+		[self _removeVisibleCellAtIndex:0];
+	}
+	while([_visibleCells count] && TUITableViewCompareRowPositions(_visibleRows[[_visibleCells count] - 1], last) == NSOrderedDescending) {
+		[self _removeVisibleCellAtIndex:[_visibleCells count] - 1];
 	}
 	
-	// add new cells
-	for(NSIndexPath *i in indexPathsToAdd) {
-		if([_visibleItems objectForKey:i]) {
-			NSLog(@"!!! Warning: already have a cell in place for index path %@\n\n\n", i);
-		} else {
-			TUITableViewCell *cell = [_dataSource tableView:self cellForRowAtIndexPath:i];
-			[self.nsView invalidateHoverForView:cell];
-			
-			cell.frame = [self rectForRowAtIndexPath:i];
-			cell.layer.zPosition = 0;
-			
-			[cell setNeedsLayout];
-			[cell prepareForDisplay];
-			
-            if([self indexPathSelected:i]) {
-                [cell setSelected:YES animated:NO];
-            } else {
-                [cell setSelected:NO animated:NO];
-            }
-			
-			if(_tableFlags.delegateTableViewWillDisplayCellForRowAtIndexPath) {
-				[_delegate tableView:self willDisplayCell:cell forRowAtIndexPath:i];
-			}
-			
-            [_visibleItems setObject:cell forKey:i];
-            
-			[self addSubview:cell];
-			
-			if([_indexPathShouldBeFirstResponder isEqual:i]) {
-                // only make cells first responder if they accept it
-                if([cell acceptsFirstResponder]){
-                    [self.nsWindow makeFirstResponderIfNotAlreadyInResponderChain:cell withFutureRequestToken:_futureMakeFirstResponderToken];
-                }
-				_indexPathShouldBeFirstResponder = nil;
+	__block NSUInteger index = 0;
+	if(indexPaths != nil) {
+		for(NSIndexPath *indexPath in indexPaths) {
+			index = [self _layoutCellForSection:indexPath.section row:indexPath.row frame:[self rectForRowAtIndexPath:indexPath] atIndex:index needsRelayout:visibleCellsNeedRelayout];
+		}
+	} else if(first.section != NSIntegerMax) {
+		[self _enumerateRowsFromTableOffset:top toTableOffset:bottom usingBlock:^(NSInteger section, NSInteger row, CGRect rowRect, BOOL *stop) {
+			if(CGRectIntersectsRect(rowRect, visible)) {
+				index = [self _layoutCellForSection:section row:row frame:rowRect atIndex:index needsRelayout:visibleCellsNeedRelayout];
 			}
-			
+		}];
+	}
+	
+	// anything left over is for rows which are no longer visible
+	while([_visibleCells count] > index) {
+		[self _removeVisibleCellAtIndex:[_visibleCells count] - 1];
+	}
+	
+	if(_prefetchDistance > 0.0) {
+		if(visible.origin.y != _lastVisibleRectOriginY) {
+			// the visible rect moves down the content as later rows scroll into view
+			_tableFlags.prefetchTowardLaterRows = (visible.origin.y < _lastVisibleRectOriginY);
+			_lastVisibleRectOriginY = visible.origin.y;
 		}
+		[self _schedulePrefetchingCells];
 	}
-    
+	
 	if(self.headerView) {
 		CGSize s = self.contentSize;
 		CGRect headerViewRect = CGRectMake(0, s.height - self.headerView.frame.size.height, visible.size.width, self.headerView.frame.size.height);
@@ -1103,6 +1925,113 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
 	}
 }
 
+#pragma mark - Prefetching
+
+- (CGFloat)prefetchDistance
+{
+	return _prefetchDistance;
+}
+
+- (void)setPrefetchDistance:(CGFloat)distance
+{
+	_prefetchDistance = MAX(0.0, distance);
+	if(_prefetchDistance > 0.0) {
+		_lastVisibleRectOriginY = [self visibleRect].origin.y;
+		_tableFlags.prefetchTowardLaterRows = 1;
+		[self _schedulePrefetchingCells];
+	} else {
+		[self _removeAllPrefetchedCells];
+	}
+}
+
+- (void)_schedulePrefetchingCells
+{
+	if(!_tableFlags.prefetchScheduled) {
+		_tableFlags.prefetchScheduled = 1;
+		// run outside of the current layout pass, which is usually a scroll tick
+		[self performSelector:@selector(_prefetchCells) withObject:nil afterDelay:0.0 inModes:@[NSRunLoopCommonModes]];
+	}
+}
+
+/**
+ * @brief Make cells ahead of time for rows just beyond the visible rect
+ *
+ * Rows within #prefetchDistance of the visible rect, on the side it's moving
+ * toward, get a cell from the data source which is laid out, drawn and added
+ * as a hidden subview, so scrolling it into view only has to unhide it. A few
+ * cells are made per pass, and passes are scheduled until the window is full.
+ * Prefetched cells which fall out of the window are recycled.
+ */
+- (void)_prefetchCells
+{
+	_tableFlags.prefetchScheduled = 0;
+	if(_prefetchDistance <= 0.0 || _sectionInfo == nil || _dataSource == nil)
+		return;
+	
+	CGRect visible = [self visibleRect];
+	CGRect window;
+	if(_tableFlags.prefetchTowardLaterRows) {
+		window = CGRectMake(visible.origin.x, CGRectGetMinY(visible) - _prefetchDistance, visible.size.width, _prefetchDistance);
+	} else {
+		window = CGRectMake(visible.origin.x, CGRectGetMaxY(visible), visible.size.width, _prefetchDistance);
+	}
+	
+	// recycle prefetched cells the table has scrolled away from
+	for(NSIndexPath *indexPath in [_prefetchedCells allKeys]) {
+		TUITableViewCell *cell = [_prefetchedCells objectForKey:indexPath];
+		CGRect frame = [self rectForRowAtIndexPath:indexPath];
+		if(!CGRectIntersectsRect(frame, window) && !CGRectIntersectsRect(frame, visible)) {
+			[_prefetchedCells removeObjectForKey:indexPath];
+			cell.hidden = NO;
+			[self _enqueueReusableCell:cell];
+			[cell removeFromSuperview];
+		}
+	}
+	
+	__block NSUInteger budget = PREFETCH_CELLS_PER_PASS;
+	__block BOOL complete = YES;
+	[self _enumerateRowsFromTableOffset:_contentHeight - CGRectGetMaxY(window) toTableOffset:_contentHeight - CGRectGetMinY(window) usingBlock:^(NSInteger section, NSInteger row, CGRect rowRect, BOOL *stop) {
+		if(!CGRectIntersectsRect(rowRect, window) || CGRectIntersectsRect(rowRect, visible))
+			return;
+		
+		NSIndexPath *indexPath = [NSIndexPath indexPathForRow:row inSection:section];
+		if([_prefetchedCells objectForKey:indexPath] != nil || [self _indexOfVisibleCellForSection:section row:row] != NSNotFound)
+			return;
+		
+		if(budget == 0) {
+			complete = NO;
+			*stop = YES;
+			return;
+		}
+		budget--;
+		
+		TUITableViewCell *cell = [_dataSource tableView:self cellForRowAtIndexPath:indexPath];
+		cell.frame = rowRect;
+		cell.hidden = YES;
+		[cell prepareForDisplay];
+		[self addSubview:cell];
+		[cell layoutIfNeeded];
+		[cell.layer displayIfNeeded];
+		
+		if(_prefetchedCells == nil)
+			_prefetchedCells = [[NSMutableDictionary alloc] init];
+		[_prefetchedCells setObject:cell forKey:indexPath];
+	}];
+	
+	if(!complete)
+		[self _schedulePrefetchingCells];
+}
+
+- (void)_removeAllPrefetchedCells
+{
+	[_prefetchedCells enumerateKeysAndObjectsUsingBlock:^(NSIndexPath *indexPath, TUITableViewCell *cell, BOOL *stop) {
+		cell.hidden = NO;
+		[self _enqueueReusableCell:cell];
+		[cell removeFromSuperview];
+	}];
+	[_prefetchedCells removeAllObjects];
+}
+
 - (BOOL)pullDownViewIsVisible
 {
 	if(_pullDownView) {
@@ -1125,14 +2054,8 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
     
 	// need to recycle all visible cells, have them be regenerated on layoutSubviews
 	// because the same cells might have different content
-	for(NSIndexPath *i in _visibleItems) {
-		TUITableViewCell *cell = [_visibleItems objectForKey:i];
-		[self _enqueueReusableCell:cell];
-		[cell removeFromSuperview];
-	}
-	
-	// clear visible cells
-	[_visibleItems removeAllObjects];
+	[self _removeAllVisibleCells];
+	[self _removeAllPrefetchedCells];
 	
 	// remove any visible headers, they should be re-added when the table is laid out
 	for(TUITableViewSection *section in _sectionInfo){
@@ -1146,6 +2069,7 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
 	[_visibleSectionHeaders removeAllIndexes];
 	
 	_sectionInfo = nil; // will be regenerated on next layout
+	[self _cancelRowHeightMeasurements]; // the heights may have changed with the data
     
     self.contentSize = CGSizeZero;
     self.contentOffset = CGPointZero;
@@ -1161,14 +2085,8 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
 	
 	// need to recycle all visible cells, have them be regenerated on layoutSubviews
 	// because the same cells might have different content
-	for(NSIndexPath *i in _visibleItems) {
-		TUITableViewCell *cell = [_visibleItems objectForKey:i];
-		[self _enqueueReusableCell:cell];
-		[cell removeFromSuperview];
-	}
-	
-	// clear visible cells
-	[_visibleItems removeAllObjects];
+	[self _removeAllVisibleCells];
+	[self _removeAllPrefetchedCells];
 	
 	// remove any visible headers, they should be re-added when the table is laid out
 	for(TUITableViewSection *section in _sectionInfo){
@@ -1182,6 +2100,7 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
 	[_visibleSectionHeaders removeAllIndexes];
 	
 	_sectionInfo = nil; // will be regenerated on next layout
+	[self _cancelRowHeightMeasurements]; // the heights may have changed with the data
 	
 	[self layoutSubviews];
 	
@@ -1201,6 +2120,12 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
 			[CATransaction setDisableActions:YES];
 			
 			BOOL visibleCellsNeedRelayout = [self _preLayoutCells];
+			if([self _resolveEstimatedRowHeightsNearVisibleRect])
+				visibleCellsNeedRelayout = YES;
+			if(_tableFlags.visibleCellsNeedRelayout) {
+				_tableFlags.visibleCellsNeedRelayout = 0;
+				visibleCellsNeedRelayout = YES;
+			}
 			[super layoutSubviews]; // this will munge with the contentOffset
 			[self _layoutSectionHeaders:visibleCellsNeedRelayout];
 			[self _layoutCells:visibleCellsNeedRelayout];
@@ -1220,15 +2145,243 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
 - (void)reloadLayout
 {
 	_sectionInfo = nil; // will be regenerated on next layout
+	[self _cancelRowHeightMeasurements]; // the heights may have changed with the data
 	
 	[self _preLayoutCells];
+	[self _resolveEstimatedRowHeightsNearVisibleRect];
 	[super layoutSubviews]; // this will munge with the contentOffset
 	[self _layoutSectionHeaders:YES];
 	[self _layoutCells:YES];
 }
 
+#pragma mark - Row Updates
+
+/**
+ * @brief Obtain the row a row moves to when rows are deleted and inserted in its section
+ *
+ * @param row the row before the update
+ * @param deleted rows deleted from the section, indexed before the update
+ * @param inserted rows inserted into the section, indexed after the update
+ * @return the row after the update, or NSNotFound if it was deleted
+ */
+static NSInteger TUITableViewRowAfterUpdate(NSInteger row, NSIndexSet *deleted, NSIndexSet *inserted)
+{
+	if([deleted containsIndex:row])
+		return NSNotFound;
+	
+	row -= [deleted countOfIndexesInRange:NSMakeRange(0, row)];
+	for(NSUInteger i = [inserted firstIndex]; i != NSNotFound && i <= row; i = [inserted indexGreaterThanIndex:i])
+		row++;
+	return row;
+}
+
+- (void)beginUpdates
+{
+	if(_updateNestingLevel++ == 0) {
+		_deletedIndexPaths = [[NSMutableArray alloc] init];
+		_insertedIndexPaths = [[NSMutableArray alloc] init];
+		_reloadedIndexPaths = [[NSMutableArray alloc] init];
+	}
+}
+
+- (void)endUpdates
+{
+	NSAssert(_updateNestingLevel > 0, @"Mismatched call to %s", __func__);
+	if(--_updateNestingLevel == 0) {
+		NSArray *deleted = _deletedIndexPaths;
+		NSArray *inserted = _insertedIndexPaths;
+		NSArray *reloaded = _reloadedIndexPaths;
+		_deletedIndexPaths = nil;
+		_insertedIndexPaths = nil;
+		_reloadedIndexPaths = nil;
+		
+		[self _updateRowsDeletingIndexPaths:deleted insertingIndexPaths:inserted reloadingIndexPaths:reloaded];
+	}
+}
+
+- (void)insertRowsAtIndexPaths:(NSArray *)indexPaths
+{
+	[self beginUpdates];
+	[_insertedIndexPaths addObjectsFromArray:indexPaths];
+	[self endUpdates];
+}
+
+- (void)deleteRowsAtIndexPaths:(NSArray *)indexPaths
+{
+	[self beginUpdates];
+	[_deletedIndexPaths addObjectsFromArray:indexPaths];
+	[self endUpdates];
+}
+
+- (void)reloadRowsAtIndexPaths:(NSArray *)indexPaths
+{
+	[self beginUpdates];
+	[_reloadedIndexPaths addObjectsFromArray:indexPaths];
+	[self endUpdates];
+}
+
+/**
+ * @brief Group index paths into one index set of rows per section
+ *
+ * @param indexPaths the index paths
+ * @return index sets by section, or nil if an index path is outside the current sections
+ */
+- (NSArray *)_rowIndexesBySectionForIndexPaths:(NSArray *)indexPaths
+{
+	NSInteger numberOfSections = [_sectionInfo count];
+	NSMutableArray *indexesBySection = [NSMutableArray arrayWithCapacity:numberOfSections];
+	for(NSInteger s = 0; s < numberOfSections; s++) {
+		[indexesBySection addObject:[NSMutableIndexSet indexSet]];
+	}
+	
+	for(NSIndexPath *indexPath in indexPaths) {
+		if(indexPath.section >= numberOfSections)
+			return nil;
+		[[indexesBySection objectAtIndex:indexPath.section] addIndex:indexPath.row];
+	}
+	return indexesBySection;
+}
+
+/**
+ * @brief Apply a batch of row updates to the section info and the visible cells
+ *
+ * @param deleted index paths of deleted rows, before the update
+ * @param inserted index paths of inserted rows, after the update
+ * @param reloaded index paths of reloaded rows, before the update
+ */
+- (void)_updateRowsDeletingIndexPaths:(NSArray *)deleted insertingIndexPaths:(NSArray *)inserted reloadingIndexPaths:(NSArray *)reloaded
+{
+	if([deleted count] == 0 && [inserted count] == 0 && [reloaded count] == 0)
+		return;
+	
+	// nothing has been laid out yet, the next layout reads everything from the data source
+	if(_sectionInfo == nil)
+		return;
+	
+	NSInteger numberOfSections = [_sectionInfo count];
+	NSArray *deletedRows = [self _rowIndexesBySectionForIndexPaths:deleted];
+	NSArray *insertedRows = [self _rowIndexesBySectionForIndexPaths:inserted];
+	NSArray *reloadedRows = [self _rowIndexesBySectionForIndexPaths:reloaded];
+	
+	BOOL consistent = (deletedRows != nil && insertedRows != nil && reloadedRows != nil);
+	if(consistent && _tableFlags.dataSourceNumberOfSectionsInTableView) {
+		consistent = ([_dataSource numberOfSectionsInTableView:self] == numberOfSections);
+	}
+	for(NSInteger s = 0; consistent && s < numberOfSections; s++) {
+		NSIndexSet *d = [deletedRows objectAtIndex:s];
+		NSIndexSet *i = [insertedRows objectAtIndex:s];
+		NSIndexSet *r = [reloadedRows objectAtIndex:s];
+		if([d count] == 0 && [i count] == 0 && [r count] == 0)
+			continue;
+		
+		NSUInteger numberOfRows = [[_sectionInfo objectAtIndex:s] numberOfRows];
+		NSUInteger expectedNumberOfRows = numberOfRows - [d count] + [i count];
+		consistent = ([d count] == 0 || [d lastIndex] < numberOfRows) &&
+		             ([r count] == 0 || [r lastIndex] < numberOfRows) &&
+		             ([i count] == 0 || [i lastIndex] < expectedNumberOfRows) &&
+		             ([_dataSource tableView:self numberOfRowsInSection:s] == expectedNumberOfRows);
+	}
+	
+	if(!consistent) {
+		NSLog(@"!!! Warning: row updates don't match the data source, reloading table view %@", self);
+		[self reloadData];
+		return;
+	}
+	
+	NSIndexPath *(^indexPathAfterUpdate)(NSIndexPath *) = ^NSIndexPath *(NSIndexPath *indexPath) {
+		if(indexPath == nil || indexPath.section >= numberOfSections)
+			return nil;
+		NSInteger row = TUITableViewRowAfterUpdate(indexPath.row, [deletedRows objectAtIndex:indexPath.section], [insertedRows objectAtIndex:indexPath.section]);
+		return (row != NSNotFound) ? [NSIndexPath indexPathForRow:row inSection:indexPath.section] : nil;
+	};
+	
+	// keep the first visible row, or the first row after it to survive, where it is
+	NSInteger anchorSection, anchorRow;
+	CGFloat anchorTop;
+	BOOL anchored = [self _getFirstVisibleRowSection:&anchorSection row:&anchorRow top:&anchorTop];
+	if(anchored) {
+		NSIndexSet *d = [deletedRows objectAtIndex:anchorSection];
+		NSInteger numberOfRows = [[_sectionInfo objectAtIndex:anchorSection] numberOfRows];
+		while(anchorRow < numberOfRows && [d containsIndex:anchorRow])
+			anchorRow++;
+		anchored = (anchorRow < numberOfRows);
+		if(anchored)
+			anchorRow = TUITableViewRowAfterUpdate(anchorRow, d, [insertedRows objectAtIndex:anchorSection]);
+	}
+	
+	// prefetched cells may be for rows which moved or changed, just make them again
+	[self _removeAllPrefetchedCells];
+	
+	// recycle the cells of deleted and reloaded rows and move the rest to their new rows,
+	// which keeps them in row order; the next layout fills in the rows left without a cell
+	for(NSUInteger index = 0; index < [_visibleCells count];) {
+		TUITableViewRowPosition position = _visibleRows[index];
+		NSInteger newRow = TUITableViewRowAfterUpdate(position.row, [deletedRows objectAtIndex:position.section], [insertedRows objectAtIndex:position.section]);
+		if(newRow == NSNotFound || [[reloadedRows objectAtIndex:position.section] containsIndex:position.row]) {
+			[self _removeVisibleCellAtIndex:index];
+		} else {
+			_visibleRows[index++].row = newRow;
+		}
+	}
+	
+	// deleted rows are dropped from the selection without a deselect notification
+	for(NSInteger s = 0; s < numberOfSections && s < [_selectedRowIndexes count]; s++) {
+		NSMutableIndexSet *selected = [_selectedRowIndexes objectAtIndex:s];
+		NSIndexSet *d = [deletedRows objectAtIndex:s];
+		NSIndexSet *i = [insertedRows objectAtIndex:s];
+		if([selected count] == 0 || ([d count] == 0 && [i count] == 0))
+			continue;
+		
+		_numberOfSelectedRows -= [selected count];
+		// shifting down over a deleted row drops it from the set
+		for(NSUInteger row = [d lastIndex]; row != NSNotFound; row = [d indexLessThanIndex:row])
+			[selected shiftIndexesStartingAtIndex:row + 1 by:-1];
+		for(NSUInteger row = [i firstIndex]; row != NSNotFound; row = [i indexGreaterThanIndex:row])
+			[selected shiftIndexesStartingAtIndex:row by:1];
+		_numberOfSelectedRows += [selected count];
+	}
+	_indexPathsForSelectedRows = nil;
+	_indexPathForLastSelectedRow = indexPathAfterUpdate(_indexPathForLastSelectedRow);
+	_baseSelectionPath = indexPathAfterUpdate(_baseSelectionPath);
+	_indexPathShouldBeFirstResponder = indexPathAfterUpdate(_indexPathShouldBeFirstResponder);
+	
+	for(NSInteger s = 0; s < numberOfSections; s++) {
+		NSIndexSet *d = [deletedRows objectAtIndex:s];
+		NSIndexSet *i = [insertedRows objectAtIndex:s];
+		NSIndexSet *r = [reloadedRows objectAtIndex:s];
+		if([d count] == 0 && [i count] == 0 && [r count] == 0)
+			continue;
+		
+		NSMutableIndexSet *reloadedAfterUpdate = [NSMutableIndexSet indexSet];
+		for(NSUInteger row = [r firstIndex]; row != NSNotFound; row = [r indexGreaterThanIndex:row]) {
+			NSInteger newRow = TUITableViewRowAfterUpdate(row, d, i);
+			if(newRow != NSNotFound)
+				[reloadedAfterUpdate addIndex:newRow];
+		}
+		
+		// the rows being measured in the background don't line up anymore
+		[self _cancelRowHeightMeasurementForSection:s];
+		
+		TUITableViewSection *section = [_sectionInfo objectAtIndex:s];
+		CGFloat previousHeight = [section sectionHeight];
+		[section _deleteRowsAtIndexes:d insertRowsAtIndexes:i reloadRowsAtIndexes:reloadedAfterUpdate];
+		[self _offsetSectionsFromIndex:s + 1 by:[section sectionHeight] - previousHeight];
+	}
+	
+	self.contentSize = CGSizeMake(self.bounds.size.width, _contentHeight);
+	if(anchored)
+		[self _scrollRowInSection:anchorSection row:anchorRow toTop:anchorTop];
+	
+	// laid out with everything else which changed this run loop turn
+	_tableFlags.visibleCellsNeedRelayout = 1;
+	[self setNeedsLayout];
+}
+
 - (void)scrollToRowAtIndexPath:(NSIndexPath *)indexPath atScrollPosition:(TUITableViewScrollPosition)scrollPosition animated:(BOOL)animated
 {
+	// the row should be scrolled to using its real height, not an estimate
+	[self _resolveEstimatedRowHeightsMaintainingVisibleRowsInRect:[self rectForRowAtIndexPath:indexPath]];
+	
 	CGRect v = [self visibleRect];
 	CGRect r = [self rectForRowAtIndexPath:indexPath];
 	
@@ -1260,12 +2413,33 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
 
 - (NSIndexPath *)indexPathForSelectedRow
 {
-	return [_arrayOfSelectedIndexes firstObject];
+	return [self topIndexPath];
 }
 
 - (NSArray *)indexPathesForSelectedRows
 {
-	return _arrayOfSelectedIndexes;
+	if(_indexPathsForSelectedRows == nil) {
+		NSMutableArray *indexPaths = [[NSMutableArray alloc] initWithCapacity:_numberOfSelectedRows];
+		[_selectedRowIndexes enumerateObjectsUsingBlock:^(NSIndexSet *rows, NSUInteger section, BOOL *stop) {
+			[rows enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+				[indexPaths addObject:[NSIndexPath indexPathForRow:row inSection:section]];
+			}];
+		}];
+		_indexPathsForSelectedRows = indexPaths;
+	}
+	return _indexPathsForSelectedRows;
+}
+
+- (NSUInteger)numberOfSelectedRows
+{
+	return _numberOfSelectedRows;
+}
+
+- (NSIndexSet *)indexesOfSelectedRowsInSection:(NSInteger)section
+{
+	if(section < 0 || section >= [_selectedRowIndexes count])
+		return [NSIndexSet indexSet];
+	return [[_selectedRowIndexes objectAtIndex:section] copy];
 }
 
 
@@ -1300,13 +2474,11 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
         
         [self _clearIndexPaths];
         
-        NSMutableArray *indexPathsToSelect = [@[] mutableCopy];
-        [self enumerateIndexPathsUsingBlock:^(NSIndexPath *indexPath, BOOL *stop) {
-            if (![_delegate respondsToSelector:@selector(tableView:shouldSelectRowAtIndexPath:forEvent:)] || [_delegate tableView:self shouldSelectRowAtIndexPath:indexPath forEvent:nil]) {
-                [indexPathsToSelect addObject:indexPath];
-            }
-        }];
-        [self _addSelectedIndexPaths:indexPathsToSelect animated:NO];
+        NSInteger lastSection = [self numberOfSections] - 1;
+        if (lastSection >= 0) {
+            [self _addSelectedRowsFromIndexPath:[NSIndexPath indexPathForRow:0 inSection:0]
+                                    toIndexPath:[NSIndexPath indexPathForRow:[self numberOfRowsInSection:lastSection] - 1 inSection:lastSection]];
+        }
     }
 }
 
@@ -1377,24 +2549,17 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
 
 - (NSIndexPath *)indexPathForFirstVisibleRow
 {
-	NSIndexPath *firstIndexPath = nil;
-	for(NSIndexPath *indexPath in _visibleItems) {
-		if(firstIndexPath == nil || [indexPath compare:firstIndexPath] == NSOrderedAscending) {
-			firstIndexPath = indexPath;
-		}
-	}
-	return firstIndexPath;
+	if([_visibleCells count] == 0)
+		return nil;
+	return [NSIndexPath indexPathForRow:_visibleRows[0].row inSection:_visibleRows[0].section];
 }
 
 - (NSIndexPath *)indexPathForLastVisibleRow
 {
-	NSIndexPath *lastIndexPath = nil;
-	for(NSIndexPath *indexPath in _visibleItems) {
-		if(lastIndexPath == nil || [indexPath compare:lastIndexPath] == NSOrderedDescending) {
-			lastIndexPath = indexPath;
-		}
-	}
-	return lastIndexPath;
+	NSUInteger count = [_visibleCells count];
+	if(count == 0)
+		return nil;
+	return [NSIndexPath indexPathForRow:_visibleRows[count - 1].row inSection:_visibleRows[count - 1].section];
 }
 
 - (BOOL)performKeyAction:(NSEvent *)event
@@ -1536,15 +2701,11 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
         
         [self _clearIndexPaths];
         
-        NSMutableArray *indexPathsToSelect = [@[] mutableCopy];
-        [[self arrayOfIndexesOfSectionsFromIndex:_baseSelectionPath to:path] enumerateObjectsUsingBlock:^(id obj, NSUInteger idx, BOOL *stop) {
-            if([_delegate respondsToSelector:@selector(tableView:shouldSelectRowAtIndexPath:forEvent:)] &&
-               ![_delegate tableView:self shouldSelectRowAtIndexPath:obj forEvent:nil]) {
-                return;
-            }
-            [indexPathsToSelect addObject:obj];
-        }];
-        [self _addSelectedIndexPaths:indexPathsToSelect animated:NO];
+        if ([path compare:_baseSelectionPath] == NSOrderedAscending) {
+            [self _addSelectedRowsFromIndexPath:path toIndexPath:_baseSelectionPath];
+        } else {
+            [self _addSelectedRowsFromIndexPath:_baseSelectionPath toIndexPath:path];
+        }
         
         _indexPathForLastSelectedRow = path;
     }
@@ -1585,45 +2746,25 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
 
 - (NSIndexPath *)topIndexPath
 {
-    if ([_arrayOfSelectedIndexes count]>0)
-    {
-        return [_arrayOfSelectedIndexes objectAtIndex:0];
+    NSInteger numberOfSections = [_selectedRowIndexes count];
+    for (NSInteger section = 0; _numberOfSelectedRows > 0 && section < numberOfSections; section++) {
+        NSIndexSet *rows = [_selectedRowIndexes objectAtIndex:section];
+        if ([rows count] > 0) {
+            return [NSIndexPath indexPathForRow:[rows firstIndex] inSection:section];
+        }
     }
 	return nil;
 }
 
 - (NSIndexPath *)bottomIndexPath
 {
-    if ([_arrayOfSelectedIndexes count]>0)
-    {
-        return [_arrayOfSelectedIndexes lastObject];
-    }
-	return nil;
-}
-
-- (NSMutableArray *)arrayOfIndexesOfSectionsFromIndex:(NSIndexPath*)startIndex
-                                                   to:(NSIndexPath*)endIndex
-{
-    // code for the other way arround
-    NSIndexPath *temp;
-    if (endIndex.section < startIndex.section ||
-        ((endIndex.section == startIndex.section) && endIndex.row < startIndex.row)) {
-        temp = endIndex;
-        endIndex = startIndex;
-        startIndex = temp;
-    }
-    
-	NSMutableArray *indexes = [[NSMutableArray alloc] init];
-    
-    for (NSInteger aSection = startIndex.section; aSection <= endIndex.section ; aSection++) {
-        NSInteger startRow = 0, endRow = [self numberOfRowsInSection:aSection];
-        if (aSection == startIndex.section) startRow = startIndex.row;
-        if (aSection == endIndex.section) endRow = endIndex.row + 1;
-        for (NSInteger aRow = startRow; aRow < endRow; aRow++) {
-            [indexes addObject:[NSIndexPath indexPathForRow:aRow inSection:aSection]];
+    for (NSInteger section = [_selectedRowIndexes count] - 1; _numberOfSelectedRows > 0 && section >= 0; section--) {
+        NSIndexSet *rows = [_selectedRowIndexes objectAtIndex:section];
+        if ([rows count] > 0) {
+            return [NSIndexPath indexPathForRow:[rows lastIndex] inSection:section];
         }
     }
-	return indexes;
+	return nil;
 }
 
 - (void)checkEventModifiers:(NSEvent *)event
@@ -1655,10 +2796,14 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
 {
     if (indexPathsToAdd && indexPathsToAdd.count > 0)
     {
-        [_arrayOfSelectedIndexes addObjectsFromArray:indexPathsToAdd];
-        [_arrayOfSelectedIndexes sortUsingComparator:^(id a, id b) {
-            return [a compare:b];
-        }];
+        for (NSIndexPath *indexPath in indexPathsToAdd) {
+            NSMutableIndexSet *rows = [self _selectedRowIndexesInSection:indexPath.section];
+            if (![rows containsIndex:indexPath.row]) {
+                [rows addIndex:indexPath.row];
+                _numberOfSelectedRows++;
+            }
+        }
+        _indexPathsForSelectedRows = nil;
         
         [indexPathsToAdd enumerateObjectsUsingBlock:^(NSIndexPath *indexPath, NSUInteger idx, BOOL * _Nonnull stop) {
             [[self cellForRowAtIndexPath:indexPath] setSelected:YES animated:shouldAnimate];
@@ -1672,6 +2817,49 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
     }
 }
 
+/**
+ * @brief Select every row between two index paths, inclusive
+ *
+ * Rows are added to the selection a range at a time unless the delegate
+ * vets each row with tableView:shouldSelectRowAtIndexPath:forEvent:, and
+ * only visible cells are touched.
+ */
+- (void)_addSelectedRowsFromIndexPath:(NSIndexPath *)fromIndexPath toIndexPath:(NSIndexPath *)toIndexPath
+{
+    BOOL delegateShouldSelect = [_delegate respondsToSelector:@selector(tableView:shouldSelectRowAtIndexPath:forEvent:)];
+    BOOL delegateDidSelect = [_delegate respondsToSelector:@selector(tableView:didSelectRowAtIndexPath:)];
+    
+    for (NSInteger section = fromIndexPath.section; section <= (NSInteger)toIndexPath.section && section < [self numberOfSections]; section++) {
+        NSInteger startRow = (section == fromIndexPath.section) ? (NSInteger)fromIndexPath.row : 0;
+        NSInteger endRow = (section == toIndexPath.section) ? (NSInteger)toIndexPath.row + 1 : [self numberOfRowsInSection:section];
+        if (startRow >= endRow) continue;
+        
+        NSMutableIndexSet *rows = [self _selectedRowIndexesInSection:section];
+        NSUInteger previousCount = [rows count];
+        NSMutableIndexSet *added = [NSMutableIndexSet indexSetWithIndexesInRange:NSMakeRange(startRow, endRow - startRow)];
+        if (delegateShouldSelect) {
+            [added removeIndexes:[added indexesPassingTest:^BOOL(NSUInteger row, BOOL *stop) {
+                return ![_delegate tableView:self shouldSelectRowAtIndexPath:[NSIndexPath indexPathForRow:row inSection:section] forEvent:nil];
+            }]];
+        }
+        [rows addIndexes:added];
+        _numberOfSelectedRows += [rows count] - previousCount;
+        
+        if (delegateDidSelect) {
+            [added enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+                [self.delegate tableView:self didSelectRowAtIndexPath:[NSIndexPath indexPathForRow:row inSection:section]];
+            }];
+        }
+    }
+    _indexPathsForSelectedRows = nil;
+    
+    [_visibleCells enumerateObjectsUsingBlock:^(TUITableViewCell *cell, NSUInteger idx, BOOL *stop) {
+        if ([self _isRowSelectedInSection:_visibleRows[idx].section row:_visibleRows[idx].row]) {
+            [cell setSelected:YES animated:NO];
+        }
+    }];
+}
+
 - (void)_removeSelectedIndexPath:(NSIndexPath*)indexPathToRemove animated:(BOOL)shouldAnimate
 {
     if (indexPathToRemove)
@@ -1680,36 +2868,60 @@ __unused static NSInteger SortCells(TUITableViewCell *a, TUITableViewCell *b, vo
         if ([self.delegate respondsToSelector:@selector(tableView:didDeselectRowAtIndexPath:)]) {
             [self.delegate tableView:self didDeselectRowAtIndexPath:indexPathToRemove];
         }
-        [_arrayOfSelectedIndexes removeObject:indexPathToRemove];
+        if ([self _isRowSelectedInSection:indexPathToRemove.section row:indexPathToRemove.row]) {
+            [[_selectedRowIndexes objectAtIndex:indexPathToRemove.section] removeIndex:indexPathToRemove.row];
+            _numberOfSelectedRows--;
+            _indexPathsForSelectedRows = nil;
+        }
         if ([_indexPathForLastSelectedRow isEqual:indexPathToRemove]) {
-            _indexPathForLastSelectedRow = [_arrayOfSelectedIndexes firstObject];
+            _indexPathForLastSelectedRow = [self topIndexPath];
         }
     }
 }
 
 - (void)_clearIndexPaths
 {
-    [_arrayOfSelectedIndexes enumerateObjectsUsingBlock:^(NSIndexPath *indexPath, NSUInteger idx, BOOL * _Nonnull stop) {
-        
-        [[self cellForRowAtIndexPath:indexPath] setSelected:NO animated:NO];
-        
-        if ([self.delegate respondsToSelector:@selector(tableView:didDeselectRowAtIndexPath:)]) {
-            [self.delegate tableView:self didDeselectRowAtIndexPath:indexPath];
+    [_visibleCells enumerateObjectsUsingBlock:^(TUITableViewCell *cell, NSUInteger idx, BOOL *stop) {
+        if ([self _isRowSelectedInSection:_visibleRows[idx].section row:_visibleRows[idx].row]) {
+            [cell setSelected:NO animated:NO];
         }
     }];
     
-    [_arrayOfSelectedIndexes removeAllObjects];
+    if ([self.delegate respondsToSelector:@selector(tableView:didDeselectRowAtIndexPath:)]) {
+        [_selectedRowIndexes enumerateObjectsUsingBlock:^(NSIndexSet *rows, NSUInteger section, BOOL *stop) {
+            [rows enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+                [self.delegate tableView:self didDeselectRowAtIndexPath:[NSIndexPath indexPathForRow:row inSection:section]];
+            }];
+        }];
+    }
+    
+    [_selectedRowIndexes removeAllObjects];
+    _numberOfSelectedRows = 0;
+    _indexPathsForSelectedRows = nil;
     _indexPathForLastSelectedRow = nil;
 }
 
+/**
+ * @brief Obtain the selected rows of a section, creating an empty set if needed
+ */
+- (NSMutableIndexSet *)_selectedRowIndexesInSection:(NSInteger)section
+{
+    while ([_selectedRowIndexes count] <= section) {
+        [_selectedRowIndexes addObject:[NSMutableIndexSet indexSet]];
+    }
+    return [_selectedRowIndexes objectAtIndex:section];
+}
+
+- (BOOL)_isRowSelectedInSection:(NSInteger)section row:(NSInteger)row
+{
+    if (section < 0 || section >= [_selectedRowIndexes count])
+        return NO;
+    return [[_selectedRowIndexes objectAtIndex:section] containsIndex:row];
+}
 
 - (BOOL)indexPathSelected:(NSIndexPath *)indexPathToCheck
 {
-    if ([self.indexPathesForSelectedRows indexOfObjectIdenticalTo:indexPathToCheck] != NSNotFound) {
-        return YES;
-    }
-    
-    return NO;
+    return indexPathToCheck != nil && [self _isRowSelectedInSection:indexPathToCheck.section row:indexPathToCheck.row];
 }
 
 
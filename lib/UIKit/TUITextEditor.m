@@ -19,6 +19,11 @@
 #import "TUINSWindow.h"
 #import "TUITextRenderer+Private.h"
 
+// implemented by views which want to know what was edited, like TUITextView
+@interface TUIView (TUITextEditorEditing)
+- (void)_textDidEditRange:(NSRange)range changeInLength:(NSInteger)delta;
+@end
+
 @implementation TUITextEditor
 
 @synthesize defaultAttributes;
@@ -35,6 +40,7 @@
 		inputContext.acceptsGlyphInfo = YES;
 		
 		_secure = NO;
+		_flags.paragraphLayout = 1; // typing only lays out the paragraph being typed in
 		self.attributedString = backingStore;
 	}
 	return self;
@@ -94,10 +100,18 @@
 	return [super resignFirstResponder];
 }
 
+// `range` is the edited range in the string as it is now, and `delta` how much longer it got
+- (void)_didEditRange:(NSRange)range changeInLength:(NSInteger)delta
+{
+	[self invalidateLayoutInRange:range changeInLength:delta];
+	if([view respondsToSelector:@selector(_textDidEditRange:changeInLength:)])
+		[view _textDidEditRange:range changeInLength:delta];
+}
+
+// edits should have been passed to -_didEditRange:changeInLength: by now
 - (void)_textDidChange
 {
 	[inputContext invalidateCharacterCoordinates];
-	[self reset];
 	[view setNeedsDisplay];
 	[view performSelector:@selector(_textDidChange)];
 }
@@ -109,11 +123,15 @@
 
 - (void)setText:(NSString *)aString
 {
+	NSUInteger oldLength = [backingStore length];
 	[backingStore beginEditing];
 	[backingStore replaceCharactersInRange:NSMakeRange(0, [backingStore length]) withString:aString];
 	[backingStore setAttributes:defaultAttributes range:NSMakeRange(0, [aString length])];
 	[backingStore endEditing];
 	
+	[self reset];
+	[self _didEditRange:NSMakeRange(0, [aString length]) changeInLength:(NSInteger)[aString length] - (NSInteger)oldLength];
+	
 	[self unmarkText];
 	self.selectedRange = NSMakeRange([aString length], 0);
 	[self _textDidChange];
@@ -213,6 +231,7 @@
 	
 	// Actually delete the characters
 	[backingStore deleteCharactersInRange:range];
+	[self _didEditRange:NSMakeRange(range.location, 0) changeInLength:-(NSInteger)range.length];
 	
 	NSRange selectedRange;
 	selectedRange.location = range.location;
@@ -275,6 +294,7 @@
 	[backingStore replaceCharactersInRange:replacementRange withString:aString];
 	[backingStore setAttributes:defaultAttributes range:NSMakeRange(replacementRange.location, [aString length])];
 	[backingStore endEditing];
+	[self _didEditRange:NSMakeRange(replacementRange.location, [aString length]) changeInLength:(NSInteger)[aString length] - (NSInteger)replacementRange.length];
 	
 	// Redisplay
 	selectedRange.location = replacementRange.location + [aString length];
@@ -308,6 +328,7 @@
 	[backingStore beginEditing];
 	if ([aString length] == 0) {
 		[backingStore deleteCharactersInRange:replacementRange];
+		[self _didEditRange:NSMakeRange(replacementRange.location, 0) changeInLength:-(NSInteger)replacementRange.length];
 		[self unmarkText];
 	} else {
 		markedRange = NSMakeRange(replacementRange.location, [aString length]);
@@ -317,6 +338,7 @@
 			[backingStore replaceCharactersInRange:replacementRange withString:aString];
 		}
 		[backingStore addAttributes:markedAttributes range:markedRange];
+		[self _didEditRange:markedRange changeInLength:(NSInteger)[aString length] - (NSInteger)replacementRange.length];
 	}
 	[backingStore endEditing];
 	
@@ -20,6 +20,22 @@
 
 - (CFIndex)stringIndexForPoint:(CGPoint)p;
 - (CFIndex)stringIndexForEvent:(NSEvent *)event;
+
+// The delegate's active range at a string index, or under a point in the
+// same space as -stringIndexForPoint:. The ranges are indexed once per
+// layout, with the rects they cover, so these are cheap enough to call for
+// every mouse moved event. Where ranges overlap, the one earlier in the
+// delegate's array wins.
+- (id<ABActiveTextRange>)activeRangeForStringIndex:(CFIndex)index;
+- (id<ABActiveTextRange>)activeRangeAtPoint:(CGPoint)p;
+- (id<ABActiveTextRange>)activeRangeForEvent:(NSEvent *)event;
+
+// The delegate is asked for its active ranges once per layout, and again
+// on each mouse down, so a click always hits its current ranges. Call this
+// when they change without the attributed string or frame changing, for
+// hovering to pick the change up before the next click.
+- (void)invalidateActiveRanges;
+
 - (void)resetSelection;
 - (CGRect)rectForCurrentSelection;
 
@@ -39,4 +55,7 @@
 - (void)textRendererWillResignFirstResponder:(TUITextRenderer *)textRenderer;
 - (void)textRendererDidResignFirstResponder:(TUITextRenderer *)textRenderer;
 
+// Sent when a virtualized layout measured paragraphs it had only estimated, changing -size.
+- (void)textRendererDidUpdateEstimatedSize:(TUITextRenderer *)textRenderer;
+
 @end
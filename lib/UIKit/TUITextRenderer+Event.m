@@ -22,6 +22,102 @@
 #import "TUITextEditor.h"
 #import "TUITextRenderer+Private.h"
 
+#define TUITextRendererActiveRangeMaxRects 10 // as many as the hit range highlight draws
+
+/*
+ The delegate's active ranges sorted by where they start, with how far the
+ ranges up to each one reach, so finding the range at a string index is a
+ binary search rather than a walk through all of them. The rects each range
+ covers are found the first time a point is tested against it. Built from
+ the line metrics, and thrown away with them or by -invalidateActiveRanges.
+ */
+typedef struct TUITextRendererActiveRange {
+	NSRange range;
+	CFIndex order; // in the delegate's array, which decides between overlapping ranges
+	CFIndex rectCount; // -1 until the rects are found
+} TUITextRendererActiveRange;
+
+typedef struct TUITextRendererActiveRanges {
+	CFArrayRef source; // retained, as the delegate handed it over
+	CFIndex count;
+	TUITextRendererActiveRange *ranges; // sorted by location
+	NSUInteger *reach; // the furthest NSMaxRange of ranges[0 ... i]
+	CGRect *rects; // TUITextRendererActiveRangeMaxRects for each of ranges
+} TUITextRendererActiveRanges;
+
+static int TUITextRendererActiveRangeCompare(const void *a, const void *b)
+{
+	const TUITextRendererActiveRange *x = (const TUITextRendererActiveRange *) a;
+	const TUITextRendererActiveRange *y = (const TUITextRendererActiveRange *) b;
+	if(x->range.location != y->range.location)
+		return x->range.location < y->range.location ? -1 : 1;
+	return x->order < y->order ? -1 : (x->order > y->order ? 1 : 0);
+}
+
+static TUITextRendererActiveRanges *TUITextRendererActiveRangesCreate(NSArray *source)
+{
+	CFIndex count = [source count];
+	TUITextRendererActiveRanges *activeRanges = (TUITextRendererActiveRanges *) malloc(sizeof(TUITextRendererActiveRanges));
+	activeRanges->source = CFBridgingRetain(source);
+	activeRanges->count = count;
+	activeRanges->ranges = (TUITextRendererActiveRange *) malloc(sizeof(TUITextRendererActiveRange) * MAX(count, 1));
+	activeRanges->reach = (NSUInteger *) malloc(sizeof(NSUInteger) * MAX(count, 1));
+	activeRanges->rects = (CGRect *) malloc(sizeof(CGRect) * TUITextRendererActiveRangeMaxRects * MAX(count, 1));
+	
+	CFIndex i = 0;
+	for(id<ABActiveTextRange> rangeValue in source) {
+		activeRanges->ranges[i].range = [rangeValue rangeValue];
+		activeRanges->ranges[i].order = i;
+		activeRanges->ranges[i].rectCount = -1;
+		i++;
+	}
+	qsort(activeRanges->ranges, count, sizeof(TUITextRendererActiveRange), TUITextRendererActiveRangeCompare);
+	
+	NSUInteger reach = 0;
+	for(i = 0; i < count; i++) {
+		reach = MAX(reach, NSMaxRange(activeRanges->ranges[i].range));
+		activeRanges->reach[i] = reach;
+	}
+	return activeRanges;
+}
+
+static void TUITextRendererActiveRangesRelease(TUITextRendererActiveRanges *activeRanges)
+{
+	CFRelease(activeRanges->source);
+	free(activeRanges->ranges);
+	free(activeRanges->reach);
+	free(activeRanges->rects);
+	free(activeRanges);
+}
+
+// the position in ranges of the range containing index, or kCFNotFound
+static CFIndex TUITextRendererActiveRangesFind(const TUITextRendererActiveRanges *activeRanges, CFIndex index)
+{
+	if(index < 0)
+		return kCFNotFound;
+	
+	// the first range starting after index
+	CFIndex low = 0;
+	CFIndex high = activeRanges->count;
+	while(low < high) {
+		CFIndex mid = low + (high - low) / 2;
+		if(activeRanges->ranges[mid].range.location <= (NSUInteger) index) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	
+	// walk back through the ones starting before it, for as long as any of them reach past it
+	CFIndex found = kCFNotFound;
+	for(CFIndex i = low - 1; i >= 0 && activeRanges->reach[i] > (NSUInteger) index; i--) {
+		const TUITextRendererActiveRange *r = &activeRanges->ranges[i];
+		if(NSLocationInRange(index, r->range) && (found == kCFNotFound || r->order < activeRanges->ranges[found].order))
+			found = i;
+	}
+	return found;
+}
+
 @implementation TUITextRenderer (Event)
 
 + (void)initialize
@@ -42,12 +138,14 @@
 - (void)setDelegate:(id<TUITextRendererDelegate>)d
 {
 	delegate = d;
+	[self invalidateActiveRanges];
 	
 	_flags.delegateActiveRangesForTextRenderer = [delegate respondsToSelector:@selector(activeRangesForTextRenderer:)];
 	_flags.delegateWillBecomeFirstResponder = [delegate respondsToSelector:@selector(textRendererWillBecomeFirstResponder:)];
 	_flags.delegateDidBecomeFirstResponder = [delegate respondsToSelector:@selector(textRendererDidBecomeFirstResponder:)];
 	_flags.delegateWillResignFirstResponder = [delegate respondsToSelector:@selector(textRendererWillResignFirstResponder:)];
 	_flags.delegateDidResignFirstResponder = [delegate respondsToSelector:@selector(textRendererDidResignFirstResponder:)];
+	_flags.delegateDidUpdateEstimatedSize = [delegate respondsToSelector:@selector(textRendererDidUpdateEstimatedSize:)];
 }
 
 - (CGPoint)localPointForEvent:(NSEvent *)event
@@ -60,7 +158,8 @@
 
 - (CFIndex)stringIndexForPoint:(CGPoint)p
 {
-	return AB_CTFrameGetStringIndexForPosition([self ctFrame], p);
+	[self layOutRect:CGRectMake(frame.origin.x + p.x, frame.origin.y + p.y, 1, 1)];
+	return AB_CTFrameMetricsGetStringIndexForPosition([self ctFrameMetrics], p);
 }
 
 - (CFIndex)stringIndexForEvent:(NSEvent *)event
@@ -68,16 +167,84 @@
 	return [self stringIndexForPoint:[self localPointForEvent:event]];
 }
 
-- (id<ABActiveTextRange>)rangeInRanges:(NSArray *)ranges forStringIndex:(CFIndex)index
+- (void)invalidateActiveRanges
+{
+	if(_activeRanges) {
+		TUITextRendererActiveRangesRelease(_activeRanges);
+		_activeRanges = NULL;
+	}
+}
+
+- (TUITextRendererActiveRanges *)_indexedActiveRanges
+{
+	if(!_flags.delegateActiveRangesForTextRenderer)
+		return NULL;
+	
+	// the delegate is only asked again once the layout changes or the ranges are invalidated
+	if(!_activeRanges) {
+		NSArray *ranges = [delegate activeRangesForTextRenderer:self];
+		if(ranges)
+			_activeRanges = TUITextRendererActiveRangesCreate(ranges);
+	}
+	return _activeRanges;
+}
+
+- (id<ABActiveTextRange>)_activeRangeAtIndex:(CFIndex)i ofActiveRanges:(TUITextRendererActiveRanges *)activeRanges
+{
+	return (__bridge id<ABActiveTextRange>) CFArrayGetValueAtIndex(activeRanges->source, activeRanges->ranges[i].order);
+}
+
+- (id<ABActiveTextRange>)activeRangeForStringIndex:(CFIndex)index
+{
+	TUITextRendererActiveRanges *activeRanges = [self _indexedActiveRanges];
+	if(!activeRanges)
+		return nil;
+	
+	CFIndex i = TUITextRendererActiveRangesFind(activeRanges, index);
+	return (i == kCFNotFound) ? nil : [self _activeRangeAtIndex:i ofActiveRanges:activeRanges];
+}
+
+- (BOOL)_activeRangeAtIndex:(CFIndex)i ofActiveRanges:(TUITextRendererActiveRanges *)activeRanges containsPoint:(CGPoint)point
+{
+	TUITextRendererActiveRange *r = &activeRanges->ranges[i];
+	CGRect *rects = activeRanges->rects + i * TUITextRendererActiveRangeMaxRects;
+	if(r->rectCount < 0) {
+		r->rectCount = TUITextRendererActiveRangeMaxRects;
+		AB_CTFrameMetricsGetRectsForRangeWithAggregationType([self ctFrameMetrics], CFRangeMake(r->range.location, r->range.length), AB_CTLineRectAggregationTypeInline, rects, &r->rectCount);
+	}
+	
+	for(CFIndex j = 0; j < r->rectCount; j++) {
+		// as much as the highlight covers
+		if(CGRectContainsPoint(CGRectInset(rects[j], -2.0f, -1.0f), point))
+			return YES;
+	}
+	return NO;
+}
+
+- (id<ABActiveTextRange>)activeRangeAtPoint:(CGPoint)p
 {
-	for(id<ABActiveTextRange> rangeValue in ranges) {
-		NSRange range = [rangeValue rangeValue];
-		if(NSLocationInRange(index, range))
-			return rangeValue;
+	// lays out around p first, which may throw the index away
+	CFIndex index = [self stringIndexForPoint:p];
+	TUITextRendererActiveRanges *activeRanges = [self _indexedActiveRanges];
+	if(!activeRanges || index == kCFNotFound)
+		return nil;
+	
+	// the index is of the nearest caret position, which can be just past the
+	// character under p, or at the end of a line well to the left of it
+	CGPoint point = CGPointMake(frame.origin.x + p.x, frame.origin.y + p.y);
+	for(CFIndex candidate = index; candidate >= index - 1; candidate--) {
+		CFIndex i = TUITextRendererActiveRangesFind(activeRanges, candidate);
+		if(i != kCFNotFound && [self _activeRangeAtIndex:i ofActiveRanges:activeRanges containsPoint:point])
+			return [self _activeRangeAtIndex:i ofActiveRanges:activeRanges];
 	}
 	return nil;
 }
 
+- (id<ABActiveTextRange>)activeRangeForEvent:(NSEvent *)event
+{
+	return [self activeRangeAtPoint:[self localPointForEvent:event]];
+}
+
 - (NSImage *)dragImageForSelection:(NSRange)selection
 {
 	CGRect b = self.view.frame;
@@ -146,13 +313,11 @@
 			break;
 	}
 	
-	CFIndex eventIndex = [self stringIndexForEvent:event];
-	NSArray *ranges = nil;
-	if(_flags.delegateActiveRangesForTextRenderer) {
-		ranges = [delegate activeRangesForTextRenderer:self];
-	}
+	// a click acts on the range, so it has to be the delegate's current one
+	[self invalidateActiveRanges];
 	
-	id<ABActiveTextRange> hitActiveRange = [self rangeInRanges:ranges forStringIndex:eventIndex];
+	CFIndex eventIndex = [self stringIndexForEvent:event];
+	id<ABActiveTextRange> hitActiveRange = [self activeRangeForStringIndex:eventIndex];
 	
 	if([event clickCount] > 1)
 		goto normal; // we want double-click-drag-select-by-word, not drag selected text
@@ -245,12 +410,12 @@ normal:
 }
 
 - (CGRect)rectForRange:(CFRange)range {
-	CTFrameRef textFrame = [self ctFrame];
 	CGRect totalRect = CGRectNull;
 	if(range.length > 0) {
 		CFIndex rectCount = 100;
 		CGRect rects[rectCount];
-		AB_CTFrameGetRectsForRangeWithAggregationType(textFrame, range, AB_CTLineRectAggregationTypeBlock, rects, &rectCount);
+		// only what's laid out can be on screen
+		AB_CTFrameMetricsGetRectsForRangeWithAggregationType([self ctFrameMetrics], range, AB_CTLineRectAggregationTypeBlock, rects, &rectCount);
 		
 		for(CFIndex i = 0; i < rectCount; ++i) {
 			CGRect rect = rects[i];
@@ -86,7 +86,8 @@ static NSAttributedString *killBuffer = nil;
 		CFRange r = CFRangeMake(index, 0);
 		CFIndex nRects = 1;
 		CGRect rects[nRects];
-		AB_CTFrameGetRectsForRange([self ctFrame], r, rects, &nRects);
+		[self layOutCharacterRange:r];
+		AB_CTFrameMetricsGetRectsForRangeWithAggregationType([self ctFrameMetrics], r, AB_CTLineRectAggregationTypeInline, rects, &nRects);
 		
 		if (nRects == 1) {
 			// If it exists, then scroll to the beginning of the rects.
@@ -102,13 +103,14 @@ static NSAttributedString *killBuffer = nil;
 
 - (CFIndex)_indexByMovingIndex:(CFIndex)index
 							by:(CFIndex)incr {
+	[self layOutCharacterRange:CFRangeMake(index, 0)];
+	const AB_CTFrameMetrics *metrics = [self ctFrameMetrics];
 	CFIndex lineIndex;
 	float xPosition;
-	AB_CTFrameGetLinePositionOfIndex(TEXT, [self ctFrame], index, &lineIndex, &xPosition);
+	AB_CTFrameMetricsGetLinePositionOfIndex(metrics, index, &lineIndex, &xPosition);
 	
 	if(lineIndex >= 0) {
-		NSArray *lines = (__bridge NSArray *)CTFrameGetLines([self ctFrame]);
-		CFIndex linesCount = [lines count];
+		CFIndex linesCount = metrics->lineCount;
 		
 		// If the incremental value is less than 0 and the line index
 		// is 0, the index doesn't change.
@@ -123,9 +125,7 @@ static NSAttributedString *killBuffer = nil;
 			// If the line index is within text bounds after increment,
 			// return the real character index.
 		} else if(lineIndex + incr >= 0) {
-			CFIndex index;
-			AB_CTFrameGetIndexForPositionInLine(TEXT, [self ctFrame], lineIndex + incr, xPosition, &index);
-			return index;
+			return AB_CTFrameMetricsGetIndexForPositionInLine(metrics, lineIndex + incr, xPosition);
 		}
 	}
 	
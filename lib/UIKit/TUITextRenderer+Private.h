@@ -1,11 +1,23 @@
 #import "TUITextRenderer.h"
 
+// Where text @p textHeight tall is laid out to align it in @p frame. The
+// size of a frame's text is rounded up, as AB_CTFrameGetSize() rounds it.
+extern CGRect TUITextRendererAlignedFrame(CGRect frame, CGFloat textHeight, TUITextVerticalAlignment verticalAlignment);
+
 @interface TUITextRenderer ()
 
 - (CTFramesetterRef)ctFramesetter;
 - (CTFrameRef)ctFrame;
 - (CGPathRef)ctPath;
+- (const AB_CTFrameMetrics *)ctFrameMetrics; // line metrics of -ctFrame, built on first use
 - (CFRange)_selectedRange;
+
+// With a virtualized layout, lays out the paragraphs which intersect a rect
+// (in the same space as -frame), or a range of the string and the lines
+// around it, so the line metrics cover them. Otherwise these do nothing.
+- (void)layOutRect:(CGRect)rect;
+- (void)layOutCharacterRange:(CFRange)range;
+
 - (void)_resetFramesetter;
 
 @end
@@ -40,6 +40,8 @@ typedef enum TUITextVerticalAlignment : NSUInteger {
 } TUITextVerticalAlignment;
 
 @protocol TUITextRendererDelegate;
+struct TUITextRendererDecorations;
+struct TUITextRendererActiveRanges;
 
 @interface TUITextRenderer : TUIResponder {
 	NSAttributedString *attributedString;
@@ -49,6 +51,13 @@ typedef enum TUITextVerticalAlignment : NSUInteger {
 	CTFramesetterRef _ct_framesetter;
 	CGPathRef _ct_path;
 	CTFrameRef _ct_frame;
+	AB_CTFrameMetrics *_ct_metrics;
+	struct TUITextRendererDecorations *_decorations; // background and pre-draw runs, with their rects
+	
+	NSMutableArray *_paragraphs; // laid out one by one when paragraphLayout is set
+	CGFloat _paragraphsWidth;
+	NSOperationQueue *_measurementQueue; // measures paragraphs a virtualized layout hasn't laid out
+	CGRect _visibleLayoutRect;
 	
 	CFIndex _selectionStart;
 	CFIndex _selectionEnd;
@@ -56,6 +65,7 @@ typedef enum TUITextVerticalAlignment : NSUInteger {
 	
 	__unsafe_unretained id<TUITextRendererDelegate> delegate;
 	id<ABActiveTextRange> hitRange;
+	struct TUITextRendererActiveRanges *_activeRanges; // the delegate's active ranges, indexed for hit testing
 	
 	CGSize shadowOffset;
 	CGFloat shadowBlur;
@@ -69,12 +79,15 @@ typedef enum TUITextVerticalAlignment : NSUInteger {
 		unsigned int drawMaskDragSelection:1;
 		unsigned int backgroundDrawingEnabled:1;
 		unsigned int preDrawBlocksEnabled:1;
+		unsigned int paragraphLayout:1;
+		unsigned int virtualizedLayout:1;
 		
 		unsigned int delegateActiveRangesForTextRenderer:1;
 		unsigned int delegateWillBecomeFirstResponder:1;
 		unsigned int delegateDidBecomeFirstResponder:1;
 		unsigned int delegateWillResignFirstResponder:1;
 		unsigned int delegateDidResignFirstResponder:1;
+		unsigned int delegateDidUpdateEstimatedSize:1;
 	} _flags;
 }
 
@@ -93,6 +106,19 @@ typedef enum TUITextVerticalAlignment : NSUInteger {
 @property (nonatomic, assign) BOOL backgroundDrawingEnabled; // default = NO
 @property (nonatomic, assign) BOOL preDrawBlocksEnabled; // default = NO
 
+// Lays out and draws only the paragraphs near what's being drawn, for
+// very long strings. Paragraphs further away only have an estimated
+// height until they're measured in the background, so -size is an
+// estimate too, and the delegate hears when it gets closer to the real
+// thing. Only works with TUITextVerticalAlignmentTop.
+@property (nonatomic, assign) BOOL virtualizedLayoutEnabled; // default = NO
+
+// With a virtualized layout, the part of the frame on screen, in the same
+// space as -frame. Paragraphs near it stay laid out when only part of it is
+// drawn, such as the caret blinking, rather than only those near what's
+// drawn. CGRectNull, the default, keeps just what's near the drawing.
+@property (nonatomic, assign) CGRect visibleLayoutRect;
+
 // Don't become first responder. This might be useful to you if
 // you'd like to disable the ability to select text while using the
 // text renderer. Allows the renderer to become "active" as a responder.
@@ -105,6 +131,12 @@ typedef enum TUITextVerticalAlignment : NSUInteger {
 - (CGSize)sizeConstrainedToWidth:(CGFloat)width numberOfLines:(NSUInteger)numberOfLines;
 - (void)reset;
 
+// Lets the renderer know part of its string was edited in place, so it
+// only has to lay out again the paragraphs touched by the edit, rather
+// than the whole string as after -reset. `range` is the edited range in
+// the string as it is now, and `delta` how much longer it got.
+- (void)invalidateLayoutInRange:(NSRange)range changeInLength:(NSInteger)delta;
+
 // The -drawingAttributedString method allows for direct access
 // to the string being drawn to the screen. For example, if the
 // text rendering control is secure, this string would then 
@@ -15,6 +15,7 @@
  */
 
 #import "TUITextRenderer.h"
+#import "TUITextRenderer+Private.h"
 #import "ABActiveRange.h"
 #import "TUIAttributedString.h"
 #import "TUICGAdditions.h"
@@ -24,6 +25,159 @@
 NSString *const TUITextRendererDidBecomeFirstResponder = @"TUITextRendererDidBecomeFirstResponder";
 NSString *const TUITextRendererDidResignFirstResponder = @"TUITextRendererDidResignFirstResponder";
 
+// paragraphs are laid out in frames this tall, so they always fit
+#define TUITextRendererParagraphHeight 1000000.0f
+
+// how far past what's drawn a virtualized layout keeps paragraphs laid out
+#define TUITextRendererVirtualizedLayoutMargin 512.0f
+
+// how long measuring paragraphs in the background goes between updates
+#define TUITextRendererMeasurementInterval 0.1
+
+static CTFrameRef TUITextRendererCreateParagraphFrame(NSAttributedString *attributedString, NSRange range, CGFloat width)
+{
+	CTFramesetterRef framesetter = CTFramesetterCreateWithAttributedString((__bridge CFAttributedStringRef)[attributedString attributedSubstringFromRange:range]);
+	CGMutablePathRef path = CGPathCreateMutable();
+	CGPathAddRect(path, NULL, CGRectMake(0, 0, width, TUITextRendererParagraphHeight));
+	CTFrameRef frame = CTFramesetterCreateFrame(framesetter, CFRangeMake(0, 0), path, NULL);
+	CGPathRelease(path);
+	CFRelease(framesetter);
+	return frame;
+}
+
+typedef struct TUITextRendererParagraphSize {
+	CGFloat width;
+	CGFloat height;
+	CGFloat trailingLeading;
+} TUITextRendererParagraphSize;
+
+static void TUITextRendererGetParagraphFrameSize(CTFrameRef frame, CGFloat *width, CGFloat *height, CGFloat *trailingLeading)
+{
+	*width = 0.0f;
+	*height = 0.0f;
+	*trailingLeading = 0.0f;
+	
+	NSArray *lines = (__bridge NSArray *)CTFrameGetLines(frame);
+	for(id line in lines) {
+		*width = MAX(*width, AB_CTLineGetSize((__bridge CTLineRef)line).width);
+	}
+	
+	CTLineRef lastLine = (__bridge CTLineRef)[lines lastObject];
+	if(lastLine != NULL) {
+		CGPoint lastLineOrigin;
+		CTFrameGetLineOrigins(frame, CFRangeMake([lines count] - 1, 1), &lastLineOrigin);
+		CGFloat ascent, descent;
+		CTLineGetTypographicBounds(lastLine, &ascent, &descent, trailingLeading);
+		*height = TUITextRendererParagraphHeight - lastLineOrigin.y + descent + *trailingLeading;
+	}
+}
+
+static CGSize TUITextRendererEstimatedParagraphSize(NSAttributedString *attributedString, NSRange range, CGFloat width)
+{
+	// Core Text's default font is Helvetica 12
+	CGFloat lineHeight = 15.0f;
+	CGFloat characterWidth = 6.0f;
+	CTFontRef font = (__bridge CTFontRef)[attributedString attribute:(id)kCTFontAttributeName atIndex:range.location effectiveRange:NULL];
+	if(font != NULL) {
+		lineHeight = CTFontGetAscent(font) + CTFontGetDescent(font) + CTFontGetLeading(font);
+		characterWidth = CTFontGetSize(font) / 2;
+	}
+	
+	CGFloat textWidth = range.length * characterWidth;
+	CGFloat lines = MAX(1.0f, ceil(textWidth / MAX(width, 1.0f)));
+	return CGSizeMake(MIN(textWidth, width), lines * lineHeight);
+}
+
+/*
+ The runs of the string with a background color or a pre-draw block, and
+ their rects, so drawing doesn't have to find them again every time. Built
+ from the line metrics, and thrown away with them.
+ */
+typedef struct TUITextRendererDecorationRun {
+	NSRange range;
+	CFTypeRef value; // retained
+	CFIndex rectIndex; // into rects
+	CFIndex rectCount;
+} TUITextRendererDecorationRun;
+
+typedef struct TUITextRendererDecorations {
+	NSRange range; // of the string the runs were found in
+	CFIndex preDrawBlockRunCount; // runs[0 ..< preDrawBlockRunCount]
+	CFIndex backgroundRunCount; // the runs after them
+	TUITextRendererDecorationRun *runs;
+	CGRect *rects;
+} TUITextRendererDecorations;
+
+static void TUITextRendererDecorationsRelease(TUITextRendererDecorations *decorations)
+{
+	for(CFIndex i = 0; i < decorations->preDrawBlockRunCount + decorations->backgroundRunCount; i++) {
+		CFRelease(decorations->runs[i].value);
+	}
+	free(decorations->runs);
+	free(decorations->rects);
+	free(decorations);
+}
+
+CGRect TUITextRendererAlignedFrame(CGRect frame, CGFloat textHeight, TUITextVerticalAlignment verticalAlignment)
+{
+	// TUITextVerticalAlignmentTop is easy since that's how Core Text always draws. For Middle and Bottom we have to shift the CTFrame down.
+	if(verticalAlignment == TUITextVerticalAlignmentTop)
+		return frame;
+	
+	CGRect effectiveFrame = frame;
+	if(verticalAlignment == TUITextVerticalAlignmentMiddle) {
+		effectiveFrame.origin.y = textHeight/2 - frame.size.height/2;
+	} else if(verticalAlignment == TUITextVerticalAlignmentBottom) {
+		effectiveFrame.origin.y = textHeight;
+	}
+	return CGRectIntegral(effectiveFrame);
+}
+
+/*
+ One paragraph of a renderer's string, laid out on its own so an edit
+ only has to lay out again the paragraphs it touched. With a virtualized
+ layout, only paragraphs near what's drawn are laid out, and the rest
+ just know their height, estimated at first and measured later.
+ */
+@interface TUITextRendererParagraph : NSObject {
+@public
+	NSRange _range;
+	CTFrameRef _frame; // NULL if not laid out
+	BOOL _measured; // whether the size is known, or _height is an estimate
+	CGFloat _top; // from the top of the renderer's frame
+	CGFloat _height; // to the top of the next paragraph
+	CGFloat _width; // of the widest line
+	CGFloat _trailingLeading; // of the last line, not counted in the renderer's size
+}
+@end
+
+@implementation TUITextRendererParagraph
+
+- (void)layOutWithAttributedString:(NSAttributedString *)attributedString width:(CGFloat)width
+{
+	if(_frame)
+		return;
+	
+	_frame = TUITextRendererCreateParagraphFrame(attributedString, _range, width);
+	TUITextRendererGetParagraphFrameSize(_frame, &_width, &_height, &_trailingLeading);
+	_measured = YES;
+}
+
+- (void)discardLayout
+{
+	if(_frame) {
+		CFRelease(_frame);
+		_frame = NULL;
+	}
+}
+
+- (void)dealloc
+{
+	[self discardLayout];
+}
+
+@end
+
 @interface TUITextRenderer ()
 @property (nonatomic, strong) NSMutableDictionary *lineRects;
 @end
@@ -39,9 +193,11 @@ NSString *const TUITextRendererDidResignFirstResponder = @"TUITextRendererDidRes
 @synthesize shadowBlur;
 @synthesize verticalAlignment;
 @synthesize lineRects;
+@synthesize visibleLayoutRect = _visibleLayoutRect;
 
 - (void)_resetFrame
 {
+	[self _resetMetrics];
 	if(_ct_frame) {
 		CFRelease(_ct_frame);
 		_ct_frame = NULL;
@@ -50,8 +206,6 @@ NSString *const TUITextRendererDidResignFirstResponder = @"TUITextRendererDidRes
 		CGPathRelease(_ct_path);
 		_ct_path = NULL;
 	}
-	
-	lineRects = nil;
 }
 
 - (void)_resetFramesetter
@@ -60,6 +214,8 @@ NSString *const TUITextRendererDidResignFirstResponder = @"TUITextRendererDidRes
 		CFRelease(_ct_framesetter);
 		_ct_framesetter = NULL;
 	}
+	_paragraphs = nil;
+	[_measurementQueue cancelAllOperations];
 	
 	[self _resetFrame];
 }
@@ -67,6 +223,7 @@ NSString *const TUITextRendererDidResignFirstResponder = @"TUITextRendererDidRes
 - (id)init {
 	if((self = [super init])) {
 		self.selectionColor = [NSColor selectedTextBackgroundColor];
+		_visibleLayoutRect = CGRectNull;
 	}
 	
 	return self;
@@ -74,6 +231,7 @@ NSString *const TUITextRendererDidResignFirstResponder = @"TUITextRendererDidRes
 
 - (void)dealloc
 {
+	[_measurementQueue cancelAllOperations];
 	[self _resetFramesetter];
 }
 
@@ -91,20 +249,9 @@ NSString *const TUITextRendererDidResignFirstResponder = @"TUITextRendererDidRes
 	if(!_ct_path) {
 		[self _buildFrameWithEffectiveFrame:frame];
 		
-		// TUITextVerticalAlignmentTop is easy since that's how Core Text always draws. For Middle and Bottom we have to shift the CTFrame down.
 		if(verticalAlignment != TUITextVerticalAlignmentTop) {
-			CGRect effectiveFrame = frame;
-			
 			CGSize size = AB_CTFrameGetSize(_ct_frame);
-			if(verticalAlignment == TUITextVerticalAlignmentMiddle) {
-				effectiveFrame.origin.y = size.height/2 - frame.size.height/2;
-			} else if(verticalAlignment == TUITextVerticalAlignmentBottom) {
-				effectiveFrame.origin.y = size.height;
-			}
-			
-			effectiveFrame = CGRectIntegral(effectiveFrame);
-			
-			[self _buildFrameWithEffectiveFrame:effectiveFrame];
+			[self _buildFrameWithEffectiveFrame:TUITextRendererAlignedFrame(frame, size.height, verticalAlignment)];
 		}
 	}
 }
@@ -136,6 +283,444 @@ NSString *const TUITextRendererDidResignFirstResponder = @"TUITextRendererDidRes
 	return _ct_path;
 }
 
+- (const AB_CTFrameMetrics *)ctFrameMetrics
+{
+	if([self _usesParagraphLayout]) {
+		[self _buildParagraphs];
+		if(!_ct_metrics) {
+			_ct_metrics = [self _createParagraphMetrics];
+		}
+		return _ct_metrics;
+	}
+	
+	[self _buildFramesetter];
+	if(!_ct_metrics) {
+		_ct_metrics = AB_CTFrameMetricsCreate(_ct_frame);
+	}
+	return _ct_metrics;
+}
+
+#pragma mark Paragraph Layout
+
+- (BOOL)_usesParagraphLayout
+{
+	// Core Text only aligns a whole frame vertically
+	return (_flags.paragraphLayout || _flags.virtualizedLayout) && verticalAlignment == TUITextVerticalAlignmentTop;
+}
+
+- (BOOL)_usesVirtualizedLayout
+{
+	return _flags.virtualizedLayout && verticalAlignment == TUITextVerticalAlignmentTop;
+}
+
+- (NSArray *)_paragraphsInRange:(NSRange)range ofString:(NSAttributedString *)string
+{
+	BOOL virtualized = [self _usesVirtualizedLayout];
+	CGFloat width = frame.size.width;
+	
+	NSMutableArray *paragraphs = [NSMutableArray array];
+	NSString *text = [string string];
+	NSUInteger location = range.location;
+	while(location < NSMaxRange(range)) {
+		TUITextRendererParagraph *paragraph = [[TUITextRendererParagraph alloc] init];
+		paragraph->_range = [text paragraphRangeForRange:NSMakeRange(location, 0)];
+		if(virtualized) {
+			CGSize size = TUITextRendererEstimatedParagraphSize(string, paragraph->_range, width);
+			paragraph->_width = size.width;
+			paragraph->_height = size.height;
+		} else {
+			[paragraph layOutWithAttributedString:string width:width];
+		}
+		[paragraphs addObject:paragraph];
+		location = NSMaxRange(paragraph->_range);
+	}
+	
+	if(virtualized)
+		[self _measureParagraphsInBackground:paragraphs];
+	return paragraphs;
+}
+
+- (void)_stackParagraphs
+{
+	CGFloat top = 0.0f;
+	for(TUITextRendererParagraph *paragraph in _paragraphs) {
+		paragraph->_top = top;
+		top += paragraph->_height;
+	}
+}
+
+- (void)_resetMetrics
+{
+	// metrics point into the paragraphs' frames, and know where they were stacked
+	if(_ct_metrics) {
+		AB_CTFrameMetricsRelease(_ct_metrics);
+		_ct_metrics = NULL;
+	}
+	[self _resetDecorations];
+	[self invalidateActiveRanges];
+	lineRects = nil;
+}
+
+- (void)_resetDecorations
+{
+	if(_decorations) {
+		TUITextRendererDecorationsRelease(_decorations);
+		_decorations = NULL;
+	}
+}
+
+- (TUITextRendererDecorations *)_decorationsInRange:(NSRange)range
+{
+	if(_decorations && NSEqualRanges(_decorations->range, range))
+		return _decorations;
+	
+	[self _resetDecorations];
+	
+	NSAttributedString *string = self.drawingAttributedString;
+	const AB_CTFrameMetrics *metrics = [self ctFrameMetrics];
+	
+	__block CFIndex runCount = 0;
+	__block CFIndex runCapacity = 8;
+	__block CFIndex rectCount = 0;
+	__block CFIndex rectCapacity = 32;
+	__block TUITextRendererDecorationRun *runs = (TUITextRendererDecorationRun *) malloc(sizeof(TUITextRendererDecorationRun) * runCapacity);
+	__block CGRect *rects = (CGRect *) malloc(sizeof(CGRect) * rectCapacity);
+	
+	void (^addRuns)(NSString *) = ^(NSString *attributeName) {
+		[string enumerateAttribute:attributeName inRange:range options:0 usingBlock:^(id value, NSRange runRange, BOOL *stop) {
+			if(value == nil) return;
+			
+			if(runCount == runCapacity) {
+				runCapacity *= 2;
+				runs = (TUITextRendererDecorationRun *) realloc(runs, sizeof(TUITextRendererDecorationRun) * runCapacity);
+			}
+			// as many rects as rectsForCharacterRange: would find
+			if(rectCapacity - rectCount < 100) {
+				rectCapacity = MAX(rectCapacity * 2, rectCount + 100);
+				rects = (CGRect *) realloc(rects, sizeof(CGRect) * rectCapacity);
+			}
+			
+			AB_CTLineRectAggregationType aggregationType = (AB_CTLineRectAggregationType) [[string attribute:TUIAttributedStringBackgroundFillStyleName atIndex:runRange.location effectiveRange:NULL] integerValue];
+			CFIndex runRectCount = 100;
+			AB_CTFrameMetricsGetRectsForRangeWithAggregationType(metrics, CFRangeMake(runRange.location, runRange.length), aggregationType, rects + rectCount, &runRectCount);
+			
+			runs[runCount].range = runRange;
+			runs[runCount].value = CFBridgingRetain(value);
+			runs[runCount].rectIndex = rectCount;
+			runs[runCount].rectCount = runRectCount;
+			runCount++;
+			rectCount += runRectCount;
+		}];
+	};
+	
+	TUITextRendererDecorations *decorations = (TUITextRendererDecorations *) malloc(sizeof(TUITextRendererDecorations));
+	decorations->range = range;
+	
+	if(_flags.preDrawBlocksEnabled)
+		addRuns(TUIAttributedStringPreDrawBlockName);
+	decorations->preDrawBlockRunCount = runCount;
+	
+	if(_flags.backgroundDrawingEnabled)
+		addRuns(TUIAttributedStringBackgroundColorAttributeName);
+	decorations->backgroundRunCount = runCount - decorations->preDrawBlockRunCount;
+	
+	decorations->runs = runs;
+	decorations->rects = rects;
+	_decorations = decorations;
+	return decorations;
+}
+
+- (void)_buildParagraphs
+{
+	if(_paragraphs != nil && _paragraphsWidth == frame.size.width)
+		return;
+	
+	// whatever is being measured belongs to the old paragraphs
+	[_measurementQueue cancelAllOperations];
+	
+	NSAttributedString *string = self.drawingAttributedString;
+	_paragraphsWidth = frame.size.width;
+	_paragraphs = [[self _paragraphsInRange:NSMakeRange(0, [string length]) ofString:string] mutableCopy];
+	[self _stackParagraphs];
+	[self _resetMetrics];
+}
+
+// the first paragraph which ends at or after index
+- (NSUInteger)_indexOfParagraphAtStringIndex:(NSUInteger)index
+{
+	NSUInteger first = 0;
+	NSUInteger last = [_paragraphs count];
+	while(first < last) {
+		NSUInteger mid = first + (last - first) / 2;
+		TUITextRendererParagraph *paragraph = [_paragraphs objectAtIndex:mid];
+		if(NSMaxRange(paragraph->_range) >= index) {
+			last = mid;
+		} else {
+			first = mid + 1;
+		}
+	}
+	return first;
+}
+
+// the first paragraph which ends below offset, measured down from the top of the frame
+- (NSUInteger)_indexOfParagraphAtOffset:(CGFloat)offset
+{
+	NSUInteger first = 0;
+	NSUInteger last = [_paragraphs count];
+	while(first < last) {
+		NSUInteger mid = first + (last - first) / 2;
+		TUITextRendererParagraph *paragraph = [_paragraphs objectAtIndex:mid];
+		if(paragraph->_top + paragraph->_height > offset) {
+			last = mid;
+		} else {
+			first = mid + 1;
+		}
+	}
+	return first;
+}
+
+/*
+ Lays out the paragraphs in `indexes` which start above `bottom`, an
+ offset down from the top of the frame, moving the paragraphs after them
+ if their estimated heights were off.
+ */
+- (void)_layOutParagraphsInRange:(NSRange)indexes aboveOffset:(CGFloat)bottom
+{
+	NSAttributedString *string = self.drawingAttributedString;
+	NSUInteger count = [_paragraphs count];
+	BOOL laidOut = NO;
+	BOOL moved = NO;
+	CGFloat top = (indexes.location < count) ? ((TUITextRendererParagraph *)[_paragraphs objectAtIndex:indexes.location])->_top : 0.0f;
+	
+	for(NSUInteger i = indexes.location; i < count; i++) {
+		BOOL inRange = (i < NSMaxRange(indexes) && top < bottom);
+		if(!inRange && !moved)
+			break;
+		
+		TUITextRendererParagraph *paragraph = [_paragraphs objectAtIndex:i];
+		paragraph->_top = top;
+		if(inRange && paragraph->_frame == NULL) {
+			CGFloat estimatedHeight = paragraph->_height;
+			[paragraph layOutWithAttributedString:string width:_paragraphsWidth];
+			moved = moved || (paragraph->_height != estimatedHeight);
+			laidOut = YES;
+		}
+		top += paragraph->_height;
+	}
+	
+	if(laidOut)
+		[self _resetMetrics];
+}
+
+- (void)layOutRect:(CGRect)rect
+{
+	if(![self _usesVirtualizedLayout])
+		return;
+	
+	[self _buildParagraphs];
+	CGFloat top = CGRectGetMaxY(frame) - CGRectGetMaxY(rect);
+	CGFloat bottom = CGRectGetMaxY(frame) - CGRectGetMinY(rect);
+	NSUInteger first = [self _indexOfParagraphAtOffset:top];
+	[self _layOutParagraphsInRange:NSMakeRange(first, [_paragraphs count] - first) aboveOffset:bottom];
+}
+
+- (void)layOutCharacterRange:(CFRange)range
+{
+	if(![self _usesVirtualizedLayout])
+		return;
+	
+	[self _buildParagraphs];
+	NSUInteger count = [_paragraphs count];
+	if(count == 0)
+		return;
+	
+	// along with a paragraph on either side, so there's always a line to move to
+	NSUInteger first = [self _indexOfParagraphAtStringIndex:range.location];
+	NSUInteger last = [self _indexOfParagraphAtStringIndex:range.location + range.length];
+	first = (first > 0) ? first - 1 : 0;
+	last = MIN(last + 1, count - 1);
+	[self _layOutParagraphsInRange:NSMakeRange(first, last + 1 - first) aboveOffset:CGFLOAT_MAX];
+}
+
+- (NSRange)_stringRangeOfParagraphsInRect:(CGRect)rect
+{
+	NSUInteger count = [_paragraphs count];
+	NSUInteger first = [self _indexOfParagraphAtOffset:CGRectGetMaxY(frame) - CGRectGetMaxY(rect)];
+	NSUInteger last = [self _indexOfParagraphAtOffset:CGRectGetMaxY(frame) - CGRectGetMinY(rect)];
+	if(first >= count)
+		return NSMakeRange([self.drawingAttributedString length], 0);
+	
+	NSRange firstRange = ((TUITextRendererParagraph *)[_paragraphs objectAtIndex:first])->_range;
+	NSRange lastRange = ((TUITextRendererParagraph *)[_paragraphs objectAtIndex:MIN(last, count - 1)])->_range;
+	return NSUnionRange(firstRange, lastRange);
+}
+
+- (void)_discardLayoutOutsideRect:(CGRect)rect
+{
+	CGFloat top = CGRectGetMaxY(frame) - CGRectGetMaxY(rect);
+	CGFloat bottom = CGRectGetMaxY(frame) - CGRectGetMinY(rect);
+	BOOL discarded = NO;
+	for(TUITextRendererParagraph *paragraph in _paragraphs) {
+		if(paragraph->_frame != NULL && (paragraph->_top + paragraph->_height <= top || paragraph->_top >= bottom)) {
+			[paragraph discardLayout];
+			discarded = YES;
+		}
+	}
+	
+	if(discarded)
+		[self _resetMetrics];
+}
+
+- (void)_measureParagraphsInBackground:(NSArray *)paragraphs
+{
+	if([paragraphs count] == 0)
+		return;
+	
+	if(_measurementQueue == nil) {
+		_measurementQueue = [[NSOperationQueue alloc] init];
+		_measurementQueue.maxConcurrentOperationCount = 1;
+	}
+	
+	// the string and the paragraphs' ranges change as it's edited, so measure a snapshot
+	paragraphs = [paragraphs copy];
+	NSUInteger count = [paragraphs count];
+	NSRange snapshotRange = NSUnionRange(((TUITextRendererParagraph *)[paragraphs objectAtIndex:0])->_range, ((TUITextRendererParagraph *)[paragraphs lastObject])->_range);
+	NSAttributedString *string = [self.drawingAttributedString attributedSubstringFromRange:snapshotRange];
+	CGFloat width = frame.size.width;
+	NSMutableData *rangesData = [NSMutableData dataWithLength:sizeof(NSRange) * count];
+	NSRange *ranges = (NSRange *)[rangesData mutableBytes];
+	for(NSUInteger i = 0; i < count; i++) {
+		ranges[i] = ((TUITextRendererParagraph *)[paragraphs objectAtIndex:i])->_range;
+		ranges[i].location -= snapshotRange.location;
+	}
+	
+	__weak TUITextRenderer *weakSelf = self;
+	NSBlockOperation *operation = [[NSBlockOperation alloc] init];
+	__weak NSBlockOperation *weakOperation = operation;
+	[operation addExecutionBlock:^{
+		const NSRange *paragraphRanges = (const NSRange *)[rangesData bytes];
+		NSUInteger batchStart = 0;
+		CFAbsoluteTime batchTime = CFAbsoluteTimeGetCurrent();
+		NSMutableData *batch = [NSMutableData data];
+		
+		for(NSUInteger i = 0; i < count && ![weakOperation isCancelled]; i++) {
+			TUITextRendererParagraphSize size;
+			CTFrameRef paragraphFrame = TUITextRendererCreateParagraphFrame(string, paragraphRanges[i], width);
+			TUITextRendererGetParagraphFrameSize(paragraphFrame, &size.width, &size.height, &size.trailingLeading);
+			CFRelease(paragraphFrame);
+			[batch appendBytes:&size length:sizeof(size)];
+			
+			// hand sizes over every so often, rather than moving text around for each one
+			CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+			if(i + 1 == count || now - batchTime >= TUITextRendererMeasurementInterval) {
+				NSArray *measuredParagraphs = [paragraphs subarrayWithRange:NSMakeRange(batchStart, i + 1 - batchStart)];
+				NSData *sizes = batch;
+				dispatch_async(dispatch_get_main_queue(), ^{
+					[weakSelf _didMeasureParagraphs:measuredParagraphs sizes:(const TUITextRendererParagraphSize *)[sizes bytes]];
+				});
+				batch = [NSMutableData data];
+				batchStart = i + 1;
+				batchTime = now;
+			}
+		}
+	}];
+	[_measurementQueue addOperation:operation];
+}
+
+- (void)_didMeasureParagraphs:(NSArray *)paragraphs sizes:(const TUITextRendererParagraphSize *)sizes
+{
+	BOOL moved = NO;
+	NSUInteger i = 0;
+	for(TUITextRendererParagraph *paragraph in paragraphs) {
+		// skip those laid out since; those replaced by an edit don't matter
+		if(!paragraph->_measured) {
+			moved = moved || (paragraph->_height != sizes[i].height);
+			paragraph->_width = sizes[i].width;
+			paragraph->_height = sizes[i].height;
+			paragraph->_trailingLeading = sizes[i].trailingLeading;
+			paragraph->_measured = YES;
+		}
+		i++;
+	}
+	
+	if(!moved)
+		return;
+	
+	[self _stackParagraphs];
+	[self _resetMetrics];
+	[view setNeedsDisplay];
+	
+	if(_flags.delegateDidUpdateEstimatedSize)
+		[delegate textRendererDidUpdateEstimatedSize:self];
+}
+
+- (AB_CTFrameMetrics *)_createParagraphMetrics
+{
+	CFIndex count = [_paragraphs count];
+	CTFrameRef *frames = (CTFrameRef *) malloc(sizeof(CTFrameRef) * MAX(count, 1));
+	CGPoint *offsets = (CGPoint *) malloc(sizeof(CGPoint) * MAX(count, 1));
+	CFIndex *stringOffsets = (CFIndex *) malloc(sizeof(CFIndex) * MAX(count, 1));
+	
+	// paragraphs a virtualized layout hasn't laid out have no lines
+	CFIndex i = 0;
+	for(TUITextRendererParagraph *paragraph in _paragraphs) {
+		if(paragraph->_frame == NULL)
+			continue;
+		frames[i] = paragraph->_frame;
+		offsets[i] = CGPointMake(0.0f, frame.size.height - paragraph->_top - TUITextRendererParagraphHeight);
+		stringOffsets[i] = paragraph->_range.location;
+		i++;
+	}
+	
+	TUITextRendererParagraph *lastParagraph = [_paragraphs lastObject];
+	CFRange stringRange = CFRangeMake(0, lastParagraph ? NSMaxRange(lastParagraph->_range) : 0);
+	AB_CTFrameMetrics *metrics = AB_CTFrameMetricsCreateWithFrames(frames, offsets, stringOffsets, i, frame, stringRange);
+	
+	free(frames);
+	free(offsets);
+	free(stringOffsets);
+	return metrics;
+}
+
+- (void)invalidateLayoutInRange:(NSRange)range changeInLength:(NSInteger)delta
+{
+	if(_paragraphs != nil) {
+		NSUInteger editStart = range.location;
+		NSUInteger editEnd = NSMaxRange(range) - delta; // in the string as it was
+		
+		// Paragraphs which touch the edit, even just at their ends, are laid out
+		// again, since the edit may have joined them or split them.
+		NSUInteger count = [_paragraphs count];
+		NSUInteger first = [self _indexOfParagraphAtStringIndex:editStart];
+		NSUInteger last = first;
+		while(last < count && ((TUITextRendererParagraph *)[_paragraphs objectAtIndex:last])->_range.location <= editEnd) {
+			last++;
+		}
+		
+		if(first < last) {
+			NSUInteger start = ((TUITextRendererParagraph *)[_paragraphs objectAtIndex:first])->_range.location;
+			NSUInteger end = NSMaxRange(((TUITextRendererParagraph *)[_paragraphs objectAtIndex:last - 1])->_range) + delta;
+			NSArray *paragraphs = [self _paragraphsInRange:NSMakeRange(start, end - start) ofString:self.drawingAttributedString];
+			[_paragraphs replaceObjectsInRange:NSMakeRange(first, last - first) withObjectsFromArray:paragraphs];
+			
+			// the paragraphs below just move
+			for(NSUInteger i = first + [paragraphs count]; i < [_paragraphs count]; i++) {
+				((TUITextRendererParagraph *)[_paragraphs objectAtIndex:i])->_range.location += delta;
+			}
+			[self _stackParagraphs];
+		} else {
+			// nothing laid out to touch, e.g. the string was empty
+			_paragraphs = nil;
+		}
+	}
+	
+	if(_ct_framesetter) {
+		CFRelease(_ct_framesetter);
+		_ct_framesetter = NULL;
+	}
+	[self _resetFrame];
+}
+
 - (CFIndex)_clampToValidRange:(CFIndex)index
 {
 	if(index < 0) return 0;
@@ -231,59 +816,52 @@ NSString *const TUITextRendererDidResignFirstResponder = @"TUITextRendererDidRes
 	if(attributedString) {
 		CGContextSaveGState(context);
 		
-		if(_flags.preDrawBlocksEnabled && !_flags.drawMaskDragSelection) {
-			[self.drawingAttributedString enumerateAttribute:TUIAttributedStringPreDrawBlockName inRange:NSMakeRange(0, [self.drawingAttributedString length]) options:0 usingBlock:^(id value, NSRange range, BOOL *stop) {
-				if(value == NULL) return;
-				
+		NSRange drawingRange = NSMakeRange(0, [self.drawingAttributedString length]);
+		CGRect layoutRect = CGRectNull;
+		if([self _usesVirtualizedLayout]) {
+			// lay out a little past what's drawn, so scrolling a bit doesn't have to
+			layoutRect = CGRectInset(CGContextGetClipBoundingBox(context), 0.0f, -TUITextRendererVirtualizedLayoutMargin);
+			[self layOutRect:layoutRect];
+			drawingRange = [self _stringRangeOfParagraphsInRect:layoutRect];
+		}
+		
+		if((_flags.preDrawBlocksEnabled || _flags.backgroundDrawingEnabled) && !_flags.drawMaskDragSelection) {
+			TUITextRendererDecorations *decorations = [self _decorationsInRange:drawingRange];
+			
+			for(CFIndex i = 0; i < decorations->preDrawBlockRunCount; i++) {
+				TUITextRendererDecorationRun *run = &decorations->runs[i];
 				CGContextSaveGState(context);
 				
-				AB_CTLineRectAggregationType aggregationType = (AB_CTLineRectAggregationType) [[self.drawingAttributedString attribute:TUIAttributedStringBackgroundFillStyleName atIndex:range.location effectiveRange:NULL] integerValue];
-				NSArray *rectsArray = [self rectsForCharacterRange:CFRangeMake(range.location, range.length) aggregationType:aggregationType];
+				// the block gets its own copy of the rects to do with as it likes
+				CGRect rects[MAX(run->rectCount, 1)];
+				memcpy(rects, decorations->rects + run->rectIndex, sizeof(CGRect) * run->rectCount);
 				
-				CFIndex rectCount = rectsArray.count;
-				CGRect rects[rectCount];
-				for(NSUInteger i = 0; i < rectCount; i++) {
-					rects[i] = [[rectsArray objectAtIndex:i] rectValue];
-				}
+				TUIAttributedStringPreDrawBlock block = (__bridge TUIAttributedStringPreDrawBlock) run->value;
+				block(self.drawingAttributedString, run->range, rects, run->rectCount);
 				
-				TUIAttributedStringPreDrawBlock block = value;
-				block(self.drawingAttributedString, range, rects, rectCount);
-					
 				CGContextRestoreGState(context);
-			}];
-		}
-		
-		if(_flags.backgroundDrawingEnabled && !_flags.drawMaskDragSelection) {
-			CGContextSaveGState(context);
+			}
 			
-			[self.drawingAttributedString enumerateAttribute:TUIAttributedStringBackgroundColorAttributeName inRange:NSMakeRange(0, [self.drawingAttributedString length]) options:0 usingBlock:^(id value, NSRange range, BOOL *stop) {
-				if(value == NULL) return;
-				
-				CGColorRef color = (__bridge CGColorRef) value;
-				CGContextSetFillColorWithColor(context, color);
-				
-				AB_CTLineRectAggregationType aggregationType = (AB_CTLineRectAggregationType) [[self.drawingAttributedString attribute:TUIAttributedStringBackgroundFillStyleName atIndex:range.location effectiveRange:NULL] integerValue];
-				NSArray *rectsArray = [self rectsForCharacterRange:CFRangeMake(range.location, range.length) aggregationType:aggregationType];
+			if(decorations->backgroundRunCount > 0) {
+				CGContextSaveGState(context);
 				
-				CFIndex rectCount = rectsArray.count;
-				CGRect rects[rectCount];
-				for(NSUInteger i = 0; i < rectCount; i++) {
-					rects[i] = [[rectsArray objectAtIndex:i] rectValue];
+				for(CFIndex i = decorations->preDrawBlockRunCount; i < decorations->preDrawBlockRunCount + decorations->backgroundRunCount; i++) {
+					TUITextRendererDecorationRun *run = &decorations->runs[i];
+					CGContextSetFillColorWithColor(context, (CGColorRef) run->value);
+					
+					for(CFIndex j = 0; j < run->rectCount; ++j) {
+						CGRect r = decorations->rects[run->rectIndex + j];
+						r = CGRectInset(r, -2, -1);
+						r = CGRectIntegral(r);
+						if(r.size.width > 1)
+							CGContextFillRect(context, r);
+					}
 				}
 				
-				for(CFIndex i = 0; i < rectCount; ++i) {
-					CGRect r = rects[i];
-					r = CGRectInset(r, -2, -1);
-					r = CGRectIntegral(r);
-					if(r.size.width > 1)
-						CGContextFillRect(context, r);
-				}
-			}];
-			
-			CGContextRestoreGState(context);
+				CGContextRestoreGState(context);
+			}
 		}
 		
-		CTFrameRef f = [self ctFrame];
 		if(hitRange && !_flags.drawMaskDragSelection) {
 			// draw highlight
 			CGContextSaveGState(context);
@@ -292,7 +870,7 @@ NSString *const TUITextRendererDidResignFirstResponder = @"TUITextRendererDidRes
 			CFRange r = {_r.location, _r.length};
 			CFIndex nRects = 10;
 			CGRect rects[nRects];
-			AB_CTFrameGetRectsForRange(f, r, rects, &nRects);
+			AB_CTFrameMetricsGetRectsForRangeWithAggregationType([self ctFrameMetrics], r, AB_CTLineRectAggregationTypeInline, rects, &nRects);
 			for(int i = 0; i < nRects; ++i) {
 				CGRect rect = rects[i];
 				rect = CGRectInset(rect, -2, -1);
@@ -315,7 +893,7 @@ NSString *const TUITextRendererDidResignFirstResponder = @"TUITextRendererDidRes
 			// draw (or mask) selection
 			CFIndex rectCount = 100;
 			CGRect rects[rectCount];
-			AB_CTFrameGetRectsForRange(f, selectedRange, rects, &rectCount);
+			AB_CTFrameMetricsGetRectsForRangeWithAggregationType([self ctFrameMetrics], selectedRange, AB_CTLineRectAggregationTypeInline, rects, &rectCount);
 			if(_flags.drawMaskDragSelection) {
 				CGContextClipToRects(context, rects, rectCount);
 			} else {
@@ -327,7 +905,42 @@ NSString *const TUITextRendererDidResignFirstResponder = @"TUITextRendererDidRes
 			CGContextSetShadowWithColor(context, shadowOffset, shadowBlur, shadowColor.CGColor);
 		
 		CGContextSetTextMatrix(context, CGAffineTransformIdentity);
-		CTFrameDraw(f, context);
+		[self _drawTextInContext:context];
+		CGContextRestoreGState(context);
+		
+		if(!CGRectIsNull(layoutRect)) {
+			// a partial redraw doesn't throw away what's on screen around it
+			CGRect keptRect = layoutRect;
+			if(!CGRectIsNull(_visibleLayoutRect))
+				keptRect = CGRectUnion(keptRect, CGRectInset(_visibleLayoutRect, 0.0f, -TUITextRendererVirtualizedLayoutMargin));
+			[self _discardLayoutOutsideRect:keptRect];
+		}
+	}
+}
+
+- (void)_drawTextInContext:(CGContextRef)context
+{
+	if(![self _usesParagraphLayout]) {
+		CTFrameDraw([self ctFrame], context);
+		return;
+	}
+	
+	[self _buildParagraphs];
+	
+	CGRect clip = CGContextGetClipBoundingBox(context);
+	CGFloat top = CGRectGetMaxY(frame);
+	NSUInteger count = [_paragraphs count];
+	for(NSUInteger i = [self _indexOfParagraphAtOffset:top - CGRectGetMaxY(clip)]; i < count; i++) {
+		TUITextRendererParagraph *paragraph = [_paragraphs objectAtIndex:i];
+		CGFloat paragraphTop = top - paragraph->_top;
+		if(paragraphTop < CGRectGetMinY(clip))
+			break; // and so is every paragraph after it
+		if(paragraph->_frame == NULL)
+			continue;
+		
+		CGContextSaveGState(context);
+		CGContextTranslateCTM(context, frame.origin.x, paragraphTop - TUITextRendererParagraphHeight);
+		CTFrameDraw(paragraph->_frame, context);
 		CGContextRestoreGState(context);
 	}
 }
@@ -345,6 +958,17 @@ NSString *const TUITextRendererDidResignFirstResponder = @"TUITextRendererDidRes
 - (CGSize)size
 {
 	if(attributedString) {
+		if([self _usesParagraphLayout]) {
+			[self _buildParagraphs];
+			
+			CGFloat w = 0.0f;
+			for(TUITextRendererParagraph *paragraph in _paragraphs) {
+				w = MAX(w, paragraph->_width);
+			}
+			TUITextRendererParagraph *lastParagraph = [_paragraphs lastObject];
+			CGFloat h = lastParagraph ? lastParagraph->_top + lastParagraph->_height - lastParagraph->_trailingLeading : 0.0f;
+			return CGSizeMake(ceil(w), ceil(h));
+		}
 		return AB_CTFrameGetSize([self ctFrame]);
 	}
 	return CGSizeZero;
@@ -397,7 +1021,8 @@ NSString *const TUITextRendererDidResignFirstResponder = @"TUITextRendererDidRes
 {
 	CFIndex rectCount = 1;
 	CGRect rects[rectCount];
-	AB_CTFrameGetRectsForRange([self ctFrame], range, rects, &rectCount);
+	[self layOutCharacterRange:CFRangeMake(range.location, 0)];
+	AB_CTFrameMetricsGetRectsForRangeWithAggregationType([self ctFrameMetrics], range, AB_CTLineRectAggregationTypeInline, rects, &rectCount);
 	if(rectCount > 0) {
 		return rects[0];
 	}
@@ -420,7 +1045,7 @@ NSString *const TUITextRendererDidResignFirstResponder = @"TUITextRendererDidRes
 	if(cachedRects == nil) {
 		CFIndex rectCount = 100;
 		CGRect rects[rectCount];
-		AB_CTFrameGetRectsForRangeWithAggregationType([self ctFrame], range, aggregationType, rects, &rectCount);
+		AB_CTFrameMetricsGetRectsForRangeWithAggregationType([self ctFrameMetrics], range, aggregationType, rects, &rectCount);
 		
 		NSMutableArray *wrappedRects = [NSMutableArray arrayWithCapacity:rectCount];
 		for(CFIndex i = 0; i < rectCount; i++) {
@@ -442,6 +1067,7 @@ NSString *const TUITextRendererDidResignFirstResponder = @"TUITextRendererDidRes
 - (void)setBackgroundDrawingEnabled:(BOOL)enabled
 {
 	_flags.backgroundDrawingEnabled = enabled;
+	[self _resetDecorations];
 }
 
 - (BOOL)preDrawBlocksEnabled
@@ -452,6 +1078,20 @@ NSString *const TUITextRendererDidResignFirstResponder = @"TUITextRendererDidRes
 - (void)setPreDrawBlocksEnabled:(BOOL)enabled
 {
 	_flags.preDrawBlocksEnabled = enabled;
+	[self _resetDecorations];
+}
+
+- (BOOL)virtualizedLayoutEnabled
+{
+	return _flags.virtualizedLayout;
+}
+
+- (void)setVirtualizedLayoutEnabled:(BOOL)enabled
+{
+	if(_flags.virtualizedLayout == enabled) return;
+	
+	_flags.virtualizedLayout = enabled;
+	[self _resetFramesetter];
 }
 
 - (void)setVerticalAlignment:(TUITextVerticalAlignment)alignment
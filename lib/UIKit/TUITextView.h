@@ -36,8 +36,11 @@
 	BOOL editable;
 	
 	BOOL spellCheckingEnabled;
-	NSInteger lastCheckToken;
-	NSArray *lastCheckResults;
+	NSMutableIndexSet *_uncheckedIndexes; // edited since spelling was last checked
+	NSMutableArray *_pendingSpellingRequests;
+	NSCache *_checkingResultsCache; // paragraph -> results, relative to the paragraph
+	NSTimeInterval _lastEditTime;
+	NSTimeInterval _typingInterval; // average time between edits while typing
 	NSTextCheckingResult *selectedTextCheckingResult;
 	BOOL autocorrectionEnabled;
 	NSMutableDictionary *autocorrectedResults;
@@ -48,6 +51,8 @@
 	TUIView *cursor;
 	
 	CGRect _lastTextRect;
+	TUIView *_viewport; // draws a virtualized layout, over what's on screen
+	NSHashTable *_observedScrollViews;
 	
 	struct {
 		unsigned int delegateTextViewDidChange:1;
@@ -56,6 +61,7 @@
 		unsigned int delegateDidBecomeFirstResponder:1;
 		unsigned int delegateWillResignFirstResponder:1;
 		unsigned int delegateDidResignFirstResponder:1;
+		unsigned int delegateDidUpdateEstimatedSize:1;
 	} _textViewFlags;
 }
 
@@ -77,6 +83,13 @@
 @property (nonatomic, assign, getter=isSpellCheckingEnabled) BOOL spellCheckingEnabled;
 @property (nonatomic, assign, getter=isAutocorrectionEnabled) BOOL autocorrectionEnabled;
 
+// For very long text. Only the text on screen, as clipped by any scroll
+// views the text view is in, is laid out and drawn, into a bitmap covering
+// just that and a margin around it, which follows the scroll views as they
+// scroll. The size of the rest is estimated until it has been measured in
+// the background. See -textViewDidUpdateEstimatedSize:.
+@property (nonatomic, assign, getter=isVirtualizedLayoutEnabled) BOOL virtualizedLayoutEnabled; // default = NO
+
 @property (nonatomic, copy) TUIViewDrawRect drawFrame;
 
 - (BOOL)hasText;
@@ -98,6 +111,10 @@
 - (void)textViewWillResignFirstResponder:(TUITextView *)textView;
 - (void)textViewDidResignFirstResponder:(TUITextView *)textView;
 
+// With a virtualized layout, sent when more of the text has been measured
+// and -sizeThatFits: changed. A good time to resize the text view.
+- (void)textViewDidUpdateEstimatedSize:(TUITextView *)textView;
+
 @end
 
 
@@ -18,8 +18,18 @@
 #import "TUICGAdditions.h"
 #import "TUINSView.h"
 #import "TUINSWindow.h"
+#import "TUIScrollView.h"
 #import "TUITextViewEditor.h"
 
+// how far past what's on screen a virtualized layout draws
+#define TUITextViewVirtualizedDrawingMargin 256.0f
+
+// Spelling is checked once typing pauses for a few times as long as it
+// usually does between keystrokes, within these bounds.
+#define TUITextViewSpellCheckingDelayFactor 2.0
+#define TUITextViewMinimumSpellCheckingDelay 0.1
+#define TUITextViewMaximumSpellCheckingDelay 1.0
+
 @interface TUITextViewAutocorrectedPair : NSObject <NSCopying> {
 	NSTextCheckingResult *correctionResult;
 	NSString *originalString;
@@ -52,12 +62,21 @@
 }
 @end
 
-@interface TUITextView () <TUITextRendererDelegate>
+// A paragraph sent to the spell checker, followed through edits made while it's being checked.
+@interface TUITextViewSpellingRequest : NSObject
+@property (nonatomic, copy) NSString *paragraph;
+@property (nonatomic, assign) NSRange range;
+@property (nonatomic, assign, getter=isCancelled) BOOL cancelled; // edited while being checked
+@end
+
+@implementation TUITextViewSpellingRequest
+@end
+
+@interface TUITextView () <TUITextRendererDelegate, TUIScrollViewObserver>
 - (void)_checkSpelling;
 - (void)_replaceMisspelledWord:(NSMenuItem *)menuItem;
 - (CGRect)_cursorRect;
 
-@property (nonatomic, strong) NSArray *lastCheckResults;
 @property (nonatomic, strong) NSTextCheckingResult *selectedTextCheckingResult;
 @property (nonatomic, strong) NSMutableDictionary *autocorrectedResults;
 @property (nonatomic, strong) TUITextRenderer *placeholderRenderer;
@@ -74,7 +93,6 @@
 @synthesize contentInset;
 @synthesize placeholder;
 @synthesize spellCheckingEnabled;
-@synthesize lastCheckResults;
 @synthesize selectedTextCheckingResult;
 @synthesize autocorrectionEnabled;
 @synthesize autocorrectedResults;
@@ -87,6 +105,8 @@
 }
 
 - (void)dealloc {
+	for(TUIScrollView *scrollView in _observedScrollViews)
+		[scrollView removeScrollObserver:self];
 	renderer.delegate = nil;
 }
 
@@ -194,6 +214,138 @@
 	_textViewFlags.delegateDidBecomeFirstResponder = [delegate respondsToSelector:@selector(textViewDidBecomeFirstResponder:)];
 	_textViewFlags.delegateWillResignFirstResponder = [delegate respondsToSelector:@selector(textViewWillResignFirstResponder:)];
 	_textViewFlags.delegateDidResignFirstResponder = [delegate respondsToSelector:@selector(textViewDidResignFirstResponder:)];
+	_textViewFlags.delegateDidUpdateEstimatedSize = [delegate respondsToSelector:@selector(textViewDidUpdateEstimatedSize:)];
+}
+
+- (BOOL)isVirtualizedLayoutEnabled
+{
+	return renderer.virtualizedLayoutEnabled;
+}
+
+- (void)setVirtualizedLayoutEnabled:(BOOL)enabled
+{
+	if(renderer.virtualizedLayoutEnabled == enabled) return;
+	
+	renderer.virtualizedLayoutEnabled = enabled;
+	if(enabled) {
+		// The text view itself doesn't draw, so it has no bitmap the size of
+		// all the text. The viewport draws it instead, as the text view
+		// would, over just the part it covers.
+		__weak TUITextView *weakSelf = self;
+		_viewport = [[TUIView alloc] initWithFrame:CGRectZero];
+		_viewport.userInteractionEnabled = NO;
+		_viewport.opaque = NO;
+		_viewport.backgroundColor = [NSColor clearColor];
+		_viewport.drawRect = ^(TUIView *view, CGRect rect) {
+			CGPoint origin = view.frame.origin;
+			CGContextTranslateCTM(TUIGraphicsGetCurrentContext(), -origin.x, -origin.y);
+			[weakSelf drawRect:CGRectOffset(rect, origin.x, origin.y)];
+		};
+		[self insertSubview:_viewport atIndex:0];
+		self.layer.contents = nil;
+		[self _moveViewportIfNeeded:YES];
+	} else {
+		[_viewport removeFromSuperview];
+		_viewport = nil;
+		renderer.visibleLayoutRect = CGRectNull;
+	}
+	[self _observeScrollViews];
+	[self setNeedsDisplay];
+}
+
+// Drawing goes through the viewport, if there is one.
+- (BOOL)_disableDrawRect
+{
+	return (_viewport != nil);
+}
+
+- (void)setNeedsDisplay
+{
+	[super setNeedsDisplay];
+	[_viewport setNeedsDisplay];
+}
+
+- (void)setNeedsDisplayInRect:(CGRect)rect
+{
+	[super setNeedsDisplayInRect:rect];
+	if(_viewport != nil)
+		[_viewport setNeedsDisplayInRect:CGRectOffset(rect, -_viewport.frame.origin.x, -_viewport.frame.origin.y)];
+}
+
+- (void)layoutSubviews
+{
+	[super layoutSubviews];
+	
+	// the text moves with the top of the text view
+	if(_viewport != nil)
+		[self _moveViewportIfNeeded:YES];
+}
+
+- (void)didMoveToSuperview
+{
+	[super didMoveToSuperview];
+	[self _observeScrollViews];
+}
+
+- (void)didMoveToWindow
+{
+	[super didMoveToWindow];
+	[self _observeScrollViews];
+}
+
+// A virtualized layout follows the scroll views the text view is in, and only those.
+- (void)_observeScrollViews
+{
+	for(TUIScrollView *scrollView in _observedScrollViews)
+		[scrollView removeScrollObserver:self];
+	[_observedScrollViews removeAllObjects];
+	if(_viewport == nil)
+		return;
+	
+	if(_observedScrollViews == nil)
+		_observedScrollViews = [NSHashTable weakObjectsHashTable];
+	for(TUIView *v = self.superview; v != nil; v = v.superview) {
+		if([v isKindOfClass:[TUIScrollView class]]) {
+			[(TUIScrollView *)v addScrollObserver:self];
+			[_observedScrollViews addObject:v];
+		}
+	}
+	[self _moveViewportIfNeeded:NO];
+}
+
+// The part of the text view its scroll views show, in its own coordinates.
+- (CGRect)_visibleRect
+{
+	CGRect visibleRect = self.bounds;
+	for(TUIView *v = self.superview; v != nil; v = v.superview) {
+		if([v isKindOfClass:[TUIScrollView class]])
+			visibleRect = CGRectIntersection(visibleRect, [self convertRect:[(TUIScrollView *)v visibleRect] fromView:v]);
+	}
+	return visibleRect;
+}
+
+/*
+ Moves the viewport over what's on screen and a margin around it, and
+ redraws it, once scrolling gets past what it covers or when @p force is set.
+ */
+- (void)_moveViewportIfNeeded:(BOOL)force
+{
+	CGRect visibleRect = [self _visibleRect];
+	if(CGRectIsEmpty(visibleRect) || (!force && CGRectContainsRect(_viewport.frame, visibleRect)))
+		return;
+	
+	CGRect frame = CGRectIntegral(CGRectIntersection(CGRectInset(visibleRect, 0.0f, -TUITextViewVirtualizedDrawingMargin), self.bounds));
+	[TUIView setAnimationsEnabled:NO block:^{
+		_viewport.frame = frame;
+	}];
+	// the renderer keeps the layout for what the viewport covers, however little of it is redrawn
+	renderer.visibleLayoutRect = frame;
+	[_viewport setNeedsDisplay];
+}
+
+- (void)scrollViewDidChangeContentOffset:(TUIScrollView *)scrollView
+{
+	[self _moveViewportIfNeeded:NO];
 }
 
 - (TUIResponder *)initialFirstResponder
@@ -342,6 +494,7 @@ static CAAnimation *ThrobAnimation()
 		CGContextClipToRoundRect(ctx, CGRectInset(textRect, 0.0f, -radius), radius);
 	}
 	
+	// with a virtualized layout, this is the viewport's context, clipped to what it covers
 	[renderer draw];
 	
 	if(renderer.attributedString.length < 1 && self.placeholder.length > 0) {
@@ -404,101 +557,237 @@ static CAAnimation *ThrobAnimation()
 	if(_textViewFlags.delegateTextViewDidChange)
 		[delegate textViewDidChange:self];
 	
+	NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+	NSTimeInterval interval = now - _lastEditTime;
+	_lastEditTime = now;
+	
 	if(spellCheckingEnabled) {
-		[self _checkSpelling];
+		// only gaps while typing tell us how fast they type
+		if(interval < TUITextViewMaximumSpellCheckingDelay)
+			_typingInterval = (_typingInterval > 0.0) ? (_typingInterval * 0.8 + interval * 0.2) : interval;
+		
+		NSTimeInterval delay = MIN(MAX(_typingInterval * TUITextViewSpellCheckingDelayFactor, TUITextViewMinimumSpellCheckingDelay), TUITextViewMaximumSpellCheckingDelay);
+		[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(_checkSpelling) object:nil];
+		[self performSelector:@selector(_checkSpelling) withObject:nil afterDelay:delay];
 	}
 }
 
+// Moves what spell checking knows about the text along with an edit.
+- (void)_spellingDidEditRange:(NSRange)range changeInLength:(NSInteger)delta
+{
+	NSUInteger oldEnd = NSMaxRange(range) - delta;
+	[_uncheckedIndexes shiftIndexesStartingAtIndex:oldEnd by:delta];
+	
+	for(TUITextViewSpellingRequest *request in _pendingSpellingRequests) {
+		NSRange requestRange = request.range;
+		if(requestRange.location >= oldEnd) {
+			requestRange.location += delta;
+			request.range = requestRange;
+		} else if(NSMaxRange(requestRange) >= range.location) {
+			request.cancelled = YES;
+		}
+	}
+}
+
+// Sent by the text editor for each edit.
+- (void)_textDidEditRange:(NSRange)range changeInLength:(NSInteger)delta
+{
+	if(!spellCheckingEnabled)
+		return;
+	
+	[self _spellingDidEditRange:range changeInLength:delta];
+	
+	if(_uncheckedIndexes == nil)
+		_uncheckedIndexes = [[NSMutableIndexSet alloc] init];
+	[_uncheckedIndexes addIndexesInRange:NSMakeRange(range.location, MAX(range.length, 1))];
+}
+
+- (void)setSpellCheckingEnabled:(BOOL)enabled
+{
+	if(spellCheckingEnabled == enabled) return;
+	
+	spellCheckingEnabled = enabled;
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(_checkSpelling) object:nil];
+	if(enabled) {
+		// edits made while it was off weren't kept track of, so all of the text needs checking
+		_uncheckedIndexes = [[NSMutableIndexSet alloc] initWithIndexesInRange:NSMakeRange(0, MAX([self.text length], 1))];
+		[self performSelector:@selector(_checkSpelling) withObject:nil afterDelay:TUITextViewMinimumSpellCheckingDelay];
+	} else {
+		_uncheckedIndexes = nil;
+		for(TUITextViewSpellingRequest *request in _pendingSpellingRequests)
+			request.cancelled = YES;
+	}
+}
+
+- (void)setAutocorrectionEnabled:(BOOL)enabled
+{
+	autocorrectionEnabled = enabled;
+	
+	// results were checked for different things
+	[_checkingResultsCache removeAllObjects];
+}
+
+/*
+ Checks the spelling of every paragraph edited since the last check.
+ Results are cached by paragraph, so a paragraph which is edited back to
+ how it was, or which is the same as another, is only checked once.
+ */
 - (void)_checkSpelling
 {
+	NSString *text = self.text;
+	NSUInteger length = [text length];
+	NSIndexSet *uncheckedIndexes = _uncheckedIndexes;
+	_uncheckedIndexes = nil;
+	
+	if(_checkingResultsCache == nil)
+		_checkingResultsCache = [[NSCache alloc] init];
+	if(_pendingSpellingRequests == nil)
+		_pendingSpellingRequests = [[NSMutableArray alloc] init];
+	
+	NSMutableIndexSet *paragraphIndexes = [NSMutableIndexSet indexSet];
+	[uncheckedIndexes enumerateRangesUsingBlock:^(NSRange range, BOOL *stop) {
+		NSUInteger start = MIN(range.location, length);
+		NSUInteger end = MIN(NSMaxRange(range), length);
+		[paragraphIndexes addIndexesInRange:[text paragraphRangeForRange:NSMakeRange(start, end - start)]];
+	}];
+	
+	[paragraphIndexes enumerateRangesUsingBlock:^(NSRange range, BOOL *stop) {
+		NSUInteger location = range.location;
+		while(location < NSMaxRange(range)) {
+			NSRange paragraphRange = [text paragraphRangeForRange:NSMakeRange(location, 0)];
+			[self _checkSpellingOfParagraphInRange:paragraphRange ofString:text];
+			location = NSMaxRange(paragraphRange);
+		}
+	}];
+}
+
+- (void)_checkSpellingOfParagraphInRange:(NSRange)paragraphRange ofString:(NSString *)text
+{
+	NSString *paragraph = [text substringWithRange:paragraphRange];
+	NSArray *cachedResults = [_checkingResultsCache objectForKey:paragraph];
+	if(cachedResults != nil) {
+		[self _applyCheckingResults:cachedResults toParagraphInRange:paragraphRange];
+		return;
+	}
+	
+	TUITextViewSpellingRequest *request = [[TUITextViewSpellingRequest alloc] init];
+	request.paragraph = paragraph;
+	request.range = paragraphRange;
+	[_pendingSpellingRequests addObject:request];
+	
 	NSTextCheckingType checkingTypes = NSTextCheckingTypeSpelling;
 	if(autocorrectionEnabled) checkingTypes |= NSTextCheckingTypeCorrection | NSTextCheckingTypeReplacement;
 	
-	NSRange wholeLineRange = NSMakeRange(0, [self.text length]);
-	lastCheckToken = [[NSSpellChecker sharedSpellChecker] requestCheckingOfString:self.text range:wholeLineRange types:checkingTypes options:nil inSpellDocumentWithTag:0 completionHandler:^(NSInteger sequenceNumber, NSArray *results, NSOrthography *orthography, NSInteger wordCount) {
-		NSRange selectionRange = [self selectedRange];
-		__block NSRange activeWordSubstringRange = NSMakeRange(0, 0);
-		[self.text enumerateSubstringsInRange:NSMakeRange(0, [self.text length]) options:NSStringEnumerationByWords | NSStringEnumerationSubstringNotRequired | NSStringEnumerationReverse | NSStringEnumerationLocalized usingBlock:^(NSString *substring, NSRange substringRange, NSRange enclosingRange, BOOL *stop) {
+	[[NSSpellChecker sharedSpellChecker] requestCheckingOfString:paragraph range:NSMakeRange(0, [paragraph length]) types:checkingTypes options:nil inSpellDocumentWithTag:0 completionHandler:^(NSInteger sequenceNumber, NSArray *results, NSOrthography *orthography, NSInteger wordCount) {
+		// This needs to happen on the main thread so that the user doesn't enter more text while we're changing the attributed string.
+		dispatch_async(dispatch_get_main_queue(), ^{
+			[_pendingSpellingRequests removeObjectIdenticalTo:request];
+			[_checkingResultsCache setObject:results forKey:paragraph];
+			
+			// an edit will check it again soon enough
+			if(!request.cancelled)
+				[self _applyCheckingResults:results toParagraphInRange:request.range];
+		});
+	}];
+}
+
+- (void)_applyCheckingResults:(NSArray *)results toParagraphInRange:(NSRange)paragraphRange
+{
+	NSMutableAttributedString *backingStore = [renderer backingStore];
+	NSRange selectionRange = [self selectedRange];
+	
+	// Don't check the word they're typing. It's just annoying.
+	__block NSRange activeWordSubstringRange = NSMakeRange(0, 0);
+	if(NSLocationInRange(selectionRange.location, paragraphRange) || selectionRange.location == NSMaxRange(paragraphRange)) {
+		[[backingStore string] enumerateSubstringsInRange:paragraphRange options:NSStringEnumerationByWords | NSStringEnumerationSubstringNotRequired | NSStringEnumerationReverse | NSStringEnumerationLocalized usingBlock:^(NSString *substring, NSRange substringRange, NSRange enclosingRange, BOOL *stop) {
 			if(selectionRange.location >= substringRange.location && selectionRange.location <= substringRange.location + substringRange.length) {
 				activeWordSubstringRange = substringRange;
 				*stop = YES;
 			}
 		}];
+	}
+	
+	[backingStore beginEditing];
+	
+	[backingStore removeAttribute:(id)kCTUnderlineColorAttributeName range:paragraphRange];
+	[backingStore removeAttribute:(id)kCTUnderlineStyleAttributeName range:paragraphRange];
+	
+	// corrections change the length of the paragraph, moving the results after them
+	NSInteger offset = paragraphRange.location;
+	for(NSTextCheckingResult *relativeResult in results) {
+		NSTextCheckingResult *result = [relativeResult resultByAdjustingRangesWithOffset:offset];
 		
-		// This needs to happen on the main thread so that the user doesn't enter more text while we're changing the attributed string.
-		dispatch_async(dispatch_get_main_queue(), ^{
-			// we only care about the most recent results, ignore anything older
-			if(sequenceNumber != lastCheckToken) return;
+		BOOL isActiveWord = NSEqualRanges(result.range, activeWordSubstringRange);
+		if(selectionRange.length == 0) {
+			if(isActiveWord) continue;
 			
-			if([self.lastCheckResults isEqualToArray:results]) return;
-			
-			[[renderer backingStore] beginEditing];
-			
-			NSRange wholeStringRange = NSMakeRange(0, [self.text length]);
-			[[renderer backingStore] removeAttribute:(id)kCTUnderlineColorAttributeName range:wholeStringRange];
-			[[renderer backingStore] removeAttribute:(id)kCTUnderlineStyleAttributeName range:wholeStringRange];
-			
-			NSMutableArray *autocorrectedResultsThisRound = [NSMutableArray array];
-			for(NSTextCheckingResult *result in results) {
-				// Don't check the word they're typing. It's just annoying.
-				BOOL isActiveWord = NSEqualRanges(result.range, activeWordSubstringRange);
-				if(selectionRange.length == 0) {
-					if(isActiveWord) continue;
-					
-					// Don't correct if it looks like they might be typing a contraction.
-					unichar lastCharacter = [[[renderer backingStore] string] characterAtIndex:self.selectedRange.location - 1];
-					if(lastCharacter == '\'') continue;
-				}
+			// Don't correct if it looks like they might be typing a contraction.
+			if(selectionRange.location > 0 && selectionRange.location <= [backingStore length]) {
+				unichar lastCharacter = [[backingStore string] characterAtIndex:selectionRange.location - 1];
+				if(lastCharacter == '\'') continue;
+			}
+		}
+		
+		if(result.resultType == NSTextCheckingTypeCorrection || result.resultType == NSTextCheckingTypeReplacement) {
+			NSString *backingString = [backingStore string];
+			if(NSMaxRange(result.range) <= backingString.length) {
+				NSString *oldString = [backingString substringWithRange:result.range];
+				TUITextViewAutocorrectedPair *correctionPair = [[TUITextViewAutocorrectedPair alloc] init];
+				correctionPair.correctionResult = result;
+				correctionPair.originalString = oldString;
+				
+				// Don't redo corrections that the user undid.
+				if([self.autocorrectedResults objectForKey:correctionPair] != nil) continue;
+				
+				[backingStore removeAttribute:(id)kCTUnderlineColorAttributeName range:result.range];
+				[backingStore removeAttribute:(id)kCTUnderlineStyleAttributeName range:result.range];
+				
+				[self.autocorrectedResults setObject:oldString forKey:correctionPair];
+				[backingStore replaceCharactersInRange:result.range withString:result.replacementString];
 				
-				if(result.resultType == NSTextCheckingTypeCorrection || result.resultType == NSTextCheckingTypeReplacement) {
-					NSString *backingString = [[renderer backingStore] string];
-					if(NSMaxRange(result.range) <= backingString.length) {
-						NSString *oldString = [backingString substringWithRange:result.range];
-						TUITextViewAutocorrectedPair *correctionPair = [[TUITextViewAutocorrectedPair alloc] init];
-						correctionPair.correctionResult = result;
-						correctionPair.originalString = oldString;
-						
-						// Don't redo corrections that the user undid.
-						if([self.autocorrectedResults objectForKey:correctionPair] != nil) continue;
-						
-						[[renderer backingStore] removeAttribute:(id)kCTUnderlineColorAttributeName range:result.range];
-						[[renderer backingStore] removeAttribute:(id)kCTUnderlineStyleAttributeName range:result.range];
-						
-						[self.autocorrectedResults setObject:oldString forKey:correctionPair];
-						[[renderer backingStore] replaceCharactersInRange:result.range withString:result.replacementString];
-						[autocorrectedResultsThisRound addObject:result];
-						
-						// the replacement could have changed the length of the string, so adjust the selection to account for that
-						NSInteger lengthChange = result.replacementString.length - oldString.length;
-						[self setSelectedRange:NSMakeRange(self.selectedRange.location + lengthChange, self.selectedRange.length)];
-					} else {
-						NSLog(@"Autocorrection result that's out of range: %@", result);
-					}
-				} else if(result.resultType == NSTextCheckingTypeSpelling) {
-					[[renderer backingStore] addAttribute:NSUnderlineColorAttributeName value:[NSColor redColor] range:result.range];
-					[[renderer backingStore] addAttribute:(id)kCTUnderlineStyleAttributeName value:[NSNumber numberWithInteger:kCTUnderlineStyleThick | kCTUnderlinePatternDot] range:result.range];
-				}
+				// the replacement could have changed the length of the string, so adjust the selection to account for that
+				NSInteger lengthChange = result.replacementString.length - oldString.length;
+				[renderer invalidateLayoutInRange:NSMakeRange(result.range.location, result.replacementString.length) changeInLength:lengthChange];
+				[self _spellingDidEditRange:NSMakeRange(result.range.location, result.replacementString.length) changeInLength:lengthChange];
+				[self setSelectedRange:NSMakeRange(self.selectedRange.location + lengthChange, self.selectedRange.length)];
+				paragraphRange.length += lengthChange;
+				offset += lengthChange;
+			} else {
+				NSLog(@"Autocorrection result that's out of range: %@", result);
 			}
-			
-			[[renderer backingStore] endEditing];
-			[renderer reset]; // make sure we reset so that the renderer uses our new attributes
-			
-			[self setNeedsDisplay];
-			
-			self.lastCheckResults = results;
-		});
-	}];
+		} else if(result.resultType == NSTextCheckingTypeSpelling) {
+			[backingStore addAttribute:NSUnderlineColorAttributeName value:[NSColor redColor] range:result.range];
+			[backingStore addAttribute:(id)kCTUnderlineStyleAttributeName value:[NSNumber numberWithInteger:kCTUnderlineStyleThick | kCTUnderlinePatternDot] range:result.range];
+		}
+	}
+	
+	[backingStore endEditing];
+	[renderer invalidateLayoutInRange:paragraphRange changeInLength:0]; // make sure the renderer uses our new attributes
+	
+	[self setNeedsDisplay];
+}
+
+// The checking result under a string index, from the last check of its paragraph.
+- (NSTextCheckingResult *)_checkingResultAtIndex:(NSUInteger)stringIndex
+{
+	NSString *text = self.text;
+	if(stringIndex > [text length])
+		return nil;
+	
+	NSRange paragraphRange = [text paragraphRangeForRange:NSMakeRange(stringIndex, 0)];
+	NSArray *results = [_checkingResultsCache objectForKey:[text substringWithRange:paragraphRange]];
+	for(NSTextCheckingResult *result in results) {
+		NSRange range = NSMakeRange(result.range.location + paragraphRange.location, result.range.length);
+		if(stringIndex >= range.location && stringIndex <= range.location + range.length)
+			return [result resultByAdjustingRangesWithOffset:paragraphRange.location];
+	}
+	return nil;
 }
 
 - (NSMenu *)menuForEvent:(NSEvent *)event
 {
 	CFIndex stringIndex = [renderer stringIndexForEvent:event];
-	for(NSTextCheckingResult *result in lastCheckResults) {
-		if(stringIndex >= result.range.location && stringIndex <= result.range.location + result.range.length) {
-			self.selectedTextCheckingResult = result;
-			break;
-		}
-	}
+	self.selectedTextCheckingResult = [self _checkingResultAtIndex:stringIndex];
 	
 	TUITextViewAutocorrectedPair *matchingAutocorrectPair = nil;
 	if(selectedTextCheckingResult == nil) {
@@ -590,9 +879,10 @@ static CAAnimation *ThrobAnimation()
 	[[renderer backingStore] removeAttribute:(id)kCTUnderlineStyleAttributeName range:selectedTextCheckingResult.range];
 	[[renderer backingStore] replaceCharactersInRange:self.selectedTextCheckingResult.range withString:replacement];
 	[[renderer backingStore] endEditing];
-	[renderer reset];
 	
 	NSInteger lengthChange = replacement.length - oldString.length;
+	[renderer invalidateLayoutInRange:NSMakeRange(self.selectedTextCheckingResult.range.location, replacement.length) changeInLength:lengthChange];
+	[self _textDidEditRange:NSMakeRange(self.selectedTextCheckingResult.range.location, replacement.length) changeInLength:lengthChange];
 	[self setSelectedRange:NSMakeRange(self.selectedRange.location + lengthChange, self.selectedRange.length)];
 	
 	[self _textDidChange];
@@ -609,9 +899,10 @@ static CAAnimation *ThrobAnimation()
 	[[renderer backingStore] removeAttribute:(id)kCTUnderlineStyleAttributeName range:selectedTextCheckingResult.range];
 	[[renderer backingStore] replaceCharactersInRange:self.selectedTextCheckingResult.range withString:replacement];
 	[[renderer backingStore] endEditing];
-	[renderer reset];
 	
 	NSInteger lengthChange = replacement.length - oldString.length;
+	[renderer invalidateLayoutInRange:NSMakeRange(self.selectedTextCheckingResult.range.location, replacement.length) changeInLength:lengthChange];
+	[self _textDidEditRange:NSMakeRange(self.selectedTextCheckingResult.range.location, replacement.length) changeInLength:lengthChange];
 	[self setSelectedRange:NSMakeRange(self.selectedRange.location + lengthChange, self.selectedRange.length)];
 	
 	[self _textDidChange];
@@ -738,6 +1029,11 @@ static CAAnimation *ThrobAnimation()
 	if(_textViewFlags.delegateDidResignFirstResponder) [delegate textViewDidResignFirstResponder:self];
 }
 
+- (void)textRendererDidUpdateEstimatedSize:(TUITextRenderer *)textRenderer
+{
+	if(_textViewFlags.delegateDidUpdateEstimatedSize) [delegate textViewDidUpdateEstimatedSize:self];
+}
+
 @end
 
 static void TUITextViewDrawRoundedFrame(TUIView *view, CGFloat radius, BOOL overDark)
@@ -63,6 +63,7 @@ typedef enum TUIViewContentMode : NSUInteger {
 @class TUINSView;
 @class TUINSWindow;
 @class TUIView;
+struct TUIViewBackingStore;
 
 typedef void(^TUIViewDrawRect)(TUIView *, CGRect);
 typedef CGRect(^TUIViewLayout)(TUIView *);
@@ -98,12 +99,12 @@ extern CGRect(^TUIViewCenteredLayout)(TUIView*);
 	__unsafe_unretained TUINSView *_nsView; // keep this updated, fast way of getting .nsView
 	
 	struct {
-		NSInteger lastWidth;
-		NSInteger lastHeight;
-		BOOL lastOpaque;
-		CGContextRef context;
+		CGContextRef context; // checked out of the backing store pool while drawing
+		struct TUIViewBackingStore *frontStore; // shown as the layer contents, for views redrawn in part
+		struct TUIViewBackingStore *backStore; // drawn into next, once nothing shows it anymore
 		CGRect dirtyRect;
-		CGFloat lastContentsScale;
+		CGSize pixelSize;
+		BOOL opaque;
 	} _context;
 	
 	struct {
@@ -197,7 +198,7 @@ extern CGRect(^TUIViewCenteredLayout)(TUIView*);
 @property (nonatomic, assign) TUIViewContentMode contentMode;
 
 /**
- If YES, drawing will be done in a background queue. If `drawQueue` is nil, it will be performed in the DISPATCH_QUEUE_PRIORITY_DEFAULT global queue. Note that `-viewWillDisplayLayer:` will still be called on the main thread.
+ If YES, drawing will be done in a background queue. If `drawQueue` is nil, it will be performed in a global queue. Draws are scheduled by TUIRenderScheduler, which coalesces redraws of the same view, draws visible views first, and sets the results as layer contents on the main thread in the order they were requested. Note that `-viewWillDisplayLayer:` will still be called on the main thread.
  
  Defaults to NO.
  */
@@ -361,7 +362,14 @@ extern CGRect(^TUIViewCenteredLayout)(TUIView*);
  */
 - (TUIView *)firstSuperviewOfClass:(Class)c;
 
+/**
+ Marks the view as needing layout. Views are laid out once each before the next run loop cycle, superviews first, however many times they ask. See TUICommitScheduler.
+ */
 - (void)setNeedsLayout;
+
+/**
+ Lays the view out now if it's marked as needing layout, first applying the constraints of any views moved since the last commit.
+ */
 - (void)layoutIfNeeded;
 
 /**
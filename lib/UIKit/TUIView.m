@@ -14,13 +14,17 @@
  limitations under the License.
  */
 
+#import <libkern/OSAtomic.h>
 #import <pthread.h>
+#import "TUIBackingStorePool.h"
 #import "TUICGAdditions.h"
+#import "TUICommitScheduler.h"
 #import "TUIView.h"
 #import "TUILayoutManager.h"
 #import "TUINSView.h"
 #import "TUINSView+Private.h"
 #import "TUINSWindow.h"
+#import "TUIRenderScheduler.h"
 #import "TUITextRenderer.h"
 #import "TUIViewController.h"
 
@@ -137,10 +141,8 @@ static pthread_key_t TUICurrentContextScaleFactorTLSKey;
     
 	[self setTextRenderers:nil];
 	_layer.delegate = nil;
-	if(_context.context) {
-		CGContextRelease(_context.context);
-		_context.context = NULL;
-	}
+	[self _releaseCGContext];
+	[self _releaseBackingStores];
 }
 
 - (id)initWithFrame:(CGRect)frame
@@ -280,42 +282,206 @@ static pthread_key_t TUICurrentContextScaleFactorTLSKey;
 	return NO;
 }
 
+- (CGSize)_CGContextPixelSize
+{
+	CGSize size = self.bounds.size;
+	CGFloat scale = [self.layer respondsToSelector:@selector(contentsScale)] ? self.layer.contentsScale : 1.0f;
+	return CGSizeMake(MAX(1, (NSInteger)(size.width * scale)), MAX(1, (NSInteger)(size.height * scale)));
+}
+
+/*
+ Backing stores come from the shared pool for the duration of a draw, and
+ may be larger than the view; see -_releaseCGContext.
+ */
 - (CGContextRef)_CGContext
 {
-	CGRect b = self.bounds;
-	NSInteger w = b.size.width;
-	NSInteger h = b.size.height;
-	BOOL o = self.opaque;
-	CGFloat currentScale = [self.layer respondsToSelector:@selector(contentsScale)] ? self.layer.contentsScale : 1.0f;
-	
+	if(!_context.context) {
+		_context.pixelSize = [self _CGContextPixelSize];
+		_context.opaque = self.opaque;
+		_context.context = [[TUIBackingStorePool sharedPool] checkOutContextWithPixelSize:_context.pixelSize opaque:_context.opaque];
+	}
+	return _context.context;
+}
+
+- (void)_releaseCGContext
+{
 	if(_context.context) {
-		// kill if we're a different size
-		if(w != _context.lastWidth || 
-		   h != _context.lastHeight ||
-		   o != _context.lastOpaque ||
-		   fabs(currentScale - _context.lastContentsScale) > 0.1f) 
-		{
-			CGContextRelease(_context.context);
-			_context.context = NULL;
-		}
+		[[TUIBackingStorePool sharedPool] checkInContext:_context.context];
+		_context.context = NULL;
 	}
+}
+
+/*
+ A backing store kept by a view which is redrawn in part. The image showing
+ a store holds a reference to it, so a store is only drawn into once the
+ view's is the only reference left, and whichever lets go last hands the
+ context back to the pool.
+ */
+typedef struct TUIViewBackingStore {
+	volatile int32_t referenceCount;
+	CGContextRef context;
+	CGRect staleRect; // drawn in the other store since this one was shown, in points
+} TUIViewBackingStore;
+
+static TUIViewBackingStore *TUIViewBackingStoreCreate(CGSize pixelSize, BOOL opaque)
+{
+	TUIViewBackingStore *store = calloc(1, sizeof(TUIViewBackingStore));
+	store->referenceCount = 1;
+	store->context = [[TUIBackingStorePool sharedPool] checkOutContextWithPixelSize:pixelSize opaque:opaque];
+	store->staleRect = CGRectInfinite;
+	return store;
+}
+
+static void TUIViewBackingStoreRelease(TUIViewBackingStore *store)
+{
+	if(store != NULL && OSAtomicDecrement32Barrier(&store->referenceCount) == 0) {
+		[[TUIBackingStorePool sharedPool] checkInContext:store->context];
+		free(store);
+	}
+}
+
+static BOOL TUIViewBackingStoreIsWritable(TUIViewBackingStore *store)
+{
+	OSMemoryBarrier();
+	return store->referenceCount == 1;
+}
+
+/*
+ Copies what's in @p rect, in points, from one store to the other, both
+ drawn at @p scale in their bottom left corners.
+ */
+static void TUIViewBackingStoreCopyRect(TUIViewBackingStore *destination, TUIViewBackingStore *source, CGRect rect, CGSize pixelSize, CGFloat scale)
+{
+	rect = CGRectIntersection(rect, CGRectMake(0, 0, pixelSize.width / scale, pixelSize.height / scale));
+	if(CGRectIsEmpty(rect))
+		return;
+	rect = CGRectIntegral(CGRectMake(rect.origin.x * scale, rect.origin.y * scale, rect.size.width * scale, rect.size.height * scale));
+	rect = CGRectIntersection(rect, CGRectMake(0, 0, pixelSize.width, pixelSize.height));
+	if(CGRectIsEmpty(rect))
+		return;
 	
-	if(!_context.context) {
-		// create a new context with the correct parameters
-		_context.lastWidth = w;
-		_context.lastHeight = h;
-		_context.lastOpaque = o;
-		_context.lastContentsScale = currentScale;
-
-		b.size.width *= currentScale;
-		b.size.height *= currentScale;
-		if(b.size.width < 1) b.size.width = 1;
-		if(b.size.height < 1) b.size.height = 1;
-		CGContextRef ctx = TUICreateGraphicsContextWithOptions(b.size, o);
-		_context.context = ctx;
+	size_t bytesPerPixel = CGBitmapContextGetBitsPerPixel(source->context) / 8;
+	size_t sourceBytesPerRow = CGBitmapContextGetBytesPerRow(source->context);
+	size_t destinationBytesPerRow = CGBitmapContextGetBytesPerRow(destination->context);
+	size_t rowBytes = (size_t)rect.size.width * bytesPerPixel;
+	
+	// rows are stored from the top
+	size_t firstRow = CGBitmapContextGetHeight(source->context) - (size_t)CGRectGetMaxY(rect);
+	const uint8_t *from = (const uint8_t *)CGBitmapContextGetData(source->context) + firstRow * sourceBytesPerRow + (size_t)rect.origin.x * bytesPerPixel;
+	firstRow = CGBitmapContextGetHeight(destination->context) - (size_t)CGRectGetMaxY(rect);
+	uint8_t *to = (uint8_t *)CGBitmapContextGetData(destination->context) + firstRow * destinationBytesPerRow + (size_t)rect.origin.x * bytesPerPixel;
+	for(size_t row = 0; row < (size_t)rect.size.height; row++)
+		memcpy(to + row * destinationBytesPerRow, from + row * sourceBytesPerRow, rowBytes);
+}
+
+- (void)_releaseBackingStores
+{
+	TUIViewBackingStoreRelease(_context.frontStore);
+	TUIViewBackingStoreRelease(_context.backStore);
+	_context.frontStore = NULL;
+	_context.backStore = NULL;
+}
+
+/*
+ The context to redraw a view which keeps its backing stores into: the back
+ store, brought up to date with what's shown if only part of it is to be
+ redrawn. A back store which some image still shows, on screen or on its way
+ there, is let go for a new one. If there's nothing to bring a new store up
+ to date from, @p partial is cleared.
+ */
+- (CGContextRef)_backStoreContextWithPixelSize:(CGSize)pixelSize scale:(CGFloat)scale partial:(BOOL *)partial
+{
+	_context.pixelSize = pixelSize;
+	_context.opaque = self.opaque;
+	
+	TUIViewBackingStore *back = _context.backStore;
+	if(back != NULL && !TUIViewBackingStoreIsWritable(back)) {
+		TUIViewBackingStoreRelease(back);
+		back = NULL;
 	}
+	if(back == NULL)
+		back = TUIViewBackingStoreCreate(pixelSize, _context.opaque);
+	_context.backStore = back;
 	
-	return _context.context;
+	if(*partial) {
+		if(_context.frontStore != NULL) {
+			// only what was drawn since this store was last shown
+			TUIViewBackingStoreCopyRect(back, _context.frontStore, back->staleRect, pixelSize, scale);
+		} else {
+			// the first time around, only the layer contents have what was drawn last
+			id contents = self.layer.contents;
+			CGImageRef previousImage = (contents != nil && CFGetTypeID((__bridge CFTypeRef)contents) == CGImageGetTypeID()) ? (__bridge CGImageRef)contents : NULL;
+			if(previousImage != NULL && CGImageGetWidth(previousImage) == pixelSize.width && CGImageGetHeight(previousImage) == pixelSize.height) {
+				CGContextSetBlendMode(back->context, kCGBlendModeCopy);
+				CGContextDrawImage(back->context, CGRectMake(0, 0, pixelSize.width, pixelSize.height), previousImage);
+				CGContextSetBlendMode(back->context, kCGBlendModeNormal);
+			} else {
+				*partial = NO;
+			}
+		}
+	}
+	return back->context;
+}
+
+static void TUIReleaseImageData(void *info, const void *data, size_t size)
+{
+	free((void *)data);
+}
+
+/*
+ The layer contents for what was drawn in the bottom left corner of @p context.
+ The pixels are copied into memory the image owns, rather than snapshotted
+ copy-on-write, so the context can go straight back to the pool without
+ anything on screen still sharing its pages, and the image takes up only
+ its own size rather than the whole pool bucket.
+ */
+- (id)_layerContentsFromCGContext:(CGContextRef)context pixelSize:(CGSize)pixelSize
+{
+	size_t width = pixelSize.width;
+	size_t height = pixelSize.height;
+	size_t rowBytes = width * (CGBitmapContextGetBitsPerPixel(context) / 8);
+	size_t contextBytesPerRow = CGBitmapContextGetBytesPerRow(context);
+	size_t bytesPerRow = (rowBytes + 15) & ~(size_t)15;
+	uint8_t *data = malloc(bytesPerRow * height);
+	if(data == NULL)
+		return nil;
+	
+	// rows are stored from the top, and the drawing is at the bottom
+	const uint8_t *source = (const uint8_t *)CGBitmapContextGetData(context) + (CGBitmapContextGetHeight(context) - height) * contextBytesPerRow;
+	for(size_t row = 0; row < height; row++)
+		memcpy(data + row * bytesPerRow, source + row * contextBytesPerRow, rowBytes);
+	
+	CGDataProviderRef provider = CGDataProviderCreateWithData(NULL, data, bytesPerRow * height, TUIReleaseImageData);
+	CGImageRef image = CGImageCreate(width, height, CGBitmapContextGetBitsPerComponent(context), CGBitmapContextGetBitsPerPixel(context), bytesPerRow, CGBitmapContextGetColorSpace(context), CGBitmapContextGetBitmapInfo(context), provider, NULL, false, kCGRenderingIntentDefault);
+	CGDataProviderRelease(provider);
+	return CFBridgingRelease(image);
+}
+
+static void TUIReleaseBackingStoreData(void *info, const void *data, size_t size)
+{
+	TUIViewBackingStoreRelease(info);
+}
+
+/*
+ Like -_layerContentsFromCGContext:pixelSize:, but the image is made over
+ the store's own pixels instead of a copy of them. The image holds a
+ reference to the store, which isn't drawn into again until the image is
+ gone.
+ */
+- (id)_layerContentsSharingPixelsWithBackingStore:(TUIViewBackingStore *)store pixelSize:(CGSize)pixelSize
+{
+	CGContextRef context = store->context;
+	size_t width = pixelSize.width;
+	size_t height = pixelSize.height;
+	size_t bytesPerRow = CGBitmapContextGetBytesPerRow(context);
+	// rows are stored from the top, and the drawing is at the bottom
+	uint8_t *data = (uint8_t *)CGBitmapContextGetData(context) + (CGBitmapContextGetHeight(context) - height) * bytesPerRow;
+	
+	OSAtomicIncrement32Barrier(&store->referenceCount);
+	CGDataProviderRef provider = CGDataProviderCreateWithData(store, data, bytesPerRow * height, TUIReleaseBackingStoreData);
+	CGImageRef image = CGImageCreate(width, height, CGBitmapContextGetBitsPerComponent(context), CGBitmapContextGetBitsPerPixel(context), bytesPerRow, CGBitmapContextGetColorSpace(context), CGBitmapContextGetBitmapInfo(context), provider, NULL, false, kCGRenderingIntentDefault);
+	CGDataProviderRelease(provider);
+	return CFBridgingRelease(image);
 }
 
 CGFloat TUICurrentContextScaleFactor(void)
@@ -352,23 +518,41 @@ static void TUISetCurrentContextScaleFactor(CGFloat s)
 		return;
 	}
 
-	void (^drawBlock)(void) = ^{
-		if (_viewFlags.delegateWillDisplayLayer) {
-			[_viewDelegate viewWillDisplayLayer:self];
+	// returns the new layer contents, so views drawing in the background can
+	// have them committed on the main thread
+	id (^renderBlock)(void) = ^id{
+		CGRect bounds = self.bounds;
+		CGRect rectToDraw = bounds;
+		CGRect dirtyRect = _context.dirtyRect;
+		_context.dirtyRect = CGRectZero;
+
+		CGSize pixelSize = [self _CGContextPixelSize];
+		CGFloat scale = [self.layer respondsToSelector:@selector(contentsScale)] ? self.layer.contentsScale : 1.0f;
+		if(_context.frontStore != NULL && (!CGSizeEqualToSize(_context.pixelSize, pixelSize) || _context.opaque != self.opaque || self.drawInBackground)) {
+			[self _releaseBackingStores];
 		}
 
-		CGRect rectToDraw = self.bounds;
-		if (!CGRectEqualToRect(_context.dirtyRect, CGRectZero)) {
-			rectToDraw = _context.dirtyRect;
-			_context.dirtyRect = CGRectZero;
+		// Redrawing only part of the view needs what was drawn last time. Views drawing
+		// on the main thread which are redrawn in part keep two backing stores: one
+		// shown as the layer contents, which is never drawn into while it is, and one
+		// to draw into next, which first gets a copy of just what changed since it was
+		// last shown. Other views draw into a store from the pool which goes straight
+		// back to it.
+		BOOL partial = (!self.drawInBackground && !CGRectIsEmpty(dirtyRect) && !CGRectIsInfinite(dirtyRect) && !CGRectContainsRect(dirtyRect, bounds));
+		BOOL buffered = (!self.drawInBackground && (partial || _context.frontStore != NULL));
+		CGContextRef context = buffered ? [self _backStoreContextWithPixelSize:pixelSize scale:scale partial:&partial] : [self _CGContext];
+		if(partial) {
+			rectToDraw = CGRectIntersection(dirtyRect, bounds);
 		}
 
-		CGContextRef context = [self _CGContext];
+		CGContextSaveGState(context);
 		TUIGraphicsPushContext(context);
 
-		CGFloat scale = [self.layer respondsToSelector:@selector(contentsScale)] ? self.layer.contentsScale : 1.0f;
 		TUISetCurrentContextScaleFactor(scale);
 		CGContextScaleCTM(context, scale, scale);
+		if(partial) {
+			CGContextClipToRect(context, rectToDraw);
+		}
 
 		if (_viewFlags.clearsContextBeforeDrawing) {
 			CGContextClearRect(context, rectToDraw);
@@ -395,22 +579,40 @@ static void TUISetCurrentContextScaleFactor(CGFloat s)
 		CGContextFillRect(context, rectToDraw);
 		#endif
 
-		layer.contents = TUIGraphicsGetImageFromCurrentImageContext();
-		CGContextScaleCTM(context, 1.0f / scale, 1.0f / scale);
 		TUIGraphicsPopContext();
-
-		if (self.drawInBackground) [CATransaction flush];
+		CGContextRestoreGState(context);
+		if(buffered) {
+			// show what was drawn without a copy, and draw into the other store next time
+			TUIViewBackingStore *drawn = _context.backStore;
+			TUIViewBackingStore *shown = _context.frontStore;
+			drawn->staleRect = CGRectNull;
+			if(shown != NULL)
+				shown->staleRect = partial ? CGRectUnion(shown->staleRect, rectToDraw) : CGRectInfinite;
+			_context.frontStore = drawn;
+			_context.backStore = shown;
+			return [self _layerContentsSharingPixelsWithBackingStore:drawn pixelSize:pixelSize];
+		} else {
+			id contents = [self _layerContentsFromCGContext:context pixelSize:pixelSize];
+			[self _releaseCGContext];
+			return contents;
+		}
 	};
-	
-	if (self.drawInBackground) {
-		layer.contents = nil;
-		
-		if (self.drawQueue != nil) {
-			[self.drawQueue addOperationWithBlock:drawBlock];
+
+	void (^drawBlock)(void) = ^{
+		[[TUICommitScheduler sharedScheduler] viewDidDisplay:self];
+		if (_viewFlags.delegateWillDisplayLayer) {
+			[_viewDelegate viewWillDisplayLayer:self];
+		}
+
+		if (self.drawInBackground) {
+			// coalesced with any other pending draw of this view, and committed in order on the main thread
+			[[TUIRenderScheduler sharedScheduler] scheduleRenderForView:self priority:[self _renderPriority] queue:self.drawQueue usingBlock:renderBlock];
 		} else {
-			dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), drawBlock);
+			layer.contents = renderBlock();
 		}
-	} else if ([NSThread isMainThread] || dispatch_get_current_queue() == dispatch_get_main_queue()) {
+	};
+
+	if ([NSThread isMainThread] || dispatch_get_current_queue() == dispatch_get_main_queue()) {
 		drawBlock();
 	} else {
 		// On Mac OS X 10.6 (and possibly other versions), spinning a run loop in
@@ -420,6 +622,20 @@ static void TUISetCurrentContextScaleFactor(CGFloat s)
 	}
 }
 
+- (TUIRenderPriority)_renderPriority
+{
+	TUINSView *view = self.nsView;
+	if(view == nil || view.window == nil || ![view.window isVisible])
+		return TUIRenderPriorityLow;
+
+	for(TUIView *v = self; v != nil; v = v.superview) {
+		if(v.hidden)
+			return TUIRenderPriorityLow;
+	}
+
+	return NSIntersectsRect(self.frameInNSView, [view visibleRect]) ? TUIRenderPriorityHigh : TUIRenderPriorityLow;
+}
+
 - (void)_blockLayout
 {
 	for(TUIView *v in self.subviews) {
@@ -438,6 +654,8 @@ static void TUISetCurrentContextScaleFactor(CGFloat s)
 
 - (void)layoutSublayersOfLayer:(CALayer *)layer
 {
+	if([NSThread isMainThread])
+		[[TUICommitScheduler sharedScheduler] viewDidLayout:self];
 	[self layoutSubviews];
 	[self _blockLayout];
 	[self.subviews makeObjectsPerformSelector:@selector(ancestorDidLayout)];
@@ -450,6 +668,9 @@ static void TUISetCurrentContextScaleFactor(CGFloat s)
 
 - (void)setDrawInBackground:(BOOL)drawInBackground
 {
+	if(!drawInBackground && _viewFlags.drawInBackground) {
+		[[TUIRenderScheduler sharedScheduler] cancelRendersForView:self];
+	}
 	_viewFlags.drawInBackground = drawInBackground;
 }
 
@@ -946,6 +1167,12 @@ static void TUISetCurrentContextScaleFactor(CGFloat s)
 }
 
 - (void)willMoveToWindow:(TUINSWindow *)newWindow {
+	if(newWindow == nil) {
+		// the store being shown stays with the layer contents, but nothing will be drawn into the other for a while
+		TUIViewBackingStoreRelease(_context.backStore);
+		_context.backStore = NULL;
+	}
+	
 	for(TUIView *subview in self.subviews) {
 		[subview willMoveToWindow:newWindow];
 	}
@@ -1020,10 +1247,15 @@ static void TUISetCurrentContextScaleFactor(CGFloat s)
 - (void)setNeedsLayout
 {
 	[self.layer setNeedsLayout];
+	// laid out once, superviews first, at the end of the run loop turn
+	if([NSThread isMainThread])
+		[[TUICommitScheduler sharedScheduler] setNeedsLayoutForView:self];
 }
 
 - (void)layoutIfNeeded
 {
+	// constraints on views moved this turn are otherwise applied at the commit
+	[[TUILayoutManager sharedLayoutManager] processChangedViews];
 	[self.layer layoutIfNeeded];
 }
 
@@ -1072,13 +1304,23 @@ static void TUISetCurrentContextScaleFactor(CGFloat s)
 
 - (void)setNeedsDisplay
 {
+	_context.dirtyRect = CGRectInfinite; // everything, even if part has already been marked
 	[self.layer setNeedsDisplay];
+	if([NSThread isMainThread])
+		[[TUICommitScheduler sharedScheduler] setNeedsDisplayForView:self];
 }
 
 - (void)setNeedsDisplayInRect:(CGRect)rect
 {
-	_context.dirtyRect = rect;
+	// accumulate until the next display, unless everything is already being redrawn
+	if(CGRectIsEmpty(_context.dirtyRect)) {
+		_context.dirtyRect = rect;
+	} else if(!CGRectIsInfinite(_context.dirtyRect)) {
+		_context.dirtyRect = CGRectUnion(_context.dirtyRect, rect);
+	}
 	[self.layer setNeedsDisplayInRect:rect];
+	if([NSThread isMainThread])
+		[[TUICommitScheduler sharedScheduler] setNeedsDisplayForView:self];
 }
 
 - (BOOL)clipsToBounds